@@ -10,7 +10,6 @@
 #include <mrpt/io/CFileGZInputStream.h>
 #include <mrpt/maps/COccupancyGridMap2D.h>
 #include <mrpt/maps/CSimplePointsMap.h>
-#include <mrpt/random/RandomGenerators.h>
 #include <mrpt/serialization/CArchive.h>
 #include <mrpt/system/filesystem.h>
 #include <mrpt/system/os.h>  // plugins
@@ -72,8 +71,8 @@ static TCLAP::ValueArg<std::string> arg_goal_vel(
 static TCLAP::ValueArg<size_t> argMaxIterations(
     "", "max-iterations", "Maximum RRT iterations", false, 1000, "1000", cmd);
 
-static TCLAP::ValueArg<unsigned int> argRandomSeed(
-    "", "random-seed", "Pseudorandom generator seed (default: from time)",
+static TCLAP::ValueArg<uint32_t> argRandomSeed(
+    "", "random-seed", "Pseudorandom generator seed (default: random)",
     false, 0, "0", cmd);
 
 static TCLAP::ValueArg<std::string> arg_plugins(
@@ -200,6 +199,9 @@ static void do_plan_path()
     if (argMaxIterations.isSet())
         planner.params_.maxIterations = argMaxIterations.getValue();
 
+    if (argRandomSeed.isSet())
+        planner.params_.randomSeed = argRandomSeed.getValue();
+
     // PTGs config file:
     mrpt::config::CConfigFile cfg(arg_ptgs_file.getValue());
     pi.ptgs.initFromConfigFile(cfg, arg_config_file_section.getValue());
@@ -208,6 +210,7 @@ static void do_plan_path()
 
     std::cout << "\nDone.\n";
     std::cout << "Success: " << (plan.success ? "YES" : "NO") << "\n";
+    std::cout << "Random seed: " << plan.randomSeed << "\n";
     std::cout << "Plan has " << plan.motionTree.edges_to_children.size()
               << " overall edges, " << plan.motionTree.nodes().size()
               << " nodes\n";
@@ -253,12 +256,6 @@ int main(int argc, char** argv)
             }
         }
 
-        if (argRandomSeed.isSet())
-        {
-            mrpt::random::getRandomGenerator().randomize(
-                argRandomSeed.getValue());
-        }
-
         do_plan_path();
         return 0;
     }
@@ -0,0 +1,256 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <mrpt/core/Clock.h>
+#include <mrpt/core/bits_math.h>
+#include <mrpt/math/TPose2D.h>
+#include <mrpt/system/COutputLogger.h>
+#include <mrpt/system/CTimeLogger.h>
+#include <mrpt/typemeta/TEnumType.h>
+#include <selfdriving/data/MoveEdgeSE2_TPS.h>
+#include <selfdriving/data/TrajectoriesAndRobotShape.h>
+#include <selfdriving/interfaces/VehicleMotionInterface.h>
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace selfdriving
+{
+struct PathTracker_Parameters
+{
+    PathTracker_Parameters() = default;
+
+    /** Rate of the tracking loop [Hz] */
+    double rate = 50.0;
+
+    /** Lengths of the odometry "pose volume" around the end of each motion
+     * that triggers the next one, see EnqueuedCondition::tolerance */
+    mrpt::math::TPose2D nextCmdTolerance = {0.10, 0.10, mrpt::DEG2RAD(5.0)};
+
+    /** Tracking is lost if an edge takes longer than its expected duration
+     * times edgeTimeoutFactor, plus edgeTimeoutMargin [s] */
+    double edgeTimeoutFactor = 2.0;
+    double edgeTimeoutMargin = 1.0;
+
+    /** [m] Tracking is lost if the vehicle gets closer than this to the end
+     * of an edge, then moves farther away without triggering the next
+     * command. Must be larger than nextCmdTolerance. */
+    double missedTriggerRadius = 0.30;
+};
+
+enum class PathTrackerStatus : uint8_t
+{
+    /** No path was given, or it was cleared */
+    IDLE = 0,
+    /** Executing a path */
+    TRACKING,
+    /** The final stop command of the path was triggered */
+    FINISHED,
+    /** The vehicle missed the trigger of a command. It was stopped. */
+    LOST
+};
+
+/** Executes planned paths, running in its own thread at a fixed rate
+ * independent of the planner and the navigation loop.
+ *
+ * When a path arrives (set_path()), it is precompiled into a queue of
+ * velocity commands, one per path edge (a MoveEdgeSE2_TPS) plus a final stop
+ * command, each one with the EnqueuedCondition that triggers it: a small
+ * odometry "pose volume" around the end pose of the former edge, computed
+ * from its PTG trajectory. The first command goes to the "immediate" slot of
+ * VehicleMotionInterface::motion_execute(), and the next one is always kept
+ * in the "next" slot, so the vehicle switches between edges by itself and
+ * the tracking loop only has to refill the "next" slot afterwards, with no
+ * PTG computation involved.
+ *
+ * Triggers are checked against the motion swept between consecutive
+ * odometry samples, not only against the latest one, since the vehicle may
+ * cross a trigger volume between ticks.
+ *
+ * Since the commands are open loop, the vehicle may miss a trigger volume
+ * (e.g. due to odometry drift, or a path not starting exactly at the
+ * vehicle). That is detected with an expected-duration timeout per edge and
+ * by checking whether the vehicle went past the end of the edge. Then, the
+ * vehicle is stopped, supervision NOPs are no longer sent, and status()
+ * reports PathTrackerStatus::LOST so a new path can be planned.
+ *
+ * A path that continues the one under execution (e.g. the next segment of a
+ * waypoint sequence, planned in advance from its end) is given with
+ * append_path(), so its commands replace the final stop and are triggered
+ * from the end of the former path, without stopping.
+ *
+ * The tracker works on its own copy of the PTGs, since their dynamic state is
+ * modified to build the commands.
+ */
+class PathTracker : public mrpt::system::COutputLogger
+{
+   public:
+    PathTracker() : mrpt::system::COutputLogger("PathTracker") {}
+
+    /** Stops the tracking thread, if running */
+    ~PathTracker();
+
+    PathTracker_Parameters params_;
+
+    /** Launches the tracking thread. Must be called before set_path(). */
+    void start(
+        const VehicleMotionInterface::Ptr& vehicle,
+        const TrajectoriesAndRobotShape&   ptgs);
+
+    /** Stops the tracking thread. The vehicle is not commanded to stop. */
+    void stop();
+
+    bool running() const { return thread_.joinable(); }
+
+    /** Replaces the path under execution, if any. The path is compiled into
+     * motion commands here, in the caller thread.
+     *
+     * \param edges The path edges, in order.
+     * \param odomPose The current vehicle odometry. The path is anchored
+     *  with its start (the first edge `stateFrom`) at this pose, since the
+     *  commands will be executed from wherever the vehicle is, not from the
+     *  plan root.
+     */
+    void set_path(
+        const std::vector<MoveEdgeSE2_TPS>& edges,
+        const mrpt::math::TPose2D&          odomPose);
+
+    /** Appends a path to the one under execution, replacing its final stop.
+     * The appended path starts where the former one ends (its first edge
+     * `stateFrom` must be the state of the former path at its end), so it is
+     * anchored at the odometry trigger pose of that final stop instead of at
+     * the current vehicle odometry, and executed seamlessly after it.
+     *
+     * 
+eturn false, with nothing done, if there is no path to append to:
+     *  the status is IDLE or LOST. If the former path has already FINISHED,
+     *  the appended one starts from its end.
+     */
+    bool append_path(const std::vector<MoveEdgeSE2_TPS>& edges);
+
+    /** Forgets about the path under execution, if any. The vehicle is not
+     * commanded to stop. */
+    void clear_path();
+
+    /** Whether there is a path whose execution has not ended yet */
+    bool is_tracking() const
+    {
+        return status() == PathTrackerStatus::TRACKING;
+    }
+
+    PathTrackerStatus status() const;
+
+    /** Index of the path edge under execution */
+    std::optional<size_t> current_edge() const;
+
+    /** Publicly available time profiling object. Default: disabled */
+    mrpt::system::CTimeLogger profiler_{false /*enabled*/, "PathTracker"};
+
+   private:
+    VehicleMotionInterface::Ptr         vehicle_;
+    std::vector<std::shared_ptr<ptg_t>> ptgs_;
+
+    std::thread        thread_;
+    std::atomic_bool   stopRequested_{false};
+    mutable std::mutex mtx_;
+
+    /** Protects ptgs_ while compiling paths */
+    std::mutex compileMtx_;
+
+    /** A command waiting in the vehicle "next" slot */
+    struct QueuedCmd
+    {
+        EnqueuedMotionCmd cmd;
+
+        /** Expected duration of the edge under execution until cmd is
+         * triggered [s] */
+        double edgeDuration = 0;
+    };
+
+    /** The motion commands of a path */
+    struct CompiledPath
+    {
+        CVehicleVelCmd::Ptr firstCmd;
+
+        /** The commands after firstCmd, with their triggers, ending with a
+         * stop command */
+        std::deque<QueuedCmd> queue;
+
+        size_t numEdges = 0;
+
+        /** Odometry pose at the end of the path (the trigger of its final
+         * stop) */
+        mrpt::math::TPose2D endPose;
+    };
+
+    /** The path to start at the next tick, if any */
+    std::optional<CompiledPath> newPath_;
+
+    /** The commands not sent to the vehicle yet. The front one is in the
+     * vehicle "next" slot. Empty if not tracking. */
+    std::deque<QueuedCmd> queue_;
+    size_t                numEdges_ = 0;
+    PathTrackerStatus     status_   = PathTrackerStatus::IDLE;
+
+    /** Odometry pose at the end of the latest path (set or appended) */
+    mrpt::math::TPose2D pathEndPose_;
+
+    /** Incremented every time the latest path is replaced or dropped, to
+     * detect that while compiling a path to append */
+    uint64_t pathGeneration_ = 0;
+
+    /** When the edge under execution started */
+    mrpt::Clock::time_point edgeStartTime_;
+
+    /** Closest distance of the vehicle to the front trigger so far [m] */
+    double minTriggerDistance_ = 0;
+
+    /** Odometry at the former tick, if tracking */
+    std::optional<mrpt::math::TPose2D> prevOdometry_;
+
+    void thread_loop();
+    void tick();
+
+    /** Stops the vehicle and drops the path. Must be called with mtx_
+     * locked. */
+    void lose_tracking(const std::string& reason);
+
+    /** Start tracking the edge ending at the front of queue_ */
+    void start_edge();
+
+    /** \param pathToOdom Transformation from path (planner) coordinates to
+     * odometry coordinates */
+    CompiledPath compile_path(
+        const std::vector<MoveEdgeSE2_TPS>& edges,
+        const mrpt::math::TPose2D&          pathToOdom);
+
+    bool condition_holds(
+        const EnqueuedCondition& c, const mrpt::math::TPose2D& odom) const;
+
+    /** Whether the vehicle went through the pose volume of `c` between two
+     * consecutive odometry samples, assuming it moved along the straight
+     * segment between them (with its heading linearly interpolated). At
+     * speed, the trigger volume may be crossed between two ticks. */
+    bool condition_swept(
+        const EnqueuedCondition& c, const mrpt::math::TPose2D& from,
+        const mrpt::math::TPose2D& to) const;
+};
+
+}  // namespace selfdriving
+
+MRPT_ENUM_TYPE_BEGIN(selfdriving::PathTrackerStatus)
+MRPT_FILL_ENUM_MEMBER(selfdriving, PathTrackerStatus::IDLE);
+MRPT_FILL_ENUM_MEMBER(selfdriving, PathTrackerStatus::TRACKING);
+MRPT_FILL_ENUM_MEMBER(selfdriving, PathTrackerStatus::FINISHED);
+MRPT_FILL_ENUM_MEMBER(selfdriving, PathTrackerStatus::LOST);
+MRPT_ENUM_TYPE_END()
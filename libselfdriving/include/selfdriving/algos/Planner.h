@@ -0,0 +1,149 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <mrpt/containers/yaml.h>
+#include <mrpt/maps/CPointsMap.h>
+#include <mrpt/rtti/CObject.h>
+#include <mrpt/system/COutputLogger.h>
+#include <mrpt/system/CTimeLogger.h>
+#include <selfdriving/algos/CostEvaluator.h>
+#include <selfdriving/data/CancellationToken.h>
+#include <selfdriving/data/CostToGoFieldCache.h>
+#include <selfdriving/data/PTGDynamicStateCache.h>
+#include <selfdriving/data/PlannerInput.h>
+#include <selfdriving/data/PlannerOutput.h>
+
+#include <map>
+#include <optional>
+
+namespace selfdriving
+{
+/** Virtual base for all path planning engines, all of them sharing the same
+ * PlannerInput / PlannerOutput interface.
+ *
+ * Planners can be instantiated by class name via the MRPT RTTI registry, e.g.
+ * `mrpt::rtti::classFactory("selfdriving::TPS_RRTstar")`.
+ */
+class Planner : public mrpt::system::COutputLogger, public mrpt::rtti::CObject
+{
+    DEFINE_VIRTUAL_MRPT_OBJECT(Planner)
+
+   public:
+    /** \param name Used for both the logger and the time profiler */
+    explicit Planner(const std::string& name);
+    virtual ~Planner();
+
+    virtual PlannerOutput plan(const PlannerInput& in) = 0;
+
+    /** Whether plan() also searches towards PlannerInput::extraGoals. Other
+     * planners only report those reached along the path to the main goal
+     * in PlannerOutput::extraGoals. */
+    virtual bool supports_extra_goals() const { return false; }
+
+    /** Loads/saves the planner-specific parameters */
+    virtual void params_from_yaml(const mrpt::containers::yaml& c) = 0;
+    virtual mrpt::containers::yaml params_as_yaml()                = 0;
+
+    std::vector<CostEvaluator::Ptr> costEvaluators_;
+
+    /** If cancelled from another thread, plan() stops as soon as possible
+     * and returns the best path found so far. */
+    CancellationToken cancellationToken_;
+
+    /** Time profiler (Default: enabled)*/
+    mrpt::system::CTimeLogger profiler_;
+
+    /** If set, cost-to-go fields are reused across plan() calls (and
+     * planners) with the same goal and static obstacles. */
+    CostToGoFieldCache::Ptr costToGoCache_;
+
+    /** Checks the edges of the path from the root of `tree` to `goalNodeId`
+     * against `obstacles`, whatever planner built the tree. The dynamic
+     * state of the PTGs in `ptgs` is modified.
+     * \return false if any edge is blocked or unreachable */
+    static bool path_is_collision_free(
+        const MotionPrimitivesTreeSE2& tree, const TNodeID goalNodeId,
+        const TrajectoriesAndRobotShape& ptgs,
+        const mrpt::maps::CPointsMap&    obstacles);
+
+   protected:
+    /** Returns local obstacles as seen from a given pose, clipped to a maximum
+     * distance. */
+    static void transform_pc_square_clipping(
+        const mrpt::maps::CPointsMap& inMap,
+        const mrpt::poses::CPose2D& asSeenFrom, const double MAX_DIST_XY,
+        mrpt::maps::CPointsMap& outMap, bool appendToOutMap = true);
+
+    /** Returns TPS-distance to obstacles.
+     * ptg dynamic state must be updated by the caller.
+     */
+    static distance_t tp_obstacles_single_path(
+        const trajectory_index_t      tp_space_k_direction,
+        const mrpt::maps::CPointsMap& localObstacles, const ptg_t& ptg);
+
+    mrpt::maps::CPointsMap::Ptr cached_local_obstacles(
+        const MotionPrimitivesTreeSE2& tree, const TNodeID nodeID,
+        const std::vector<mrpt::maps::CPointsMap::Ptr>& globalObstacles,
+        double                                          MAX_XY_DIST);
+
+    /** for use in cached_local_obstacles(), local_obstacles_cache_ */
+    struct LocalObstaclesInfo
+    {
+        mrpt::maps::CPointsMap::Ptr obs;
+        mrpt::math::TPose2D         globalNodePose;
+    };
+
+    std::map<TNodeID, LocalObstaclesInfo> local_obstacles_cache_;
+
+    /** Returns the cost-to-go field towards the goal in `in`, built from its
+     * static obstacle sources, taken from costToGoCache_ if set. Obstacles
+     * are inflated by the robot radius, for circular robots, if
+     * `inflateObstacles` is true. Inflation may close passages the robot
+     * fits through, due to the grid discretization, so non-inflated fields
+     * must be used where a lower bound of the cost-to-go is required. */
+    std::shared_ptr<const CostToGoField> cost_to_go_field(
+        const PlannerInput& in, const double resolution,
+        const bool inflateObstacles = true);
+
+    /** Edge cost: its PTG distance plus all costEvaluators_ */
+    cost_t cost_path_segment(const MoveEdgeSE2_TPS& edge) const;
+
+    /** Memoized PTG dynamic states. Derived classes must reset it at the
+     * beginning of each plan() */
+    PTGDynamicStateCache ptgDynStateCache_;
+
+    /** Fills in `edge.interpolatedPath` with `nSeg` intermediary poses of
+     * its PTG path, up to step `ptgStep`. Nothing is done if nSeg=0. */
+    static void interpolate_edge(
+        MoveEdgeSE2_TPS& edge, const ptg_t& ptg, const uint32_t ptgStep,
+        const size_t nSeg);
+
+    /** Returns the cheapest collision-free edge, among all PTGs in `trs`,
+     * going from `from` to `target` (up to the PTG discretization) not
+     * longer than `maxDistance`, or an empty optional if there is none.
+     * `localObstacles` must be given in the frame of `from`. The edge
+     * parentId is left for the caller to set. */
+    std::optional<MoveEdgeSE2_TPS> best_edge_towards(
+        const SE2_KinState& from, const mrpt::math::TPose2D& target,
+        const bool ignoreTargetHeading, const double headingTolerance,
+        const distance_t maxDistance, const TrajectoriesAndRobotShape& trs,
+        const mrpt::maps::CPointsMap& localObstacles, const size_t nSeg);
+};
+
+/** Planner parameters `randomSeed`, for the planner own pseudorandom
+ * generator: a fixed seed, or none to draw one from std::random_device. In
+ * YAML, a negative value (or a missing entry) means none. */
+void random_seed_to_yaml(
+    mrpt::containers::yaml& c, const std::optional<uint32_t>& randomSeed);
+void random_seed_from_yaml(
+    const mrpt::containers::yaml& c, std::optional<uint32_t>& randomSeed);
+
+/** The given seed, or one from std::random_device if there is none */
+uint32_t actual_random_seed(const std::optional<uint32_t>& randomSeed);
+
+}  // namespace selfdriving
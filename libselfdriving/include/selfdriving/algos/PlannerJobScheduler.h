@@ -0,0 +1,140 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <mrpt/core/Clock.h>
+#include <mrpt/typemeta/TEnumType.h>
+#include <selfdriving/data/CancellationToken.h>
+
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace selfdriving
+{
+/** Priority classes of PlannerJobScheduler jobs, from highest to lowest. */
+enum class PlannerJobClass : uint8_t
+{
+    /** The vehicle is waiting for it, e.g. a replan after a path blockage */
+    URGENT = 0,
+    /** Planning ahead of time, e.g. the next waypoint segment */
+    LOOKAHEAD,
+    /** Speculative work, e.g. refining the path under execution */
+    BACKGROUND
+};
+
+/** A pool of planner threads running jobs by priority class (see
+ * PlannerJobClass), then in FIFO order.
+ *
+ * Each job comes with a CancellationToken, meant to be checked by the job
+ * itself (e.g. by passing it to Planner::cancellationToken_). When a job is
+ * enqueued and there is no idle worker for it, the token of the running job
+ * with the lowest priority below it is cancelled, so higher priority jobs
+ * never wait behind lower priority ones.
+ *
+ * Note that, with idle workers, jobs of any class run concurrently, so jobs
+ * must not share mutable state, e.g. PTG objects (see
+ * WaypointSequencer::path_planner_function()).
+ */
+class PlannerJobScheduler
+{
+   public:
+    using Ptr = std::shared_ptr<PlannerJobScheduler>;
+
+    explicit PlannerJobScheduler(
+        size_t numWorkers = 1, const std::string& threadsName = "planner");
+
+    /** Cancels all jobs, then waits for the running ones to end. */
+    ~PlannerJobScheduler();
+
+    /** Enqueues a job. \return The future result of `f()` */
+    template <class F>
+    auto enqueue(
+        const PlannerJobClass jobClass, const CancellationToken& token, F&& f)
+        -> std::future<decltype(f())>
+    {
+        using return_t = decltype(f());
+
+        auto task = std::make_shared<std::packaged_task<return_t()>>(
+            std::forward<F>(f));
+        auto fut = task->get_future();
+
+        push_job(jobClass, token, [task]() { (*task)(); });
+        return fut;
+    }
+
+    size_t num_workers() const { return workers_.size(); }
+
+    /** Statistics for each job class */
+    struct ClassStats
+    {
+        size_t started   = 0;  //!< Started jobs
+        size_t jobs      = 0;  //!< Finished jobs
+        size_t preempted = 0;  //!< Cancelled in favor of higher priority jobs
+
+        /** Time from enqueue to start, and running time [s] */
+        double meanQueueTime = 0, maxQueueTime = 0;
+        double meanRunTime   = 0;
+    };
+
+    ClassStats stats(const PlannerJobClass jobClass) const;
+
+   private:
+    static constexpr size_t NUM_CLASSES = 3;
+
+    struct Job
+    {
+        PlannerJobClass         jobClass = PlannerJobClass::URGENT;
+        CancellationToken       token;
+        std::function<void()>   run;
+        mrpt::Clock::time_point enqueued;
+    };
+
+    struct WorkerState
+    {
+        /** Empty if idle */
+        std::optional<PlannerJobClass> jobClass;
+        CancellationToken              token;
+    };
+
+    struct StatsAccum
+    {
+        size_t started = 0, jobs = 0, preempted = 0;
+        double sumQueueTime = 0, maxQueueTime = 0, sumRunTime = 0;
+    };
+
+    void push_job(
+        const PlannerJobClass jobClass, const CancellationToken& token,
+        std::function<void()>&& run);
+
+    void worker_loop(size_t workerIdx);
+
+    mutable std::mutex      mtx_;
+    std::condition_variable cv_;
+    bool                    shutdown_ = false;
+
+    std::array<std::deque<Job>, NUM_CLASSES> queues_;
+    std::array<StatsAccum, NUM_CLASSES>      stats_;
+    std::vector<WorkerState>                 workersState_;
+    std::vector<std::thread>                 workers_;
+};
+
+}  // namespace selfdriving
+
+MRPT_ENUM_TYPE_BEGIN_NAMESPACE(selfdriving, selfdriving::PlannerJobClass)
+MRPT_FILL_ENUM_MEMBER(selfdriving::PlannerJobClass, URGENT);
+MRPT_FILL_ENUM_MEMBER(selfdriving::PlannerJobClass, LOOKAHEAD);
+MRPT_FILL_ENUM_MEMBER(selfdriving::PlannerJobClass, BACKGROUND);
+MRPT_ENUM_TYPE_END()
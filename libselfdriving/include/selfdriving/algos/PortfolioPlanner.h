@@ -0,0 +1,90 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <mrpt/core/WorkerThreadsPool.h>
+#include <selfdriving/algos/TPS_RRTstar.h>
+
+#include <memory>
+
+namespace selfdriving
+{
+struct PortfolioPlanner_Parameters
+{
+    PortfolioPlanner_Parameters() = default;
+    static PortfolioPlanner_Parameters FromYAML(
+        const mrpt::containers::yaml& c);
+
+    /** Number of planner instances to run in parallel.
+     * 0: one per hardware thread. */
+    size_t numInstances = 4;
+
+    /** Deadline for the whole portfolio [s]. 0: no limit other than the
+     * instances own stop conditions. */
+    double maxPlanningTime = 1.0;
+
+    /** If true, return the first successful plan and cancel all other
+     * instances, which also stop at their first solution
+     * (TPS_RRTstar_Parameters::stopAtFirstSolution). Otherwise, wait for all
+     * instances and return the one with the lowest path cost. */
+    bool returnFirstSolution = true;
+
+    mrpt::containers::yaml as_yaml();
+    void                   load_from_yaml(const mrpt::containers::yaml& c);
+};
+
+/** Runs several TPS_RRTstar instances in parallel over the same problem, each
+ * with a different random seed and, optionally, different parameters, and
+ * returns the first or the best solution.
+ *
+ * Since randomized planners have a heavy-tailed time-to-first-solution
+ * distribution, running a diverse portfolio of them reduces the latency of
+ * the worst cases.
+ *
+ * Each instance works on its own copy of the PTGs, since their dynamic state
+ * is modified while planning. Copies are made once and reused in subsequent
+ * plan() calls, as long as the input PTG objects are the same.
+ */
+class PortfolioPlanner : public mrpt::system::COutputLogger
+{
+   public:
+    PortfolioPlanner();
+    ~PortfolioPlanner() = default;
+
+    PlannerOutput plan(const PlannerInput& in);
+
+    PortfolioPlanner_Parameters params_;
+
+    /** Parameters for each instance. If there are less entries than
+     * instances, the missing ones are generated from the first entry (or
+     * default parameters, if empty) by alternating TPS and Euclidean sampling
+     * and increasing the goal bias. Random seeds of generated entries are
+     * consecutive, starting at the seed of the first entry (if not -1). */
+    std::vector<TPS_RRTstar_Parameters> instancesParams_;
+
+    std::vector<CostEvaluator::Ptr> costEvaluators_;
+
+    /** If cancelled from another thread, all instances are stopped and the
+     * best path found so far is returned. */
+    CancellationToken cancellationToken_;
+
+    /** Time profiler (Default: enabled)*/
+    mrpt::system::CTimeLogger profiler_{true, "PortfolioPlanner"};
+
+   private:
+    std::unique_ptr<mrpt::WorkerThreadsPool> pool_;
+    size_t                                   poolSize_ = 0;
+
+    /** Per-instance copies of the PTGs in ptgsCopiesSource_ */
+    std::vector<std::vector<ptg_t::Ptr>> ptgsCopies_;
+    std::vector<ptg_t::Ptr>              ptgsCopiesSource_;
+
+    std::vector<TPS_RRTstar_Parameters> build_instances_params(
+        const size_t numInstances) const;
+};
+
+}  // namespace selfdriving
@@ -0,0 +1,99 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <selfdriving/algos/Planner.h>
+#include <selfdriving/data/CostToGoField.h>
+
+namespace selfdriving
+{
+struct TPS_Astar_Parameters
+{
+    TPS_Astar_Parameters() = default;
+    static TPS_Astar_Parameters FromYAML(const mrpt::containers::yaml& c);
+
+    /** Lattice resolution: two states falling in the same cell are
+     * considered the same search node. */
+    double gridResolutionXY         = 0.20;                //!< [m]
+    double gridResolutionYaw        = mrpt::DEG2RAD(5.0);  //!< [rad]
+    double gridResolutionLinearVel  = 0.25;                //!< [m/s]
+    double gridResolutionAngularVel = mrpt::DEG2RAD(10.0);  //!< [rad/s]
+
+    /** Number of trajectories (evenly spaced "k" indices) used from each
+     * PTG to expand successors. */
+    size_t trajectoriesPerPTG = 11;
+
+    /** Successor motions are generated for `numStepLengths` PTG distances,
+     * evenly spaced in [minStepLength, maxStepLength]. */
+    double minStepLength  = 0.50;  //!< [m]
+    double maxStepLength  = 1.50;  //!< [m]
+    size_t numStepLengths = 2;
+
+    /** Search is aborted after expanding this many nodes, bounding the
+     * worst-case latency. */
+    size_t maxExpandedNodes = 20000;
+
+    /** Cell size of the CostToGoField used as heuristic [m] */
+    double heuristicGridResolution = 0.25;
+
+    /** >1 for weighted A* (faster, but not optimal up to the lattice) */
+    double heuristicWeight = 1.0;
+
+    /** See TPS_RRTstar_Parameters */
+    double ptgDynStateLinearVelQuantization  = 0.01;  //!< [m/s]
+    double ptgDynStateAngularVelQuantization = mrpt::DEG2RAD(1.0);  //!< [rad/s]
+
+    /** Required to smooth interpolation of rendered paths, evaluation of
+     * path cost, etc. */
+    size_t pathInterpolatedSegments = 5;
+
+    mrpt::containers::yaml as_yaml();
+    void                   load_from_yaml(const mrpt::containers::yaml& c);
+};
+
+/** Deterministic lattice (Hybrid A*-like) planner on TP-Space motion
+ * primitives.
+ *
+ * States are discretized in (x, y, heading, linear and angular velocity)
+ * cells, stored in a hashed closed set. Successors are generated with a fixed
+ * subset of trajectories and distances of each PTG, and ordered by an
+ * admissible heuristic obtained from a CostToGoField over the obstacles (not
+ * inflated by the robot shape, so it never overestimates the cost-to-go,
+ * up to the heuristic grid resolution).
+ * Each expanded node also tries a direct PTG motion to the goal (ignoring its
+ * heading, as TPS_RRTstar does), so the goal is reached exactly.
+ *
+ * For the same input, the output (and the number of expansions) is always
+ * the same. The output tree holds all expanded nodes, with the same
+ * structure than the one of TPS_RRTstar.
+ */
+class TPS_Astar : public Planner
+{
+    DEFINE_MRPT_OBJECT(TPS_Astar, selfdriving)
+
+   public:
+    TPS_Astar();
+    ~TPS_Astar() = default;
+
+    PlannerOutput plan(const PlannerInput& in) override;
+
+    void params_from_yaml(const mrpt::containers::yaml& c) override
+    {
+        params_.load_from_yaml(c);
+    }
+    mrpt::containers::yaml params_as_yaml() override
+    {
+        return params_.as_yaml();
+    }
+
+    TPS_Astar_Parameters params_;
+
+   private:
+    void set_ptg_dynamic_state(ptg_t& ptg, const SE2_KinState& s);
+};
+
+}  // namespace selfdriving
@@ -0,0 +1,105 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <mrpt/random/RandomGenerators.h>
+#include <selfdriving/algos/Planner.h>
+
+namespace selfdriving
+{
+struct TPS_BITstar_Parameters
+{
+    TPS_BITstar_Parameters() = default;
+    static TPS_BITstar_Parameters FromYAML(const mrpt::containers::yaml& c);
+
+    size_t samplesPerBatch = 100;
+    size_t maxBatches      = 50;
+
+    /** Time limit for plan() [s]. 0: no limit other than maxBatches. */
+    double maxPlanningTime = 0;
+
+    /** Only edges between states closer than this (Euclidean distance) are
+     * considered [m] */
+    double connectionRadius = 3.0;
+
+    /** Heading tolerance when connecting to a new sample (its pose becomes
+     * the one actually reached by the PTG), and when rewiring existing
+     * nodes, respectively. */
+    double headingToleranceGenerate = mrpt::DEG2RAD(90.0);
+    double headingToleranceMetric   = mrpt::DEG2RAD(2.0);
+    double metricDistanceEpsilon    = 0.01;
+
+    /** See TPS_RRTstar_Parameters */
+    double ptgDynStateLinearVelQuantization  = 0.01;  //!< [m/s]
+    double ptgDynStateAngularVelQuantization = mrpt::DEG2RAD(1.0);  //!< [rad/s]
+
+    /** Required to smooth interpolation of rendered paths, evaluation of
+     * path cost, etc. */
+    size_t pathInterpolatedSegments = 5;
+
+    /** Empty: seed from std::random_device. See PlannerOutput::randomSeed */
+    std::optional<uint32_t> randomSeed;
+
+    mrpt::containers::yaml as_yaml();
+    void                   load_from_yaml(const mrpt::containers::yaml& c);
+};
+
+/** Batch Informed Trees (BIT*)-like planner on TP-Space motion primitives.
+ *
+ * Instead of one random sample per iteration, samples are drawn in batches,
+ * restricted to the informed set (states that could improve the current
+ * solution). Candidate edges are kept in a priority queue ordered by their
+ * heuristic total cost (cost-to-come + Euclidean edge length + Euclidean
+ * distance to goal, all of them lower bounds), so the expensive exact PTG
+ * inverse map and collision check (tp_obstacles_single_path()) is only
+ * evaluated for edges that could improve the current solution.
+ *
+ * The output tree has the same structure than the one of TPS_RRTstar.
+ */
+class TPS_BITstar : public Planner
+{
+    DEFINE_MRPT_OBJECT(TPS_BITstar, selfdriving)
+
+   public:
+    TPS_BITstar();
+    ~TPS_BITstar() = default;
+
+    PlannerOutput plan(const PlannerInput& in) override;
+
+    void params_from_yaml(const mrpt::containers::yaml& c) override
+    {
+        params_.load_from_yaml(c);
+    }
+    mrpt::containers::yaml params_as_yaml() override
+    {
+        return params_.as_yaml();
+    }
+
+    TPS_BITstar_Parameters params_;
+
+   private:
+    /** Pseudorandom generator, seeded at the beginning of each plan() */
+    mrpt::random::CRandomGenerator rng_;
+
+    /** Draws a batch of collision-free samples within the informed set for
+     * the given solution cost, appending them to `samples`. */
+    void draw_samples_batch(
+        const PlannerInput& pi, const cost_t bestCost,
+        std::vector<mrpt::math::TPose2D>& samples);
+
+    /** Returns the cheapest collision-free edge, among all PTGs, from `tree`
+     * node `srcNodeId` to `target` (up to the PTG discretization), or an
+     * empty optional if there is none. */
+    std::optional<MoveEdgeSE2_TPS> evaluate_edge(
+        const MotionPrimitivesTreeSE2& tree, const TNodeID srcNodeId,
+        const mrpt::math::TPose2D& target, const double headingTolerance,
+        const bool ignoreTargetHeading, const TrajectoriesAndRobotShape& trs,
+        const std::vector<mrpt::maps::CPointsMap::Ptr>& globalObstacles,
+        const double                                    MAX_XY_DIST);
+};
+
+}  // namespace selfdriving
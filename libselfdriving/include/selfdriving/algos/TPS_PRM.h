@@ -0,0 +1,139 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <mrpt/random/RandomGenerators.h>
+#include <selfdriving/algos/Planner.h>
+#include <selfdriving/data/PTGRoadmap.h>
+
+#include <memory>
+#include <set>
+
+namespace selfdriving
+{
+struct TPS_PRM_Parameters
+{
+    TPS_PRM_Parameters() = default;
+    static TPS_PRM_Parameters FromYAML(const mrpt::containers::yaml& c);
+
+    /** Number of roadmap nodes to generate in build_roadmap() */
+    size_t numNodes = 2000;
+
+    /** Probability of drawing a new node uniformly over the map, instead of
+     * extending an existing node with a random PTG motion. */
+    double uniformSamplingProbability = 0.2;
+
+    double minStepLength = 0.50;  //!< For PTG extensions [m]
+    double maxStepLength = 2.00;  //!< For PTG extensions [m]
+
+    /** Roadmap connections and query start/goal connections are only
+     * attempted between poses closer than this [m] */
+    double connectionRadius = 3.0;
+
+    /** Max number of nearest neighbors to connect each node with */
+    size_t maxNeighbors = 15;
+
+    double headingToleranceMetric = mrpt::DEG2RAD(5.0);
+
+    /** Max number of graph searches per query, each one discarding roadmap
+     * edges found to be blocked by live (sensed) obstacles. */
+    size_t maxLazyValidationRounds = 20;
+
+    size_t pathInterpolatedSegments = 5;
+
+    /** Empty: seed from std::random_device */
+    std::optional<uint32_t> randomSeed;
+
+    mrpt::containers::yaml as_yaml();
+    void                   load_from_yaml(const mrpt::containers::yaml& c);
+};
+
+/** Probabilistic roadmap (PRM) planner on TP-Space motion primitives.
+ *
+ * The roadmap is built once over a static map with build_roadmap(), and can
+ * be saved to and loaded from disk (see PTGRoadmap). Then, each plan() query
+ * only connects start and goal to the roadmap, runs an A* graph search, and
+ * lazily validates the found path against all PlannerInput::obstacles (e.g.
+ * including live sensed obstacles), searching again without the blocked
+ * edges if needed.
+ *
+ * The output tree contains a single path from start to goal.
+ */
+class TPS_PRM : public Planner
+{
+    DEFINE_MRPT_OBJECT(TPS_PRM, selfdriving)
+
+   public:
+    TPS_PRM();
+    ~TPS_PRM() = default;
+
+    /** Builds the roadmap over the world bounding box and obstacles in `in`
+     * (start and goal states are ignored). */
+    void build_roadmap(const PlannerInput& in);
+
+    PlannerOutput plan(const PlannerInput& in) override;
+
+    void params_from_yaml(const mrpt::containers::yaml& c) override
+    {
+        params_.load_from_yaml(c);
+    }
+    mrpt::containers::yaml params_as_yaml() override
+    {
+        return params_.as_yaml();
+    }
+
+    TPS_PRM_Parameters params_;
+
+    /** Only modified by build_roadmap(), so it can be shared among several
+     * TPS_PRM instances running plan() in parallel, each with its own PTGs
+     * (see PlannerInput::ptgs). */
+    std::shared_ptr<PTGRoadmap> roadmap_ = std::make_shared<PTGRoadmap>();
+
+   private:
+    mrpt::random::CRandomGenerator rng_;
+
+    /** Returns the cheapest collision-free motion, among all PTGs, from
+     * `from` towards `to`, with the PTG dynamic state for the velocity in
+     * `from`. `localObstacles` must be given in the frame of `from`.
+     * `fromNodeIdx` and `toNodeIdx` are just copied into the edge.
+     */
+    std::optional<PTGRoadmap::edge_t> connect(
+        const SE2_KinState& from, const mrpt::math::TPose2D& to,
+        const bool ignoreTargetHeading, const TrajectoriesAndRobotShape& trs,
+        const mrpt::maps::CPointsMap&  localObstacles,
+        const PTGRoadmap::node_index_t fromNodeIdx,
+        const PTGRoadmap::node_index_t toNodeIdx);
+
+    /** Re-evaluates the motion `e` towards pose `to` for the actual state
+     * `from` (roadmap motions assume zero initial velocity) and checks it
+     * against the given obstacles. If the PTG path of `e` no longer ends at
+     * `to` from that state, the cheapest direct motion to `to` is used
+     * instead. The returned `stateTo` is the real end of the motion, within
+     * tolerance of `to`, so the next edge must start there.
+     * \return The motion, or an empty optional if blocked or unreachable.
+     */
+    std::optional<MoveEdgeSE2_TPS> resolve_edge(
+        const PTGRoadmap::edge_t& e, const SE2_KinState& from,
+        const mrpt::math::TPose2D& to, const bool ignoreTargetHeading,
+        const TrajectoriesAndRobotShape&                trs,
+        const std::vector<mrpt::maps::CPointsMap::Ptr>& globalObstacles);
+
+    /** Obstacles as seen from `p`, clipped to the max PTG range */
+    static void local_obstacles(
+        const mrpt::math::TPose2D&                      p,
+        const std::vector<mrpt::maps::CPointsMap::Ptr>& globalObstacles,
+        const TrajectoriesAndRobotShape& trs, mrpt::maps::CPointsMap& out);
+
+    /** Indices of roadmap nodes closer than connectionRadius to `p`, sorted by
+     * increasing distance, up to maxNeighbors */
+    std::vector<PTGRoadmap::node_index_t> nearby_roadmap_nodes(
+        const mrpt::math::TPose2D& p) const;
+
+    void set_ptg_dynamic_state(ptg_t& ptg, const mrpt::math::TTwist2D& vel);
+};
+
+}  // namespace selfdriving
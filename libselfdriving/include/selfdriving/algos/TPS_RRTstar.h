@@ -6,11 +6,16 @@
 
 #pragma once
 
-#include <mrpt/system/COutputLogger.h>
-#include <mrpt/system/CTimeLogger.h>
-#include <selfdriving/algos/CostEvaluator.h>
-#include <selfdriving/data/PlannerInput.h>
-#include <selfdriving/data/PlannerOutput.h>
+#include <mrpt/random/RandomGenerators.h>
+#include <selfdriving/algos/Planner.h>
+#include <selfdriving/data/CostToGoField.h>
+#include <selfdriving/data/LowDiscrepancySequence.h>
+#include <selfdriving/data/PlanningCorridor.h>
+
+#include <array>
+#include <map>
+#include <unordered_map>
+#include <vector>
 
 namespace selfdriving
 {
@@ -24,49 +29,170 @@ struct TPS_RRTstar_Parameters
     double maxStepLength       = 1.00;  //!< Between waypoints [m]
     size_t maxIterations       = 10000;
 
+    /** Shrinking search radius, as in RRT*: at each iteration, the radius
+     * is `min(initialSearchRadius, searchRadiusGamma*(log(n)/n)^(1/3))`, for
+     * a tree with `n` nodes in the 3D SE(2) space, but never below
+     * minSearchRadius. Set searchRadiusGamma to 0 for a fixed radius. */
+    double searchRadiusGamma = 12.0;
+    double minSearchRadius   = 1.0;  //!< [m]
+
+    /** If >0, only the `maxNeighbors` nodes nearest to each new sample
+     * are considered for EXTEND and REWIRE (k-nearest RRT*). */
+    size_t maxNeighbors = 0;
+
     bool   drawInTPS           = true;  //!< Draw samples in TPS vs Euclidean
     double drawBiasTowardsGoal = 0.1;
 
+    /** Sequence of the samples: (x,y,phi) for Euclidean sampling, (node,
+     * PTG, trajectory, distance) for TPS sampling. ScrambledHalton uses
+     * randomSeed, so parallel planners with different seeds do not draw the
+     * same samples. Goal bias and corridor decisions are always random. */
+    SamplingSequence samplingSequence = SamplingSequence::Random;
+
+    /** Maximum number of tentative samples per iteration. If no valid sample
+     * is found within this budget, or before the maxPlanningTime deadline,
+     * the iteration is skipped. */
+    size_t maxDrawAttempts = 10000;
+
+    /** Adaptive proposal for TPS sampling: the trajectories of each PTG are
+     * grouped into this many bins, each one drawn with a probability
+     * proportional to its rate of valid samples so far (those out of the
+     * world bbox or colliding are failures), but never below
+     * minProposalWeight. 0: disabled, uniform drawing of trajectories. */
+    size_t proposalBinsPerPTG = 16;
+    double minProposalWeight  = 0.05;
+
     double headingToleranceGenerate = mrpt::DEG2RAD(90.0);
     double headingToleranceMetric   = mrpt::DEG2RAD(2.0);
     double metricDistanceEpsilon    = 0.01;
 
     double SE2_metricAngleWeight = 1.0;
 
+    /** Quantization steps for the vehicle velocity when seeding PTGs with a
+     * new dynamic state. Nodes with velocities within the same quantization
+     * cell reuse the PTG state, see PTGDynamicStateCache. 0: exact match. */
+    double ptgDynStateLinearVelQuantization  = 0.01;  //!< [m/s]
+    double ptgDynStateAngularVelQuantization = mrpt::DEG2RAD(1.0);  //!< [rad/s]
+
     /** Required to smooth interpolation of rendered paths, evaluation of
      * path cost, etc. */
     size_t pathInterpolatedSegments = 5;
 
     size_t saveDebugVisualizationDecimation = 0;
 
+    /** Seed for the planner own pseudorandom generator. Use a fixed value
+     * to obtain reproducible plans. Empty: seed from std::random_device.
+     * The actual seed is returned in PlannerOutput::randomSeed. */
+    std::optional<uint32_t> randomSeed;
+
+    /** Time limit for plan() [s]. The best path found so far is returned when
+     * it expires. 0: no limit other than maxIterations. */
+    double maxPlanningTime = 0;
+
+    /** If true, plan() returns as soon as the goal is reached for the first
+     * time, without further optimizing the path. */
+    bool stopAtFirstSolution = false;
+
+    /** Bidirectional search: besides the main tree, grow a second tree
+     * backwards from the goal using reversed PTG motions, and try to connect
+     * both of them at each iteration. */
+    bool bidirectional = false;
+
+    /** Number of nearest nodes of the other tree for which a connection is
+     * attempted, in each iteration of the bidirectional search. */
+    size_t bidirectionalConnectCandidates = 3;
+
+    /** Hierarchical planning: a coarse grid search (see CostToGoField) from
+     * the goal is run first. Then, Euclidean samples are drawn within a
+     * corridor around the coarse path with probability
+     * `corridorSamplingProbability` (over the whole world bbox otherwise, to
+     * keep probabilistic completeness), TPS samples outside of it are
+     * rejected with that same probability, and samples that cannot improve
+     * the current solution according to the cost-to-go are discarded (only
+     * if PlannerInput::extraGoals is empty, since the cost-to-go only
+     * refers to the main goal). The corridor uses obstacles inflated by the
+     * robot radius, while pruning uses a second, non-inflated field, so it
+     * never discards samples on paths the inflated grid wrongly blocks.
+     * The cost-to-go field is also used to bias samples towards the goal
+     * (see drawBiasTowardsGoal) along the coarse path, and it is reused
+     * across calls if Planner::costToGoCache_ is set. */
+    bool   coarseGridGuidance          = false;
+    double coarseGridResolution        = 0.50;  //!< [m]
+    double corridorWidth               = 3.0;  //!< Half-width [m]
+    double corridorSamplingProbability = 0.9;
+
     mrpt::containers::yaml as_yaml();
     void                   load_from_yaml(const mrpt::containers::yaml& c);
 };
 
-class TPS_RRTstar : public mrpt::system::COutputLogger
+class TPS_RRTstar : public Planner
 {
+    DEFINE_MRPT_OBJECT(TPS_RRTstar, selfdriving)
+
    public:
     TPS_RRTstar();
     ~TPS_RRTstar() = default;
 
-    PlannerOutput plan(const PlannerInput& in);
+    /** Runs the planner.
+     *
+     * Different TPS_RRTstar objects can run plan() concurrently, since each
+     * one owns its random generator and caches, as long as they do not share
+     * PTG objects (PlannerInput::ptgs), whose dynamic state is modified.
+     *
+     * If PlannerInput::extraGoals is not empty, samples are also biased
+     * towards them, and the best path to each one is reported in
+     * PlannerOutput::extraGoals.
+     */
+    PlannerOutput plan(const PlannerInput& in) override;
+
+    bool supports_extra_goals() const override { return true; }
+
+    /** Incremental (RRTX-like) repair of a previous plan() output, after new
+     * obstacles have appeared, instead of planning again from scratch.
+     *
+     * Only edges whose swept PTG path is blocked by `newObstacles` (given in
+     * global coordinates, only those not present when planning) are
+     * invalidated, looking up the obstacles around each edge in a coarse
+     * grid. Their subtrees become unreachable
+     * and are then reattached, in a cascade, to the cheapest collision-free
+     * nearby parent. The cost of that is proportional to the size of the
+     * change, not to the size of the tree.
+     *
+     * \return The repaired tree, with `success` telling whether the goal is
+     * still reachable. Obstacles in `previous.originalInput` are assumed to
+     * be unchanged otherwise.
+     */
+    PlannerOutput repair(
+        const PlannerOutput&          previous,
+        const mrpt::maps::CPointsMap& newObstacles);
 
-    TPS_RRTstar_Parameters          params_;
-    std::vector<CostEvaluator::Ptr> costEvaluators_;
+    void params_from_yaml(const mrpt::containers::yaml& c) override
+    {
+        params_.load_from_yaml(c);
+    }
+    mrpt::containers::yaml params_as_yaml() override
+    {
+        return params_.as_yaml();
+    }
 
-    /** Time profiler (Default: enabled)*/
-    mrpt::system::CTimeLogger profiler_{true, "TPS_RRTstar"};
+    TPS_RRTstar_Parameters params_;
 
    private:
     struct DrawFreePoseParams
     {
         DrawFreePoseParams(
             const PlannerInput& pi, const MotionPrimitivesTreeSE2& tree,
-            const distance_t& searchRadius, const TNodeID goalNodeId)
+            const distance_t& searchRadius, const TNodeID goalNodeId,
+            const CostToGoField*    costToGo      = nullptr,
+            const CostToGoField*    costToGoBound = nullptr,
+            const PlanningCorridor* corridor      = nullptr)
             : pi_(pi),
               tree_(tree),
               searchRadius_(searchRadius),
-              goalNodeId_(goalNodeId)
+              goalNodeId_(goalNodeId),
+              costToGo_(costToGo),
+              costToGoBound_(costToGoBound),
+              corridor_(corridor)
         {
         }
 
@@ -74,20 +200,87 @@ class TPS_RRTstar : public mrpt::system::COutputLogger
         const MotionPrimitivesTreeSE2& tree_;
         const distance_t&              searchRadius_;
         const TNodeID                  goalNodeId_;
+
+        /** Only if coarseGridGuidance is enabled. costToGo_ has obstacles
+         * inflated by the robot radius (for the corridor and goal bias),
+         * costToGoBound_ does not (an admissible bound, for pruning). */
+        const CostToGoField*    costToGo_      = nullptr;
+        const CostToGoField*    costToGoBound_ = nullptr;
+        const PlanningCorridor* corridor_      = nullptr;
     };
 
-    using closest_lie_nodes_list_t = std::map<
-        distance_t,
-        std::reference_wrapper<const MotionPrimitivesTreeSE2::node_t>>;
+    /** True if a sample at `q`, reachable with a cost of at least
+     * `costToCome`, cannot improve the current solution according to the
+     * non-inflated cost-to-go field. */
+    bool cannot_improve_solution(
+        const DrawFreePoseParams& p, const mrpt::math::TPose2D& q,
+        const cost_t costToCome) const;
+
+    /** An entry of find_nearby_nodes() results */
+    struct NearbyNode
+    {
+        NearbyNode(
+            const MotionPrimitivesTreeSE2::node_t& n,
+            const mrpt::math::TPose2D&             queryRelPose)
+            : node(n), relPose(queryRelPose)
+        {
+        }
+
+        std::reference_wrapper<const MotionPrimitivesTreeSE2::node_t> node;
+
+        /** The query pose, relative to the node: `query - node.pose` */
+        mrpt::math::TPose2D relPose;
+
+        const MotionPrimitivesTreeSE2::node_t& get() const
+        {
+            return node.get();
+        }
+    };
+
+    using closest_lie_nodes_list_t = std::map<distance_t, NearbyNode>;
 
     using already_existing_node_t = std::optional<TNodeID>;
 
     using draw_pose_return_t = std::tuple<
         mrpt::math::TPose2D, already_existing_node_t, closest_lie_nodes_list_t>;
 
-    draw_pose_return_t draw_random_free_pose(const DrawFreePoseParams& p);
-    draw_pose_return_t draw_random_tps(const DrawFreePoseParams& p);
-    draw_pose_return_t draw_random_euclidean(const DrawFreePoseParams& p);
+    /** Draws a sample, or returns an empty optional if none was found within
+     * the attempt budget (see maxDrawAttempts) */
+    std::optional<draw_pose_return_t> draw_random_free_pose(
+        const DrawFreePoseParams& p);
+    std::optional<draw_pose_return_t> draw_random_tps(
+        const DrawFreePoseParams& p);
+    std::optional<draw_pose_return_t> draw_random_euclidean(
+        const DrawFreePoseParams& p);
+
+    /** Tentative samples in the last draw_random_free_pose() call */
+    size_t drawAttempts_ = 0;
+
+    /** plan() deadline, if maxPlanningTime is set */
+    std::optional<mrpt::Clock::time_point> planDeadline_;
+
+    /** True if the sampler must give up, after `attempt` tentative samples */
+    bool draw_budget_exhausted(size_t attempt) const;
+
+    /** Adaptive proposal statistics, see proposalBinsPerPTG */
+    struct ProposalBin
+    {
+        uint32_t successes = 0, failures = 0;
+    };
+    /** Indexed by PTG index, then trajectory bin. Reset in each plan() */
+    std::vector<std::vector<ProposalBin>> proposalBins_;
+
+    double proposal_weight(const ProposalBin& b) const;
+
+    /** Maps `u` in [0,1) to a trajectory index of PTG `ptgIdx`, following
+     * the adaptive proposal distribution. */
+    trajectory_index_t draw_trajectory_index(
+        ptg_index_t ptgIdx, size_t trajCount, double u) const;
+
+    /** Records whether a TPS sample along a given trajectory was valid */
+    void update_proposal(
+        ptg_index_t ptgIdx, trajectory_index_t trajIdx, size_t trajCount,
+        bool success);
 
     using path_to_nodes_list_t = std::map<
         distance_t,
@@ -113,12 +306,33 @@ class TPS_RRTstar : public mrpt::system::COutputLogger
      * the metric on the Lie group, i.e. *not* following any particular PTG
      * trajectory.
      *
+     * In plan(), this is called once per iteration, for the new sample, and
+     * the result is shared by the EXTEND and REWIRE stages.
+     *
+     * Only the nodes in the cells of an (x,y) grid index (see nodeIndices_)
+     * overlapping the ball are checked, since the Lie metric is never
+     * smaller than the |x| and |y| differences.
+     *
      * \sa find_reachable_nodes_from(), find_source_nodes_towards()
      */
     closest_lie_nodes_list_t find_nearby_nodes(
         const MotionPrimitivesTreeSE2& tree, const mrpt::math::TPose2D& query,
         const double maxDistance);
 
+    /** Grid index of the (x,y) coordinates of the nodes of a tree, with
+     * cells of minSearchRadius. Node poses never change once inserted, and
+     * node IDs are consecutive, so it is updated lazily in
+     * find_nearby_nodes() with the nodes added since its former call. */
+    struct NodeGridIndex
+    {
+        size_t                                              numIndexed = 0;
+        std::unordered_map<uint64_t, std::vector<TNodeID>> cells;
+    };
+
+    /** One per tree, by address. Cleared at the start of plan() and
+     * repair(). */
+    std::map<const MotionPrimitivesTreeSE2*, NodeGridIndex> nodeIndices_;
+
     std::tuple<distance_t, TNodeID> find_closest_node(
         const MotionPrimitivesTreeSE2& tree,
         const mrpt::math::TPose2D&     query) const;
@@ -137,35 +351,62 @@ class TPS_RRTstar : public mrpt::system::COutputLogger
         const closest_lie_nodes_list_t& hintCloseNodes,
         const std::optional<TNodeID>&   nodeToIgnoreHeading = std::nullopt);
 
-    /** Returns local obstacles as seen from a given pose, clipped to a maximum
-     * distance. */
-    static void transform_pc_square_clipping(
-        const mrpt::maps::CPointsMap& inMap,
-        const mrpt::poses::CPose2D& asSeenFrom, const double MAX_DIST_XY,
-        mrpt::maps::CPointsMap& outMap, bool appendToOutMap = true);
+    /** Pseudorandom generator, seeded at the beginning of each plan() */
+    mrpt::random::CRandomGenerator rng_;
 
-    /** Returns TPS-distance to obstacles.
-     * ptg dynamic state must be updated by the caller.
-     */
-    distance_t tp_obstacles_single_path(
-        const trajectory_index_t      tp_space_k_direction,
-        const mrpt::maps::CPointsMap& localObstacles, const ptg_t& ptg);
+    /** Low-discrepancy sequences for draw_random_euclidean() and
+     * draw_random_tps(), created at the beginning of each plan() unless
+     * samplingSequence is Random. */
+    std::optional<HaltonSequence> euclideanSequence_, tpsSequence_;
 
-    mrpt::maps::CPointsMap::Ptr cached_local_obstacles(
-        const MotionPrimitivesTreeSE2& tree, const TNodeID nodeID,
-        const std::vector<mrpt::maps::CPointsMap::Ptr>& globalObstacles,
-        double                                          MAX_XY_DIST);
-
-    /** for use in cached_local_obstacles(), local_obstacles_cache_ */
-    struct LocalObstaclesInfo
+    /** Returns the next sample in [0,1)^N from `seq`, or from rng_ if it is
+     * empty. */
+    template <size_t N>
+    std::array<double, N> draw_unit_sample(std::optional<HaltonSequence>& seq)
     {
-        mrpt::maps::CPointsMap::Ptr obs;
-        mrpt::math::TPose2D         globalNodePose;
-    };
-
-    std::map<TNodeID, LocalObstaclesInfo> local_obstacles_cache_;
+        std::array<double, N> u;
+        if (seq)
+            seq->next(u.data());
+        else
+            for (auto& v : u) v = rng_.drawUniform(0.0, 1.0);
+        return u;
+    }
+
+    /** Bidirectional search: grows the reverse tree `goalTree`, whose root is
+     * the goal and whose node costs are costs *to* the goal, by one random
+     * reversed PTG motion ending at one of its existing nodes.
+     * \return The ID of the new node in `goalTree`, if it was inserted.
+     */
+    std::optional<TNodeID> extend_reverse_tree(
+        MotionPrimitivesTreeSE2& goalTree, const PlannerInput& pi,
+        const std::vector<mrpt::maps::CPointsMap::Ptr>& globalObstacles,
+        const double MAX_XY_DIST, const distance_t searchRadius);
+
+    /** Bidirectional search: tries to link `tree` node `fromNodeId` to the
+     * goal by following the chain of `goalTree` nodes from
+     * `goalTreeNodeId` to its root, validating each hop as a forward motion
+     * from the end of the former one. `tree` is only modified if the whole
+     * chain is valid and cheaper than the current solution: then its nodes
+     * are added, and the goal node rewired. Existing nodes closer than
+     * metricDistanceEpsilon to a hop end are reused instead of duplicated.
+     * \return true if the goal node has been rewired.
+     */
+    bool connect_to_reverse_tree(
+        MotionPrimitivesTreeSE2& tree, const TNodeID fromNodeId,
+        const MotionPrimitivesTreeSE2& goalTree, const TNodeID goalTreeNodeId,
+        const TNodeID goalNodeId, const PlannerInput& pi,
+        const std::vector<mrpt::maps::CPointsMap::Ptr>& globalObstacles,
+        const double MAX_XY_DIST, const distance_t searchRadius);
 
-    cost_t cost_path_segment(const MoveEdgeSE2_TPS& edge) const;
+    /** Returns the cheapest collision-free edge, among all PTGs, going from
+     * `tree` node `srcNodeId` to `target` (up to the PTG discretization).
+     */
+    std::optional<MoveEdgeSE2_TPS> direct_edge_towards(
+        const MotionPrimitivesTreeSE2& tree, const TNodeID srcNodeId,
+        const mrpt::math::TPose2D& target, const bool ignoreTargetHeading,
+        const TrajectoriesAndRobotShape&                trs,
+        const std::vector<mrpt::maps::CPointsMap::Ptr>& globalObstacles,
+        const double MAX_XY_DIST, const distance_t maxDistance);
 };
 
 }  // namespace selfdriving
@@ -6,11 +6,13 @@
 
 #pragma once
 
-#include <mrpt/core/WorkerThreadsPool.h>
 #include <mrpt/poses/CPose2DInterpolator.h>
 #include <mrpt/system/COutputLogger.h>
 #include <mrpt/system/CTimeLogger.h>
 #include <mrpt/typemeta/TEnumType.h>
+#include <selfdriving/algos/PathTracker.h>
+#include <selfdriving/algos/PlannerJobScheduler.h>
+#include <selfdriving/algos/TPS_PRM.h>
 #include <selfdriving/algos/TPS_RRTstar.h>
 #include <selfdriving/data/PlannerInput.h>
 #include <selfdriving/data/PlannerOutput.h>
@@ -19,8 +21,12 @@
 #include <selfdriving/interfaces/ObstacleSource.h>
 #include <selfdriving/interfaces/VehicleMotionInterface.h>
 
+#include <atomic>
 #include <functional>
 #include <list>
+#include <mutex>
+#include <utility>
+#include <vector>
 
 namespace selfdriving
 {
@@ -123,11 +129,18 @@ class WaypointSequencer : public mrpt::system::COutputLogger
 
         /** [rad] Angular error tolerance for waypoints with an assigned heading
          * (Default: 5 deg) */
-        // double waypoint_angle_tolerance = mrpt::DEG2RAD(5.0);
+        double waypoint_angle_tolerance = mrpt::DEG2RAD(5.0);
 
         /** >=0 number of waypoints to forward to the underlying navigation
          * engine, to ease obstacles avoidance when a waypoint is blocked
-         * (Default=2). */
+         * (Default=2).
+         *
+         * They are passed to the path planner as PlannerInput::extraGoals, so
+         * a single plan provides paths to all of them. Then, skippable
+         * waypoints are skipped only if a path to a later one was found.
+         * With planners not searching for extra goals (see
+         * Planner::supports_extra_goals()), skippable waypoints are always
+         * skipped, as with no look-ahead. */
         int multitarget_look_ahead = 2;
 
         /** Default value=0, means use the "targetAllowedDistance" passed by the
@@ -145,7 +158,54 @@ class WaypointSequencer : public mrpt::system::COutputLogger
          * dist_check_target_is_blocked be fulfilled to raise an event */
         int hysteresis_check_target_is_blocked{3};
 
+        /** Path planner engine: the class name of any registered Planner,
+         * e.g. "selfdriving::TPS_Astar" for deterministic planning with a
+         * bounded number of expansions. TPS_RRTstar is configured from
+         * `rrt_params`; any other planner, from `planner_params`, if not
+         * empty. */
+        std::string planner_name = "selfdriving::TPS_RRTstar";
+
         TPS_RRTstar_Parameters rrt_params;
+        mrpt::containers::yaml planner_params;
+
+        /** If set, path planning uses a TPS_PRM roadmap over the static
+         * globalMapObstacleSource instead of TPS_RRTstar. The roadmap is
+         * loaded from this file in initialize() if it exists and matches the
+         * current PTGs; otherwise, it is built and saved to this file. */
+        std::optional<std::string> prm_roadmap_file;
+
+        TPS_PRM_Parameters prm_params;
+
+        /** Pipelined planning: while the path towards a waypoint is being
+         * executed, the segment towards the next one is planned in another
+         * thread, starting at the predicted final state of the current path.
+         * It is used as soon as the current waypoint is reached, after
+         * checking it against the obstacles sensed meanwhile. */
+        bool pipelined_planning = true;
+
+        /** [m] When checking a pipelined plan, sensed obstacle points closer
+         * than this to a point already present when it was planned are not
+         * considered new. */
+        double revalidation_obstacle_tolerance = 0.02;
+
+        /** Latency compensation: plans start at the vehicle state predicted
+         * after the expected planning time, an exponentially-weighted moving
+         * average (with this smoothing factor in (0,1]) of the latencies of
+         * former plans. 0: disabled, plan from the latest vehicle state.
+         * See predict_vehicle_state(). */
+        double plan_latency_ewma_alpha = 0.3;
+
+        /** [s] Expected planning time before any plan has been measured */
+        double initial_plan_latency = 0.5;
+
+        /** Number of path planner threads (Default=2). Replans the vehicle is
+         * waiting for preempt lower priority jobs (e.g. pipelined planning)
+         * if there is no idle thread, see PlannerJobScheduler. */
+        size_t planner_worker_threads = 2;
+
+        /** Parameters of the path tracker thread, which sends the planned
+         * paths to the vehicle, see PathTracker */
+        PathTracker_Parameters path_tracker_params;
 
         /** @} */
 
@@ -225,6 +285,21 @@ class WaypointSequencer : public mrpt::system::COutputLogger
     mrpt::system::CTimeLogger navProfiler_{
         true /*enabled*/, "WaypointSequencer"};
 
+    /** Total time [s] spent by the path planner thread, and the part of it
+     * spent in plans that were cancelled (new navigation request, cancel(),
+     * or a change of target) before or after completion. */
+    double total_planner_time() const { return plannerTimeUs_ * 1e-6; }
+    double wasted_planner_time() const { return wastedPlannerTimeUs_ * 1e-6; }
+
+    /** Queueing and running time statistics of the path planner jobs of the
+     * given priority class. Requires initialize() to be called first. */
+    PlannerJobScheduler::ClassStats planner_job_stats(
+        const PlannerJobClass jobClass) const
+    {
+        ASSERT_(plannerScheduler_);
+        return plannerScheduler_->stats(jobClass);
+    }
+
     /** @}*/
 
 #if 0
@@ -286,16 +361,46 @@ class WaypointSequencer : public mrpt::system::COutputLogger
 
     void internal_on_start_new_navigation();
 
-    // Path planning in a parallel thread:
-    mrpt::WorkerThreadsPool pathPlannerPool_{
-        1 /*Single thread*/, mrpt::WorkerThreadsPool::POLICY_DROP_OLD,
-        "path_planner"};
+    /** Path planning in parallel threads: plans the vehicle is waiting for
+     * are PlannerJobClass::URGENT, pipelined plans are LOOKAHEAD. Created in
+     * initialize(). */
+    std::unique_ptr<PlannerJobScheduler> plannerScheduler_;
+
+    /** Executes the active plan at its own rate. Started in initialize(). */
+    PathTracker pathTracker_;
+
+    /** Sends the path from the root of the active plan to
+     * activePlanGoalNodeId to pathTracker_.
+     *
+     * \param continuesFormerPath If true, the plan starts at the end of the
+     *  path formerly sent (a pipelined plan), and it is appended to it.
+     *  Otherwise, it replaces it, starting at the current vehicle pose.
+     *  \return false if the plan could not be appended, since the tracker
+     *  lost the former path.
+     */
+    bool send_active_plan_to_tracker(bool continuesFormerPath);
+
+    /** Drops the active plan if pathTracker_ lost track of it, or if its
+     * execution ended before reaching activeFinalTarget, so a new one is
+     * planned from the current vehicle state */
+    void check_path_tracking();
+
+    /** Forgets about activeFinalTarget, activePlan and the pipelined plan of
+     * the next segment, if any */
+    void drop_active_plan();
 
     struct PathPlannerInput
     {
         PathPlannerInput() = default;
 
         selfdriving::PlannerInput pi;
+
+        /** The waypoint of each of pi.extraGoals */
+        std::vector<waypoint_idx_t> extraGoalWaypoints;
+
+        /** Passed to the planner, to stop it if the plan is no longer needed
+         */
+        CancellationToken cancellation;
     };
 
     struct PathPlannerOutput
@@ -303,10 +408,89 @@ class WaypointSequencer : public mrpt::system::COutputLogger
         PathPlannerOutput() = default;
 
         selfdriving::PlannerOutput po;
+
+        /** The waypoint of each of po.extraGoals */
+        std::vector<waypoint_idx_t> extraGoalWaypoints;
+
+        /** ObstacleSource::version() of each po.originalInput.obstacles,
+         * when planning started */
+        std::vector<uint64_t> obstacleVersions;
+
+        /** The obstacles of each dynamic source in
+         * po.originalInput.obstacles, as last checked (nullptr for static
+         * sources), so revalidation_function() only checks new points */
+        std::vector<mrpt::maps::CPointsMap::Ptr> obstacleSnapshots;
+
+        /** Whether po.motionTree was built by TPS_RRTstar, so it can be
+         * fixed with TPS_RRTstar::repair() */
+        bool repairable = false;
+
+        /** True if already checked by revalidation_function() */
+        bool revalidated = false;
+
+        /** The final waypoint of the path and its tree node, see
+         * choose_path_goal(). Empty if not chosen yet, or if there is no
+         * valid path. */
+        std::optional<waypoint_idx_t> chosenWp;
+        TNodeID                       pathGoalNodeId = INVALID_NODEID;
     };
 
     PathPlannerOutput path_planner_function(PathPlannerInput ppi);
 
+    /** EWMA of the time from enqueuing a plan to getting its result [s] */
+    std::optional<double> planLatencyEstimate_;
+
+    /** The vehicle state predicted `dt` seconds after the latest
+     * localization, following its commanded motion: integrating its current
+     * velocity while pathTracker_ executes a path, or at rest at its current
+     * pose otherwise, since then it was commanded to stop (or it was not
+     * commanded at all). */
+    SE2_KinState predict_vehicle_state(const double dt) const;
+
+    /** Accumulated by path_planner_function() [us] */
+    std::atomic<int64_t> plannerTimeUs_{0}, wastedPlannerTimeUs_{0};
+
+    /** Cancels the running or enqueued path planner job, if any */
+    void cancel_path_planner();
+
+    /** Shared by all planner instances, since most replans are towards the
+     * same waypoint. */
+    CostToGoFieldCache::Ptr costToGoCache_ =
+        std::make_shared<CostToGoFieldCache>();
+
+    /** Creates and configures a new instance of config_.planner_name, or a
+     * new TPS_PRM over the roadmap of roadmapPlanner_, if any */
+    Planner::Ptr create_planner() const;
+
+    /** Only if config_.prm_roadmap_file is set. Created in initialize().
+     * Only used to build (or load) the roadmap, shared by the TPS_PRM
+     * instances of each planner job. */
+    std::shared_ptr<TPS_PRM> roadmapPlanner_;
+
+    /** Planner::supports_extra_goals() of the planner used. Set in
+     * initialize() */
+    bool plannerSupportsExtraGoals_ = false;
+
+    /** Deep copies of config_.ptgs for the planner jobs, since planners
+     * modify the PTGs dynamic state. Copies are reused by later jobs, but
+     * never used by two jobs at once. */
+    struct PTGsCopyPool
+    {
+        std::mutex                             mtx;
+        std::vector<TrajectoriesAndRobotShape> free;
+        size_t generation = 0;  //!< Incremented when config_.ptgs change
+    };
+    PTGsCopyPool ptgsCopies_;
+
+    /** Takes a copy of config_.ptgs from ptgsCopies_, or creates a new one.
+     * \return The copy and the pool generation, for release_ptgs_copy() */
+    std::pair<TrajectoriesAndRobotShape, size_t> acquire_ptgs_copy();
+
+    void release_ptgs_copy(
+        TrajectoriesAndRobotShape&& ptgs, const size_t generation);
+
+    void initialize_roadmap_planner();
+
     /** Everything that should be cleared upon a new navigation command. */
     struct CurrentNavInternalState
     {
@@ -323,11 +507,34 @@ class WaypointSequencer : public mrpt::system::COutputLogger
 
         std::future<PathPlannerOutput> pathPlannerFuture;
         std::optional<waypoint_idx_t>  pathPlannerTarget;
+        CancellationToken              pathPlannerCancellation;
+
+        /** True if pathPlannerFuture comes from the pipelined planning of
+         * the next segment */
+        bool pathPlannerIsPipelined = false;
+
+        /** True if pathPlannerFuture starts at the end of the path sent to
+         * the tracker (a handed-over pipelined plan, even if revalidated
+         * since then) */
+        bool pathPlannerContinuesPath = false;
+
+        /** When the pathPlannerFuture job was enqueued, to measure latency */
+        mrpt::Clock::time_point pathPlannerEnqueueTime;
 
         /** The final waypoint of the currently under-execution path tracking.
          */
         std::optional<waypoint_idx_t> activeFinalTarget;
 
+        /** The plan under execution, and its final node, towards
+         * activeFinalTarget */
+        std::optional<PathPlannerOutput> activePlan;
+        TNodeID                          activePlanGoalNodeId = INVALID_NODEID;
+
+        /** Pipelined planning of the segment after activeFinalTarget */
+        std::future<PathPlannerOutput> nextSegmentFuture;
+        std::optional<waypoint_idx_t>  nextSegmentTarget;
+        CancellationToken              nextSegmentCancellation;
+
         // int  counterCheckTargetIsBlocked_ = 0;
 
         /** For sending an alarm (error event) when it seems that we are not
@@ -350,14 +557,42 @@ class WaypointSequencer : public mrpt::system::COutputLogger
      * trajectory to the path tracker */
     void check_new_rrtstar_output();
 
-    /** Finds the next waypt index up to which we should find a new RRT* plan */
-    waypoint_idx_t find_next_waypoint_for_planner();
+    /** Finds the next waypt index up to which we should find a new RRT* plan,
+     * only among those after `after`, if given. */
+    std::optional<waypoint_idx_t> find_next_waypoint_for_planner(
+        const std::optional<waypoint_idx_t>& after = std::nullopt);
 
-    /** Enqueues a task in pathPlannerPool_ running path_planner_function() and
-     * saving future results into pathPlannerFuture
+    /** Enqueues an URGENT job in plannerScheduler_ running
+     * path_planner_function() and saving future results into
+     * pathPlannerFuture
      */
     void enqueue_path_planner_towards(const waypoint_idx_t target);
 
+    /** The planner input for a path towards waypoint `target` (and the
+     * following ones, see multitarget_look_ahead), except the start state */
+    PathPlannerInput make_planner_input(const waypoint_idx_t target);
+
+    /** Pipelined planning: enqueues a LOOKAHEAD job in plannerScheduler_ for
+     * the segment after activeFinalTarget */
+    void enqueue_next_segment_planner();
+
+    /** Marks waypoints as reached when the vehicle gets to activeFinalTarget,
+     * and hands over the pipelined plan of the next segment, if any */
+    void check_active_target_reached();
+
+    /** Whether any obstacle source changed since `p` was planned */
+    bool obstacles_changed(const PathPlannerOutput& p) const;
+
+    /** Run in a planner thread: checks the chosen path of a pipelined plan
+     * against the obstacles of the sources that changed since it was
+     * computed. If blocked, the tree is repaired (only if built by
+     * TPS_RRTstar) and the path goal is left to be chosen again. */
+    PathPlannerOutput revalidation_function(
+        PathPlannerOutput p, CancellationToken cancellation);
+
+    /** Sets the chosenWp and pathGoalNodeId of a planner result */
+    void choose_path_goal(PathPlannerOutput& result) const;
+
 #if 0
     bool checkHasReachedTarget(const double targetDist) const override;
 
@@ -0,0 +1,31 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+namespace selfdriving
+{
+/** A thread-safe flag used to ask a running planner to stop as soon as
+ * possible. All copies of a token share the same state, so a token can be
+ * handed to a planner and cancelled later on from another thread.
+ */
+class CancellationToken
+{
+   public:
+    CancellationToken() = default;
+
+    void cancel() { *flag_ = true; }
+    bool cancelled() const { return *flag_; }
+
+   private:
+    std::shared_ptr<std::atomic_bool> flag_ =
+        std::make_shared<std::atomic_bool>(false);
+};
+
+}  // namespace selfdriving
@@ -0,0 +1,96 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <mrpt/containers/CDynamicGrid.h>
+#include <mrpt/maps/CPointsMap.h>
+#include <mrpt/math/TPoint2D.h>
+
+#include <limits>
+#include <optional>
+#include <vector>
+
+namespace selfdriving
+{
+/** A 2D grid with the length of the shortest obstacle-free path from each
+ * cell to a goal point, computed with a Dijkstra wavefront over an
+ * 8-connected occupancy grid built from point obstacles.
+ *
+ * Unlike the plain Euclidean distance, it accounts for walls between a pose
+ * and the goal, so it is a much better heuristic for graph search planners.
+ * heuristic() returns a lower bound of the true path length (up to the grid
+ * resolution), so it can be used as an A* admissible heuristic.
+ */
+class CostToGoField
+{
+   public:
+    CostToGoField() = default;
+
+    struct Parameters
+    {
+        Parameters() = default;
+
+        double resolution = 0.25;  //!< Grid cell size [m]
+
+        /** Obstacles are grown by this radius [m], typically the radius of
+         * the circle inscribed in the robot shape. */
+        double obstacleInflation = 0;
+    };
+
+    static CostToGoField Compute(
+        const mrpt::math::TPoint2D& goal, const mrpt::math::TPoint2D& bboxMin,
+        const mrpt::math::TPoint2D&                     bboxMax,
+        const std::vector<mrpt::maps::CPointsMap::Ptr>& obstacles,
+        const Parameters&                               p = Parameters());
+
+    bool empty() const { return grid_.getSizeX() == 0; }
+
+    /** Grid path length from `p` to the goal, or an empty optional if `p` is
+     * outside of the grid, in an occupied cell, or the goal is unreachable
+     * from it. */
+    std::optional<double> cost_to_go(const mrpt::math::TPoint2D& p) const;
+
+    /** A lower bound of the path length from `p` to the goal: the largest of
+     * the Euclidean distance and the grid cost, the latter corrected for the
+     * 8-connectivity and cell discretization errors. */
+    double heuristic(const mrpt::math::TPoint2D& p) const;
+
+    /** Returns the grid path (cell centers) from `p` to the goal, following
+     * the steepest descent of the field, or an empty vector if the goal is
+     * not reachable from `p`. The path is truncated after `maxLength` [m].
+     */
+    std::vector<mrpt::math::TPoint2D> path_from(
+        const mrpt::math::TPoint2D& p,
+        const double maxLength = std::numeric_limits<double>::max()) const;
+
+    /** The point `distance` meters ahead of `p` along path_from(), or the
+     * goal if it is closer. Empty if the goal is not reachable from `p`. */
+    std::optional<mrpt::math::TPoint2D> lookahead_point(
+        const mrpt::math::TPoint2D& p, const double distance) const;
+
+    /** The world area covered by the field */
+    mrpt::math::TPoint2D bbox_min() const
+    {
+        return {grid_.getXMin(), grid_.getYMin()};
+    }
+    mrpt::math::TPoint2D bbox_max() const
+    {
+        return {grid_.getXMax(), grid_.getYMax()};
+    }
+
+    const mrpt::math::TPoint2D& goal() const { return goal_; }
+
+    using grid_t = mrpt::containers::CDynamicGrid<float>;
+
+    const grid_t& grid() const { return grid_; }
+
+   private:
+    grid_t               grid_;
+    mrpt::math::TPoint2D goal_;
+};
+
+}  // namespace selfdriving
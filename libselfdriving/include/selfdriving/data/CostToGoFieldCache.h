@@ -0,0 +1,79 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <selfdriving/data/CostToGoField.h>
+#include <selfdriving/interfaces/ObstacleSource.h>
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+namespace selfdriving
+{
+/** A thread-safe, least-recently-used cache of CostToGoField objects, so
+ * successive plans towards the same goal (e.g. replanning towards the same
+ * waypoint) reuse the same field.
+ *
+ * Entries are keyed by the exact goal, the field parameters, and the
+ * identity, ObstacleSource::version() and a hash of the points of each
+ * obstacle source (see obstacle_points_hash()), since static sources may
+ * not bump their version when their contents change. Hashing is linear in
+ * the number of points, much cheaper than building a field. A cached field
+ * is reused if it covers the requested world area.
+ *
+ * Only static obstacle sources (see ObstacleSource::dynamic()) are used to
+ * build the fields: with fewer obstacles, the field remains a lower bound of
+ * the actual cost-to-go.
+ */
+class CostToGoFieldCache
+{
+   public:
+    using Ptr = std::shared_ptr<CostToGoFieldCache>;
+
+    explicit CostToGoFieldCache(size_t maxEntries = 8)
+        : maxEntries_(maxEntries)
+    {
+    }
+
+    /** Returns the cached field, or computes it (and stores it) if there is
+     * none for the given goal and obstacles. */
+    std::shared_ptr<const CostToGoField> get(
+        const mrpt::math::TPoint2D& goal, const mrpt::math::TPoint2D& bboxMin,
+        const mrpt::math::TPoint2D&             bboxMax,
+        const std::vector<ObstacleSource::Ptr>& obstacles,
+        const CostToGoField::Parameters&        p);
+
+    void clear();
+
+    size_t hits() const { return hits_; }
+    size_t misses() const { return misses_; }
+
+   private:
+    struct Entry
+    {
+        mrpt::math::TPoint2D goal;
+
+        CostToGoField::Parameters params;
+
+        /** Source, version, and points hash */
+        std::vector<std::tuple<const ObstacleSource*, uint64_t, uint64_t>>
+            sources;
+
+        std::shared_ptr<const CostToGoField> field;
+    };
+
+    const size_t     maxEntries_;
+    std::mutex       mtx_;
+    std::list<Entry> entries_;  //!< Most recently used first
+    size_t           hits_ = 0, misses_ = 0;
+};
+
+}  // namespace selfdriving
@@ -0,0 +1,70 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <mrpt/typemeta/TEnumType.h>
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace selfdriving
+{
+/** How planners draw their random samples. */
+enum class SamplingSequence : uint8_t
+{
+    /** Independent pseudorandom samples */
+    Random = 0,
+    /** Deterministic Halton sequence */
+    Halton,
+    /** Halton sequence with seeded random digit permutations, so parallel
+     * planners with different seeds explore different sequences. */
+    ScrambledHalton
+};
+
+/** A Halton low-discrepancy sequence over the unit hypercube [0,1)^d, with
+ * optional digit scrambling.
+ *
+ * Compared to independent uniform samples, consecutive points fill the
+ * space evenly, without clusters or gaps, so a given coverage is reached
+ * with fewer samples. The sequence is fully determined by the number of
+ * dimensions and the scrambling seed.
+ */
+class HaltonSequence
+{
+   public:
+    /** Creates the sequence for `dimensions` dimensions. If a seed is given,
+     * digits are scrambled with random permutations (one per dimension)
+     * and the sequence starts at a seed-dependent index. */
+    explicit HaltonSequence(
+        size_t                         dimensions,
+        const std::optional<uint32_t>& scrambleSeed = std::nullopt);
+
+    size_t dimensions() const { return bases_.size(); }
+
+    /** Writes the next point of the sequence into `out`, which must have
+     * room for dimensions() values in the range [0,1). */
+    void next(double* out);
+
+   private:
+    std::vector<uint32_t> bases_;
+
+    /** Digit permutations, for each dimension. Empty if not scrambled. */
+    std::vector<std::vector<uint32_t>> permutations_;
+
+    uint64_t index_ = 1;
+
+    double radical_inverse(size_t dim, uint64_t i) const;
+};
+
+}  // namespace selfdriving
+
+MRPT_ENUM_TYPE_BEGIN_NAMESPACE(selfdriving, selfdriving::SamplingSequence)
+MRPT_FILL_ENUM_MEMBER(selfdriving::SamplingSequence, Random);
+MRPT_FILL_ENUM_MEMBER(selfdriving::SamplingSequence, Halton);
+MRPT_FILL_ENUM_MEMBER(selfdriving::SamplingSequence, ScrambledHalton);
+MRPT_ENUM_TYPE_END()
@@ -13,13 +13,17 @@
 #include <mrpt/nav/tpspace/CParameterizedTrajectoryGenerator.h>
 #include <mrpt/poses/CPose2D.h>
 #include <selfdriving/data/MoveEdgeSE2_TPS.h>
+#include <selfdriving/data/PTGDynamicStateCache.h>
+#include <selfdriving/data/PTGReachableRegion.h>
 #include <selfdriving/data/SE2_KinState.h>
 #include <selfdriving/data/ptg_t.h>
 
 #include <cstdint>
 #include <deque>
+#include <limits>
 #include <list>
 #include <set>
+#include <vector>
 
 namespace selfdriving
 {
@@ -203,6 +207,58 @@ class MotionPrimitivesTree : public mrpt::graphs::CDirectedTree<EDGE_TYPE>
         node.cost_     = newCost;
     }
 
+    /** Recomputes the costs of all descendants of `nodeId` from its current
+     * cost and their edge costs, e.g. after it has been rewired. Nodes below
+     * an edge with the max. cost, or whose parent has it, are unreachable and
+     * also get the max. cost. */
+    void propagate_cost_to_descendants(const mrpt::graphs::TNodeID nodeId)
+    {
+        constexpr cost_t UNREACHABLE = std::numeric_limits<cost_t>::max();
+
+        std::vector<mrpt::graphs::TNodeID> pending = {nodeId};
+        while (!pending.empty())
+        {
+            const auto id = pending.back();
+            pending.pop_back();
+
+            const auto it = base_t::edges_to_children.find(id);
+            if (it == base_t::edges_to_children.end()) continue;
+
+            const cost_t parentCost = nodes_.at(id).cost_;
+            for (const auto& e : it->second)
+            {
+                auto& child = nodes_.at(e.id);
+                child.cost_ =
+                    (parentCost == UNREACHABLE || e.data.cost == UNREACHABLE)
+                        ? UNREACHABLE
+                        : parentCost + e.data.cost;
+                pending.push_back(e.id);
+            }
+        }
+    }
+
+    /** Marks the edge from its parent to `nodeId` as blocked (max. cost), so
+     * `nodeId` and all its descendants become unreachable, until they are
+     * rewired with rewire_node_parent(). */
+    void invalidate_edge_to(const mrpt::graphs::TNodeID nodeId)
+    {
+        constexpr cost_t UNREACHABLE = std::numeric_limits<cost_t>::max();
+
+        auto& node = nodes_.at(nodeId);
+        for (auto& e : base_t::edges_to_children.at(*node.parentID_))
+        {
+            if (e.id != nodeId) continue;
+            e.data.cost = UNREACHABLE;
+            node.cost_  = UNREACHABLE;
+            propagate_cost_to_descendants(nodeId);
+            return;
+        }
+        THROW_EXCEPTION_FMT(
+            "[invalidate_edge_to] Error: Could not find edge from parent to "
+            "node #%s",
+            std::to_string(nodeId).c_str());
+    }
+
     const EDGE_TYPE& edge_to_parent(const mrpt::graphs::TNodeID nodeId) const
     {
         auto&       node        = nodes_.at(nodeId);
@@ -281,8 +337,14 @@ template <>
 struct PoseDistanceMetric_TPS<SE2_KinState>
 {
     // Note: ptg is not const since we'll need to update its dynamic state
-    PoseDistanceMetric_TPS(ptg_t& ptg, const double headingTolerance)
-        : ptg_(ptg), headingTolerance_(headingTolerance)
+    PoseDistanceMetric_TPS(
+        ptg_t& ptg, const double headingTolerance,
+        PTGDynamicStateCache*     dynStateCache   = nullptr,
+        const PTGReachableRegion* reachableRegion = nullptr)
+        : ptg_(ptg),
+          headingTolerance_(headingTolerance),
+          dynStateCache_(dynStateCache),
+          reachableRegion_(reachableRegion)
     {
     }
 
@@ -294,67 +356,130 @@ struct PoseDistanceMetric_TPS<SE2_KinState>
         if (std::abs(a.pose.y - b.y) > d) return true;
         if (std::abs(mrpt::math::angDistance(a.pose.phi, b.phi)) > d)
             return true;
+        // Note: masks are only built for PTGs independent of the velocity
+        if (reachableRegion_)
+        {
+            // Out of the area the PTG can reach at all?
+            const auto rel = b - a.pose;
+            if (!reachableRegion_->contains(rel.x, rel.y)) return true;
+        }
         return false;
     }
     std::optional<std::tuple<distance_t, trajectory_index_t>> distance(
         const SE2_KinState& src, const mrpt::math::TPose2D& dst,
         bool ignoreDstHeading) const
     {
-        normalized_distance_t normDist;
-        trajectory_index_t    k;
-        const auto            relPose     = dst - src.pose;
-        auto                  localSrcVel = src.vel;
+        const auto relPose     = dst - src.pose;
+        auto       localSrcVel = src.vel;
         localSrcVel.rotate(-src.pose.phi);
 
+        set_dynamic_state(localSrcVel, relPose);
+
+        const batch_result_t r =
+            distance_to_relative_pose({relPose, ignoreDstHeading});
+
+        // not in range: we can't evaluate this distance!
+        if (!r.valid()) return {};
+
+        return {{r.d, r.k}};
+    }
+
+    /** One query for distance_batch(): a target pose relative to the source
+     */
+    struct batch_query_t
+    {
+        mrpt::math::TPose2D relPose;
+        bool                ignoreDstHeading = false;
+    };
+
+    /** One result from distance_batch() */
+    struct batch_result_t
+    {
+        trajectory_index_t k = 0;
+        distance_t         d = 0;
+        /** The target is within the PTG range (exact inverse map) */
+        bool exact = false;
+        /** The heading at the end of the PTG path is within tolerance */
+        bool headingValid = false;
+
+        bool valid() const { return exact && headingValid; }
+    };
+
+    /** Evaluates distance() for many target poses, all of them reached from
+     * source states sharing the same local velocity `localSrcVel`, so the
+     * PTG dynamic state is set up only once for the whole batch.
+     *
+     * `results` is resized to the number of queries, in the same order.
+     */
+    void distance_batch(
+        const mrpt::math::TTwist2D&       localSrcVel,
+        const std::vector<batch_query_t>& queries,
+        std::vector<batch_result_t>&      results) const
+    {
+        results.resize(queries.size());
+        if (queries.empty()) return;
+
+        set_dynamic_state(localSrcVel, queries.front().relPose);
+
+        for (size_t i = 0; i < queries.size(); i++)
+            results[i] = distance_to_relative_pose(queries[i]);
+    }
+
+   private:
+    ptg_t&                    ptg_;
+    const double              headingTolerance_;
+    PTGDynamicStateCache*     dynStateCache_   = nullptr;
+    const PTGReachableRegion* reachableRegion_ = nullptr;
+
+    void set_dynamic_state(
+        const mrpt::math::TTwist2D& localSrcVel,
+        const mrpt::math::TPose2D&  relTarget) const
+    {
         ptg_t::TNavDynamicState dynState;
-        dynState.relTarget      = relPose;
+        dynState.relTarget      = relTarget;
         dynState.targetRelSpeed = 1.0;  // TODO! (?)
         dynState.curVelLocal    = localSrcVel;
 
-        ptg_.updateNavDynamicState(dynState);
+        if (dynStateCache_)
+            dynStateCache_->update(ptg_, dynState);
+        else
+            ptg_.updateNavDynamicState(dynState);
+    }
 
-        bool tp_point_is_exact =
-            ptg_.inverseMap_WS2TP(relPose.x, relPose.y, k, normDist);
+    /** The PTG dynamic state must be already set by the caller */
+    batch_result_t distance_to_relative_pose(const batch_query_t& q) const
+    {
+        batch_result_t        r;
+        normalized_distance_t normDist;
+        const auto&           relPose = q.relPose;
 
-        distance_t d = normDist * ptg_.getRefDistance();
+        r.exact = ptg_.inverseMap_WS2TP(relPose.x, relPose.y, r.k, normDist);
+        r.d     = normDist * ptg_.getRefDistance();
 
-        if (tp_point_is_exact)
-        {
-            uint32_t ptg_step;
-            ptg_.getPathStepForDist(k, d, ptg_step);
-            const auto   reconsRelPose = ptg_.getPathPose(k, ptg_step);
-            const double headingError =
-                ignoreDstHeading ? .0
-                                 : std::abs(mrpt::math::angDistance(
-                                       reconsRelPose.phi, relPose.phi));
-
-            if (headingError > headingTolerance_) tp_point_is_exact = false;
-        }
+        if (!r.exact) return r;
 
-        if (tp_point_is_exact)
-        {
-            // de-normalize distance
-            if (d == 0 &&
-                (relPose.x != 0 || relPose.y != 0 || relPose.phi != 0))
-            {
-                // Due to the discrete nature of PTG paths, in rare cases
-                // we have d=0 despite the target is actually not exactly, but
-                // very close to the origin:
-                d = relPose.norm() +
-                    std::abs(relPose.phi) * ptg_.getRefDistance();
-            }
-            return {{d, k}};
-        }
-        else
+        uint32_t ptg_step;
+        ptg_.getPathStepForDist(r.k, r.d, ptg_step);
+        const auto   reconsRelPose = ptg_.getPathPose(r.k, ptg_step);
+        const double headingError =
+            q.ignoreDstHeading ? .0
+                               : std::abs(mrpt::math::angDistance(
+                                     reconsRelPose.phi, relPose.phi));
+
+        r.headingValid = headingError <= headingTolerance_;
+
+        // de-normalize distance
+        if (r.d == 0 &&
+            (relPose.x != 0 || relPose.y != 0 || relPose.phi != 0))
         {
-            // not in range: we can't evaluate this distance!
-            return {};
+            // Due to the discrete nature of PTG paths, in rare cases
+            // we have d=0 despite the target is actually not exactly, but
+            // very close to the origin:
+            r.d = relPose.norm() +
+                  std::abs(relPose.phi) * ptg_.getRefDistance();
         }
+        return r;
     }
-
-   private:
-    ptg_t&       ptg_;
-    const double headingTolerance_;
 };
 
 /** Pose metric for SE(2) on the actual Lie group, i.e. NOT limited to a given
@@ -0,0 +1,73 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <selfdriving/data/ptg_t.h>
+
+#include <cstddef>
+#include <map>
+#include <tuple>
+
+namespace selfdriving
+{
+/** Memoization of the dynamic state of a set of PTGs, used to avoid calling
+ * the (potentially expensive) ptg_t::updateNavDynamicState() when the new
+ * state is equivalent to the one the PTG already holds.
+ *
+ * Two dynamic states are considered equivalent if they share the same key:
+ * (PTG, quantized local velocity, target relative speed). Note that
+ * `relTarget` is *not* part of the key, since the planner does not use
+ * target-dependent PTG parameters, so a PTG whose internal tables were built
+ * for the same velocity is reused as is.
+ *
+ * Quantized velocities (not the original ones) are the ones actually sent to
+ * the PTG, so results do not depend on the order in which states are
+ * evaluated.
+ *
+ * \note All PTG dynamic state changes must go through the same cache object
+ * for it to remain consistent. Call clear() if a PTG may have been modified
+ * by someone else.
+ */
+class PTGDynamicStateCache
+{
+   public:
+    PTGDynamicStateCache() = default;
+
+    /** Quantization step for `vx` and `vy` [m/s]. 0: exact match */
+    double linearVelocityQuantization = 0;
+
+    /** Quantization step for `omega` [rad/s]. 0: exact match */
+    double angularVelocityQuantization = 0;
+
+    /** Makes sure `ptg` is in the given dynamic state, up to the velocity
+     * quantization steps, invoking ptg_t::updateNavDynamicState() only if
+     * required.
+     * \return true on cache hit (PTG left untouched), false otherwise.
+     */
+    bool update(ptg_t& ptg, const ptg_t::TNavDynamicState& ds);
+
+    /** Returns the velocity actually used as key and sent to the PTG by
+     * update() for a given (unquantized) local velocity. */
+    mrpt::math::TTwist2D quantized_velocity(
+        const mrpt::math::TTwist2D& localVel) const;
+
+    /** Forgets about all PTG states, e.g. at the beginning of a new plan. */
+    void clear();
+
+    size_t hits() const { return hits_; }
+    size_t misses() const { return misses_; }
+
+   private:
+    /** (vx, vy, omega, targetRelSpeed), after quantization */
+    using key_t = std::tuple<double, double, double, double>;
+
+    std::map<const ptg_t*, key_t> lastApplied_;
+
+    size_t hits_ = 0, misses_ = 0;
+};
+
+}  // namespace selfdriving
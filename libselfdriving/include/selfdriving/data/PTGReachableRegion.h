@@ -0,0 +1,72 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <selfdriving/data/ptg_t.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace selfdriving
+{
+/** A grid bitmap, in the local frame of a PTG, marking which (x,y) cells can
+ * be reached by any of its trajectories.
+ *
+ * It is used as a cheap pre-filter before the exact (and much more costly)
+ * ptg_t::inverseMap_WS2TP() look ups, e.g. for Ackermann vehicles, which
+ * cannot reach large areas besides and behind the vehicle.
+ *
+ * \sa TrajectoriesAndRobotShape::initFromConfigFile()
+ */
+class PTGReachableRegion
+{
+   public:
+    PTGReachableRegion() = default;
+
+    /** Builds the mask by sweeping all PTG trajectories, for the PTG current
+     * dynamic state. Reached cells are dilated by `dilationDistance` [m] to
+     * account for the tolerance of inverseMap_WS2TP().
+     *
+     * The mask must hold for any initial velocity, so it is disabled for
+     * PTGs whose trajectories depend on it (e.g. Holo_Blend), detected by
+     * comparing them for a few initial velocities. The PTG dynamic state is
+     * restored afterwards.
+     *
+     * \param[in] resolution Cell size [m]. Use <=0 to disable the mask, i.e.
+     * all points will be considered as reachable.
+     */
+    void build(
+        ptg_t& ptg, const double resolution,
+        const double dilationDistance = 0.10);
+
+    /** False if the mask has not been built, or it was disabled. */
+    bool valid() const { return !cells_.empty(); }
+
+    /** Returns false if the given point, in the PTG local frame, is known to
+     * be unreachable by the PTG. It always returns true for an invalid mask.
+     */
+    bool contains(const double x, const double y) const
+    {
+        if (!valid()) return true;
+        const int cx = static_cast<int>((x - minXY_) / resolution_);
+        const int cy = static_cast<int>((y - minXY_) / resolution_);
+        if (x < minXY_ || y < minXY_ || cx >= size_ || cy >= size_)
+            return false;
+        return cells_[cx + cy * size_] != 0;
+    }
+
+   private:
+    /** True if any trajectory of `ptg` changes by more than `tolerance` [m]
+     * for a moving vehicle, with respect to the current dynamic state */
+    static bool depends_on_velocity(ptg_t& ptg, const double tolerance);
+
+    double               resolution_ = 0, minXY_ = 0;
+    int                  size_       = 0;  //!< Cells in each dimension
+    std::vector<uint8_t> cells_;
+};
+
+}  // namespace selfdriving
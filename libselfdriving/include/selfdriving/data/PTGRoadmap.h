@@ -0,0 +1,97 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <mrpt/math/TPose2D.h>
+#include <selfdriving/data/MotionPrimitivesTree.h>
+#include <selfdriving/data/TrajectoriesAndRobotShape.h>
+#include <selfdriving/interfaces/ObstacleSource.h>
+
+#include <string>
+#include <vector>
+
+namespace selfdriving
+{
+/** A directed graph (roadmap) of SE(2) poses connected by collision-free PTG
+ * motion primitives, built once over a static map and reused for many
+ * planning queries.
+ *
+ * All motions start with the nominal (zero velocity) PTG dynamic state.
+ * TPS_PRM re-evaluates them for the actual vehicle velocity at query time.
+ *
+ * \sa TPS_PRM
+ */
+class PTGRoadmap
+{
+   public:
+    PTGRoadmap() = default;
+
+    using node_index_t = size_t;
+    using edge_index_t = size_t;
+
+    struct edge_t
+    {
+        node_index_t       from = 0, to = 0;
+        ptg_index_t        ptgIndex     = 0;
+        trajectory_index_t ptgPathIndex = 0;
+        distance_t         ptgDist      = 0;
+        cost_t             cost         = 0;
+    };
+
+    /** Roadmap vertices: collision-free poses */
+    std::vector<mrpt::math::TPose2D> nodes;
+
+    /** Roadmap motions between nodes */
+    std::vector<edge_t> edges;
+
+    /** Outgoing edges, for each node. Rebuilt by rebuild_adjacency() */
+    std::vector<std::vector<edge_index_t>> outEdges;
+
+    /** Signatures of the PTGs and robot shape used to build the roadmap
+     * (TrajectoriesAndRobotShape::ptg_signature_hash()), and of the static
+     * obstacles (static_obstacles_signature()), to detect stale roadmap
+     * files. */
+    std::vector<uint64_t> ptgSignatures;
+    uint64_t              mapSignature = 0;
+
+    bool empty() const { return nodes.empty(); }
+    void clear();
+
+    node_index_t add_node(const mrpt::math::TPose2D& p);
+    edge_index_t add_edge(const edge_t& e);
+
+    /** Must be called after modifying `edges` directly */
+    void rebuild_adjacency();
+
+    /** Returns true if the roadmap was built for the given set of PTGs and
+     * robot shape */
+    bool compatible_with(const TrajectoriesAndRobotShape& trs) const;
+
+    /** Like compatible_with(trs), also checking that the roadmap was built
+     * for the current contents of the static sources in `obstacles`. This
+     * hashes all their points, so do not call it for each query. */
+    bool compatible_with(
+        const TrajectoriesAndRobotShape&        trs,
+        const std::vector<ObstacleSource::Ptr>& obstacles) const;
+
+    /** A hash of the points of all non-dynamic sources in `obstacles` */
+    static uint64_t static_obstacles_signature(
+        const std::vector<ObstacleSource::Ptr>& obstacles);
+
+    /** Saves/loads the roadmap to/from a (gz-compressed) binary file.
+     * Saving writes a temporary file which is then renamed, so readers never
+     * see a partially-written roadmap.
+     * \return false on I/O errors or wrong file format.
+     */
+    bool save_to_file(const std::string& fileName) const;
+    bool load_from_file(const std::string& fileName);
+
+   private:
+    bool write_to_file(const std::string& fileName) const;
+};
+
+}  // namespace selfdriving
@@ -11,14 +11,40 @@
 #include <selfdriving/data/TrajectoriesAndRobotShape.h>
 #include <selfdriving/interfaces/ObstacleSource.h>
 
+#include <optional>
+#include <vector>
+
 namespace selfdriving
 {
+/** An additional goal for multi-goal planning (PlannerInput::extraGoals) */
+struct PlannerGoal
+{
+    PlannerGoal() = default;
+
+    SE2_KinState state;
+
+    /** Max. distance [m] to state.pose for the goal to be reached */
+    double distanceTolerance = 0.5;
+
+    /** Max. heading error [rad] for the goal to be reached. Empty: any
+     * heading is fine. */
+    std::optional<double> headingTolerance;
+
+    bool is_reached_by(const mrpt::math::TPose2D& p) const;
+};
+
 struct PlannerInput
 {
     SE2_KinState        stateStart, stateGoal;
     mrpt::math::TPose2D worldBboxMin, worldBboxMax;  //!< World bounds
     std::vector<ObstacleSource::Ptr> obstacles;
     TrajectoriesAndRobotShape        ptgs;
+
+    /** Optional goals besides stateGoal, e.g. the next waypoints. Planners
+     * supporting them (TPS_RRTstar) grow a single tree that also serves
+     * these goals, and report the best path to each one in
+     * PlannerOutput::extraGoals. Other planners ignore them. */
+    std::vector<PlannerGoal> extraGoals;
 };
 
 }  // namespace selfdriving
@@ -10,12 +10,27 @@
 #include <selfdriving/data/MotionPrimitivesTree.h>
 #include <selfdriving/data/PlannerInput.h>
 
+#include <cstdint>
 #include <set>
 
 namespace selfdriving
 {
 using TNodeID = mrpt::graphs::TNodeID;
 
+/** The result for each of PlannerInput::extraGoals */
+struct PlannerGoalResult
+{
+    PlannerGoalResult() = default;
+
+    bool success = false;
+
+    /** The cheapest tree node reaching the goal within its tolerances */
+    TNodeID goalNodeId = INVALID_NODEID;
+
+    /** Cost of the path from the tree root to goalNodeId */
+    double pathCost = std::numeric_limits<double>::max();
+};
+
 /** The output of the path planner */
 struct PlannerOutput
 {
@@ -35,12 +50,29 @@ struct PlannerOutput
     /** Total cost of the best found path (cost; Euclidean distance) */
     double pathCost = std::numeric_limits<double>::max();
 
+    /** The seed actually used for the planner pseudorandom generator, which
+     * allows reproducing this same plan. */
+    uint32_t randomSeed = 0;
+
+    /** Sampling-based planners: total number of tentative samples, and
+     * number of iterations without any valid sample within the attempt
+     * budget. */
+    size_t drawAttempts = 0, drawFailures = 0;
+
     /** The ID of the best target node in the tree */
     TNodeID goalNodeId = INVALID_NODEID;
 
     /** The generated motion tree that explores free space starting at "start"
      */
     MotionPrimitivesTreeSE2 motionTree;
+
+    /** Results for each of originalInput.extraGoals, in the same order */
+    std::vector<PlannerGoalResult> extraGoals;
+
+    /** Fills in extraGoals by looking for the cheapest reachable node in
+     * motionTree (other than goalNodeId) within the tolerances of each one.
+     */
+    void update_extra_goal_results();
 };
 
 }  // namespace selfdriving
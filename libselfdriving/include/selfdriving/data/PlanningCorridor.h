@@ -0,0 +1,54 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <mrpt/containers/CDynamicGrid.h>
+#include <mrpt/math/TPoint2D.h>
+#include <mrpt/random/RandomGenerators.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace selfdriving
+{
+/** The set of grid cells within a given distance of a coarse path, used to
+ * focus the sampling of fine planners (e.g. TPS_RRTstar) on the relevant
+ * part of large maps.
+ *
+ * \sa CostToGoField::path_from()
+ */
+class PlanningCorridor
+{
+   public:
+    PlanningCorridor() = default;
+
+    /** Builds the corridor around `path`, with cells of size `resolution` and
+     * a half-width of `width` [m]. */
+    static PlanningCorridor FromPath(
+        const std::vector<mrpt::math::TPoint2D>& path, const double width,
+        const double resolution);
+
+    bool empty() const { return cells_.empty(); }
+
+    bool contains(const mrpt::math::TPoint2D& p) const
+    {
+        const uint8_t* c = mask_.cellByPos(p.x, p.y);
+        return c && *c;
+    }
+
+    /** Draws a point uniformly distributed over the corridor area */
+    mrpt::math::TPoint2D draw_uniform(
+        mrpt::random::CRandomGenerator& rng) const;
+
+   private:
+    mrpt::containers::CDynamicGrid<uint8_t> mask_;
+
+    /** Centers of all cells in the corridor */
+    std::vector<mrpt::math::TPoint2D> cells_;
+};
+
+}  // namespace selfdriving
@@ -9,8 +9,10 @@
 #include <mrpt/config/CConfigFileBase.h>
 #include <mrpt/containers/yaml.h>
 #include <mrpt/math/TPolygon2D.h>
+#include <selfdriving/data/PTGReachableRegion.h>
 #include <selfdriving/data/ptg_t.h>
 
+#include <cstdint>
 #include <memory>
 #include <variant>
 #include <vector>
@@ -38,6 +40,19 @@ class TrajectoriesAndRobotShape
     std::vector<std::shared_ptr<ptg_t>> ptgs;  //!< Allowed movement sets
     RobotShape                          robotShape;
 
+    /** Reachable areas of each PTG, in the same order than `ptgs`. Built in
+     * initFromConfigFile() with a cell size given by the config parameter
+     * `PTG_reachable_region_resolution` [m] (Default=0.10, <=0 to disable).
+     * Masks are left disabled for PTGs whose trajectories depend on the
+     * vehicle velocity.
+     */
+    std::vector<PTGReachableRegion> reachableRegions;
+
+    /** A hash of all the parameters of ptgs[i] and robotShape, which
+     * determine the PTG trajectories and collision tables. It also names the
+     * PTG cache files. */
+    uint64_t ptg_signature_hash(const size_t i) const;
+
    private:
     bool initialized_ = false;
 };
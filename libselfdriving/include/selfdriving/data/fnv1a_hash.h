@@ -0,0 +1,41 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace selfdriving
+{
+constexpr uint64_t FNV1A_64_OFFSET = 0xcbf29ce484222325ULL;
+constexpr uint64_t FNV1A_64_PRIME  = 0x100000001b3ULL;
+
+/** FNV-1a hash of a raw memory block: a simple hash, stable across compilers
+ * and runs (unlike std::hash), so it can name cache files and tag contents
+ * saved to disk. Pass the previous result as `h` to hash several blocks in a
+ * row.
+ */
+inline uint64_t fnv1a_64(
+    const void* data, size_t len, uint64_t h = FNV1A_64_OFFSET)
+{
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= bytes[i];
+        h *= FNV1A_64_PRIME;
+    }
+    return h;
+}
+
+/// \overload
+inline uint64_t fnv1a_64(const std::string& str, uint64_t h = FNV1A_64_OFFSET)
+{
+    return fnv1a_64(str.data(), str.size(), h);
+}
+
+}  // namespace selfdriving
@@ -12,6 +12,9 @@
 #include <mrpt/obs/CObservation.h>
 #include <mrpt/system/datetime.h>
 
+#include <atomic>
+#include <cstdint>
+
 namespace selfdriving
 {
 class ObstacleSource
@@ -29,9 +32,21 @@ class ObstacleSource
     virtual mrpt::maps::CPointsMap::Ptr obstacles(
         mrpt::system::TTimeStamp t = mrpt::system::TTimeStamp()) = 0;
 
+    /** True if obstacles change with time, e.g. those from live sensors.
+     * Static sources can be used to build long-lived data, such as the
+     * cost-to-go fields in CostToGoFieldCache. */
     virtual bool dynamic() const { return false; }
+
+    /** A counter that changes whenever obstacles() may return different
+     * points than before (e.g. a map update). */
+    virtual uint64_t version() const { return 0; }
 };
 
+/** A hash of the coordinates of all points in `pts`, stable across runs, to
+ * detect changes in obstacle contents not reflected by
+ * ObstacleSource::version(). */
+uint64_t obstacle_points_hash(const mrpt::maps::CPointsMap& pts);
+
 /** A simple obstacle source from a fixed (static world) point cloud. */
 class ObstacleSourceStaticPointcloud : public ObstacleSource
 {
@@ -69,8 +84,13 @@ class ObstacleSourceGenericSensor : public ObstacleSource
         auto lck         = mrpt::lockHelper(obsMtx_);
         obs_             = o;
         robotPoseForObs_ = robotPose;
+        version_++;
     }
 
+    bool dynamic() const override { return true; }
+
+    uint64_t version() const override { return version_; }
+
     mrpt::maps::CPointsMap::Ptr obstacles(
         [[maybe_unused]] mrpt::system::TTimeStamp t =
             mrpt::system::TTimeStamp()) override
@@ -88,6 +108,7 @@ class ObstacleSourceGenericSensor : public ObstacleSource
     std::mutex                   obsMtx_;
     mrpt::obs::CObservation::Ptr obs_;
     mrpt::poses::CPose3D         robotPoseForObs_;
+    std::atomic<uint64_t>        version_{0};
 };
 
 }  // namespace selfdriving
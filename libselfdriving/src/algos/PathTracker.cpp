@@ -0,0 +1,410 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#include <mrpt/core/format.h>
+#include <mrpt/core/lock_helper.h>
+#include <mrpt/math/wrap2pi.h>
+#include <mrpt/system/CRateTimer.h>
+#include <mrpt/system/datetime.h>
+#include <mrpt/system/thread_name.h>
+#include <selfdriving/algos/PathTracker.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace selfdriving;
+
+PathTracker::~PathTracker() { stop(); }
+
+void PathTracker::start(
+    const VehicleMotionInterface::Ptr& vehicle,
+    const TrajectoriesAndRobotShape&   ptgs)
+{
+    MRPT_START
+
+    ASSERT_(vehicle);
+    ASSERT_(ptgs.initialized());
+    ASSERT_GT_(params_.rate, .0);
+
+    stop();
+
+    vehicle_ = vehicle;
+
+    // Own copies of the PTGs, since their dynamic state is modified:
+    ptgs_.clear();
+    for (const auto& ptg : ptgs.ptgs)
+    {
+        ptgs_.push_back(
+            std::dynamic_pointer_cast<ptg_t>(ptg->duplicateGetSmartPtr()));
+        ASSERT_(ptgs_.back());
+    }
+
+    stopRequested_ = false;
+    thread_        = std::thread(&PathTracker::thread_loop, this);
+    mrpt::system::thread_name("path_tracker", thread_);
+
+    MRPT_END
+}
+
+void PathTracker::stop()
+{
+    if (!thread_.joinable()) return;
+
+    stopRequested_ = true;
+    thread_.join();
+
+    clear_path();
+}
+
+void PathTracker::set_path(
+    const std::vector<MoveEdgeSE2_TPS>& edges,
+    const mrpt::math::TPose2D&          odomPose)
+{
+    // Path poses to odom frame, with the path start at the vehicle:
+    const auto pathToOdom =
+        edges.empty()
+            ? odomPose
+            : odomPose + (mrpt::math::TPose2D(0, 0, 0) -
+                          edges.front().stateFrom.pose);
+
+    auto path = compile_path(edges, pathToOdom);
+
+    auto lck     = mrpt::lockHelper(mtx_);
+    pathEndPose_ = path.endPose;
+    newPath_     = std::move(path);
+    status_      = PathTrackerStatus::TRACKING;
+    pathGeneration_++;
+}
+
+bool PathTracker::append_path(const std::vector<MoveEdgeSE2_TPS>& edges)
+{
+    MRPT_START
+
+    if (edges.empty()) return true;
+
+    mrpt::math::TPose2D anchor;
+    uint64_t            generation;
+    {
+        auto lck = mrpt::lockHelper(mtx_);
+        if (status_ == PathTrackerStatus::IDLE ||
+            status_ == PathTrackerStatus::LOST)
+            return false;
+
+        anchor     = pathEndPose_;
+        generation = pathGeneration_;
+    }
+
+    // The appended path starts at the end of the former one:
+    const auto pathToOdom =
+        anchor + (mrpt::math::TPose2D(0, 0, 0) - edges.front().stateFrom.pose);
+
+    auto path = compile_path(edges, pathToOdom);
+
+    auto lck = mrpt::lockHelper(mtx_);
+    if (generation != pathGeneration_ ||
+        status_ == PathTrackerStatus::IDLE ||
+        status_ == PathTrackerStatus::LOST)
+        return false;  // The former path was replaced or dropped meanwhile
+
+    pathEndPose_ = path.endPose;
+
+    if (newPath_ && !newPath_->queue.empty())
+    {
+        // The former path did not start yet:
+        newPath_->queue.back().cmd.nextCmd = path.firstCmd;
+        for (auto& q : path.queue) newPath_->queue.push_back(std::move(q));
+        newPath_->numEdges += path.numEdges;
+    }
+    else if (newPath_ || queue_.empty())
+    {
+        // The former path is empty or already finished, at the anchor pose:
+        newPath_ = std::move(path);
+    }
+    else
+    {
+        // Replace the final stop of the path under execution:
+        queue_.back().cmd.nextCmd = path.firstCmd;
+        const bool stopIsNext     = (queue_.size() == 1);
+        for (auto& q : path.queue) queue_.push_back(std::move(q));
+        numEdges_ += path.numEdges;
+
+        // The final stop may already be in the vehicle "next" slot:
+        if (stopIsNext &&
+            !vehicle_->motion_execute(std::nullopt, queue_.front().cmd))
+            MRPT_LOG_WARN("motion_execute() failed appending a path");
+    }
+    status_ = PathTrackerStatus::TRACKING;
+
+    return true;
+    MRPT_END
+}
+
+void PathTracker::clear_path()
+{
+    auto lck = mrpt::lockHelper(mtx_);
+
+    newPath_.reset();
+    queue_.clear();
+    numEdges_ = 0;
+    status_   = PathTrackerStatus::IDLE;
+    pathGeneration_++;
+}
+
+PathTrackerStatus PathTracker::status() const
+{
+    auto lck = mrpt::lockHelper(mtx_);
+    return status_;
+}
+
+std::optional<size_t> PathTracker::current_edge() const
+{
+    auto lck = mrpt::lockHelper(mtx_);
+    if (queue_.empty()) return {};
+    return numEdges_ - queue_.size();
+}
+
+void PathTracker::thread_loop()
+{
+    mrpt::system::CRateTimer rate(params_.rate);
+
+    while (!stopRequested_)
+    {
+        try
+        {
+            mrpt::system::CTimeLoggerEntry tle(profiler_, "tick");
+            tick();
+        }
+        catch (const std::exception& e)
+        {
+            auto lck = mrpt::lockHelper(mtx_);
+            lose_tracking(std::string("Exception: ") + e.what());
+        }
+        rate.sleep();
+    }
+}
+
+void PathTracker::tick()
+{
+    auto lck = mrpt::lockHelper(mtx_);
+
+    if (newPath_)
+    {
+        queue_              = std::move(newPath_->queue);
+        numEdges_           = newPath_->numEdges;
+        const auto firstCmd = newPath_->firstCmd;
+        newPath_.reset();
+
+        prevOdometry_.reset();
+
+        if (queue_.empty())
+        {
+            status_ = PathTrackerStatus::FINISHED;
+            return;
+        }
+
+        // Replace whatever the vehicle was doing:
+        if (!vehicle_->motion_execute(firstCmd, queue_.front().cmd))
+            MRPT_LOG_WARN("motion_execute() failed for a new path");
+        start_edge();
+        return;
+    }
+
+    if (queue_.empty()) return;
+
+    const auto odo = vehicle_->get_odometry();
+    ASSERTMSG_(odo.valid, "Invalid odometry from the vehicle interface");
+
+    const auto& front = queue_.front();
+
+    const bool triggered =
+        condition_holds(front.cmd.nextCondition, odo.odometry) ||
+        (prevOdometry_ && condition_swept(
+                              front.cmd.nextCondition, *prevOdometry_,
+                              odo.odometry));
+    prevOdometry_ = odo.odometry;
+
+    if (triggered)
+    {
+        // The vehicle switched to the next motion by itself:
+        queue_.pop_front();
+
+        if (queue_.empty())
+        {
+            // It was the final stop:
+            MRPT_LOG_DEBUG("Path execution finished.");
+            numEdges_ = 0;
+            status_   = PathTrackerStatus::FINISHED;
+            return;
+        }
+
+        // Keep the "next" slot full:
+        if (!vehicle_->motion_execute(std::nullopt, queue_.front().cmd))
+            MRPT_LOG_WARN("motion_execute() failed enqueuing a command");
+        start_edge();
+        return;
+    }
+
+    // Did the vehicle miss the trigger?
+    const auto&  trigger = front.cmd.nextCondition.position;
+    const double dist    = mrpt::hypot_fast(
+        odo.odometry.x - trigger.x, odo.odometry.y - trigger.y);
+
+    if (minTriggerDistance_ < params_.missedTriggerRadius &&
+        dist > params_.missedTriggerRadius)
+    {
+        lose_tracking(mrpt::format(
+            "Vehicle went past the end of edge #%u",
+            static_cast<unsigned int>(numEdges_ - queue_.size())));
+        return;
+    }
+    mrpt::keep_min(minTriggerDistance_, dist);
+
+    const double edgeTime =
+        mrpt::system::timeDifference(edgeStartTime_, mrpt::Clock::now());
+    if (edgeTime > front.edgeDuration * params_.edgeTimeoutFactor +
+                       params_.edgeTimeoutMargin)
+    {
+        lose_tracking(mrpt::format(
+            "Edge #%u took %.02f s, expected %.02f s",
+            static_cast<unsigned int>(numEdges_ - queue_.size()), edgeTime,
+            front.edgeDuration));
+        return;
+    }
+
+    // NOP, to let the vehicle know the path is still being supervised:
+    vehicle_->motion_execute(std::nullopt, std::nullopt);
+}
+
+void PathTracker::start_edge()
+{
+    edgeStartTime_      = mrpt::Clock::now();
+    minTriggerDistance_ = std::numeric_limits<double>::max();
+}
+
+void PathTracker::lose_tracking(const std::string& reason)
+{
+    MRPT_LOG_ERROR_STREAM("Path tracking lost: " << reason);
+
+    const bool wasMoving = !queue_.empty();
+
+    newPath_.reset();
+    queue_.clear();
+    numEdges_ = 0;
+    status_   = PathTrackerStatus::LOST;
+    pathGeneration_++;
+
+    // Stop, and no more NOPs, so the vehicle watchdog also fires if this
+    // stop command is not honored:
+    if (wasMoving) vehicle_->stop(STOP_TYPE::REGULAR);
+}
+
+PathTracker::CompiledPath PathTracker::compile_path(
+    const std::vector<MoveEdgeSE2_TPS>& edges,
+    const mrpt::math::TPose2D&          pathToOdom)
+{
+    MRPT_START
+
+    CompiledPath cp;
+    cp.numEdges = edges.size();
+    cp.endPose  = pathToOdom;
+    if (edges.empty()) return cp;
+
+    auto lck = mrpt::lockHelper(compileMtx_);
+
+    for (size_t i = 0; i < edges.size(); i++)
+    {
+        const auto& edge = edges[i];
+        ASSERT_(edge.ptgIndex >= 0);
+
+        auto& ptg = *ptgs_.at(edge.ptgIndex);
+        ptg.updateNavDynamicState(edge.getPTGDynState());
+
+        auto cmd = ptg.directionToMotionCommand(edge.ptgPathIndex);
+        ASSERT_(cmd);
+        cmd->cmdVel_scale(edge.ptgSpeedScale);
+
+        if (i == 0)
+            cp.firstCmd = cmd;
+        else
+            cp.queue.back().cmd.nextCmd = cmd;
+
+        // The following command is triggered at the end pose of this PTG
+        // trajectory:
+        uint32_t step = 0;
+        ASSERT_(
+            ptg.getPathStepForDist(edge.ptgPathIndex, edge.ptgDist, step));
+        const auto endPose =
+            edge.stateFrom.pose + ptg.getPathPose(edge.ptgPathIndex, step);
+
+        QueuedCmd next;
+        next.cmd.nextCondition.position  = pathToOdom + endPose;
+        next.cmd.nextCondition.tolerance = params_.nextCmdTolerance;
+
+        next.edgeDuration = step * ptg.getPathStepDuration() /
+                            std::max(edge.ptgSpeedScale, 1e-3);
+        cp.queue.push_back(next);
+    }
+
+    // Stop at the end of the last edge:
+    auto stopCmd = ptgs_.at(edges.back().ptgIndex)
+                       ->getSupportedKinematicVelocityCommand();
+    stopCmd->setToStop();
+    cp.queue.back().cmd.nextCmd = stopCmd;
+    cp.endPose                  = cp.queue.back().cmd.nextCondition.position;
+
+    return cp;
+    MRPT_END
+}
+
+bool PathTracker::condition_holds(
+    const EnqueuedCondition& c, const mrpt::math::TPose2D& odom) const
+{
+    const auto& pos = c.position;
+    const auto& tol = c.tolerance;
+
+    return std::abs(odom.x - pos.x) <= 0.5 * tol.x &&
+           std::abs(odom.y - pos.y) <= 0.5 * tol.y &&
+           std::abs(mrpt::math::angDistance(odom.phi, pos.phi)) <=
+               0.5 * tol.phi;
+}
+
+bool PathTracker::condition_swept(
+    const EnqueuedCondition& c, const mrpt::math::TPose2D& from,
+    const mrpt::math::TPose2D& to) const
+{
+    const auto& pos = c.position;
+    const auto& tol = c.tolerance;
+
+    // Clip the segment from(t=0) -> to(t=1) against the (x,y) box:
+    double       t0 = 0, t1 = 1;
+    const double p0[2] = {from.x - pos.x, from.y - pos.y};
+    const double d[2]  = {to.x - from.x, to.y - from.y};
+    const double h[2]  = {0.5 * tol.x, 0.5 * tol.y};
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (d[i] == 0)
+        {
+            if (std::abs(p0[i]) > h[i]) return false;
+            continue;
+        }
+        double ta = (-h[i] - p0[i]) / d[i], tb = (h[i] - p0[i]) / d[i];
+        if (ta > tb) std::swap(ta, tb);
+        t0 = std::max(t0, ta);
+        t1 = std::min(t1, tb);
+        if (t0 > t1) return false;
+    }
+
+    // The heading error is linear in t within the clipped interval:
+    const double dPhi = mrpt::math::angDistance(from.phi, to.phi);
+    const double e0 =
+        mrpt::math::angDistance(pos.phi, from.phi + t0 * dPhi);
+    const double e1 = e0 + (t1 - t0) * dPhi;
+
+    return (e0 <= 0 && e1 >= 0) || (e0 >= 0 && e1 <= 0) ||
+           std::min(std::abs(e0), std::abs(e1)) <= 0.5 * tol.phi;
+}
@@ -0,0 +1,293 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#include <mrpt/maps/CSimplePointsMap.h>
+#include <selfdriving/algos/Planner.h>
+
+#include <limits>
+#include <random>
+
+using namespace selfdriving;
+
+IMPLEMENTS_VIRTUAL_MRPT_OBJECT(Planner, mrpt::rtti::CObject, selfdriving)
+
+Planner::Planner(const std::string& name) : profiler_(true, name)
+{
+    setLoggerName(name);
+}
+
+Planner::~Planner() = default;
+
+void Planner::transform_pc_square_clipping(
+    const mrpt::maps::CPointsMap& inMap, const mrpt::poses::CPose2D& asSeenFrom,
+    const double MAX_DIST_XY, mrpt::maps::CPointsMap& outMap,
+    bool appendToOutMap)
+{
+    size_t       nObs;
+    const float *obs_xs, *obs_ys, *obs_zs;
+    inMap.getPointsBuffer(nObs, obs_xs, obs_ys, obs_zs);
+
+    if (!appendToOutMap) outMap.clear();
+    // Prealloc mem for speed-up
+    outMap.reserve(nObs);
+
+    const mrpt::poses::CPose2D invPose = -asSeenFrom;
+    // We can safely discard the rest of obstacles, since they cannot be
+    // converted into TP-Obstacles anyway!
+
+    for (size_t obs = 0; obs < nObs; obs++)
+    {
+        const double gx = obs_xs[obs], gy = obs_ys[obs];
+
+        if (std::abs(gx - asSeenFrom.x()) > MAX_DIST_XY ||
+            std::abs(gy - asSeenFrom.y()) > MAX_DIST_XY)
+        {
+            // ignore this obstacle: anyway, I don't know how to map it to
+            // TP-Obs!
+            continue;
+        }
+
+        double ox, oy;
+        invPose.composePoint(gx, gy, ox, oy);
+
+        outMap.insertPointFast(ox, oy, 0);
+    }
+}
+
+distance_t Planner::tp_obstacles_single_path(
+    const trajectory_index_t      tp_space_k_direction,
+    const mrpt::maps::CPointsMap& localObstacles, const ptg_t& ptg)
+{
+    MRPT_START
+    // Take "k_rand"s and "distances" such that the collision hits the
+    // obstacles
+    // in the "grid" of the given PT
+    // --------------------------------------------------------------------
+    size_t       nObs;
+    const float *obs_xs, *obs_ys, *obs_zs;
+    localObstacles.getPointsBuffer(nObs, obs_xs, obs_ys, obs_zs);
+
+    // Init obs ranges:
+    normalized_distance_t out_TPObstacle_k = 0;
+    ptg.initTPObstacleSingle(tp_space_k_direction, out_TPObstacle_k);
+
+    for (size_t obs = 0; obs < nObs; obs++)
+    {
+        const float ox = obs_xs[obs];
+        const float oy = obs_ys[obs];
+
+        ptg.updateTPObstacleSingle(
+            ox, oy, tp_space_k_direction, out_TPObstacle_k);
+    }
+
+    // Leave distances in out_TPObstacles un-normalized, so they
+    // just represent real distances in "pseudo-meters".
+    return out_TPObstacle_k;
+
+    MRPT_END
+}
+
+bool Planner::path_is_collision_free(
+    const MotionPrimitivesTreeSE2& tree, const TNodeID goalNodeId,
+    const TrajectoriesAndRobotShape& ptgs,
+    const mrpt::maps::CPointsMap&    obstacles)
+{
+    MRPT_START
+
+    mrpt::maps::CSimplePointsMap localObs;
+
+    for (const auto& node : tree.backtrack_path(goalNodeId))
+    {
+        if (!node.parentID_) continue;  // the root
+        if (node.cost_ == std::numeric_limits<cost_t>::max()) return false;
+
+        const auto& edge = tree.edge_to_parent(node.nodeID_);
+        auto&       ptg  = *ptgs.ptgs.at(edge.ptgIndex);
+        ptg.updateNavDynamicState(edge.getPTGDynState());
+
+        transform_pc_square_clipping(
+            obstacles, mrpt::poses::CPose2D(edge.stateFrom.pose),
+            edge.ptgDist + ptg.getMaxRobotRadius(), localObs,
+            false /*don't append*/);
+
+        if (tp_obstacles_single_path(edge.ptgPathIndex, localObs, ptg) <=
+            edge.ptgDist)
+            return false;
+    }
+    return true;
+
+    MRPT_END
+}
+
+mrpt::maps::CPointsMap::Ptr Planner::cached_local_obstacles(
+    const MotionPrimitivesTreeSE2& tree, const TNodeID nodeID,
+    const std::vector<mrpt::maps::CPointsMap::Ptr>& globalObstacles,
+    double                                          MAX_XY_DIST)
+{
+    // reuse?
+    const auto& node = tree.nodes().at(nodeID);
+
+    auto itOc = local_obstacles_cache_.find(nodeID);
+    if (itOc != local_obstacles_cache_.end() &&
+        itOc->second.globalNodePose == node.pose)
+    {  // cache hit
+        return itOc->second.obs;
+    }
+
+    // create/update
+    auto& loc = local_obstacles_cache_[nodeID];
+
+    loc.globalNodePose = node.pose;
+    if (!loc.obs)
+        loc.obs = mrpt::maps::CSimplePointsMap::Create();
+    else
+        loc.obs->clear();
+
+    for (const auto& obs : globalObstacles)
+    {
+        ASSERT_(obs);
+        transform_pc_square_clipping(
+            *obs, mrpt::poses::CPose2D(node.pose), MAX_XY_DIST, *loc.obs);
+    }
+
+    return loc.obs;
+}
+
+cost_t Planner::cost_path_segment(const MoveEdgeSE2_TPS& edge) const
+{
+    // Base cost: distance
+    cost_t c = edge.ptgDist;
+
+    // Additional optional cost evaluators:
+    for (const auto& ce : costEvaluators_)
+    {
+        ASSERT_(ce);
+        c += (*ce)(edge);
+    }
+
+    return c;
+}
+
+void Planner::interpolate_edge(
+    MoveEdgeSE2_TPS& edge, const ptg_t& ptg, const uint32_t ptgStep,
+    const size_t nSeg)
+{
+    if (!nSeg) return;
+
+    auto& ip = edge.interpolatedPath.emplace();
+    ip.emplace_back(0, 0, 0);  // fixed
+    for (size_t i = 0; i < nSeg; i++)
+    {
+        const auto iStep = ((i + 1) * ptgStep) / (nSeg + 2);
+        ip.emplace_back(ptg.getPathPose(edge.ptgPathIndex, iStep));
+    }
+    ip.emplace_back(ptg.getPathPose(edge.ptgPathIndex, ptgStep));
+}
+
+std::optional<MoveEdgeSE2_TPS> Planner::best_edge_towards(
+    const SE2_KinState& from, const mrpt::math::TPose2D& target,
+    const bool ignoreTargetHeading, const double headingTolerance,
+    const distance_t maxDistance, const TrajectoriesAndRobotShape& trs,
+    const mrpt::maps::CPointsMap& localObstacles, const size_t nSeg)
+{
+    std::optional<MoveEdgeSE2_TPS> bestEdge;
+
+    for (ptg_index_t ptgIdx = 0; ptgIdx < trs.ptgs.size(); ptgIdx++)
+    {
+        auto& ptg = *trs.ptgs.at(ptgIdx);
+
+        const PoseDistanceMetric_TPS<SE2_KinState> de(
+            ptg, headingTolerance, &ptgDynStateCache_,
+            ptgIdx < trs.reachableRegions.size()
+                ? &trs.reachableRegions.at(ptgIdx)
+                : nullptr);
+
+        if (de.cannotBeNearerThan(from, target, maxDistance)) continue;
+
+        // This also sets the PTG dynamic state for `from`:
+        const auto ret = de.distance(from, target, ignoreTargetHeading);
+        if (!ret) continue;
+
+        const auto [trajDist, trajIdx] = *ret;
+        if (trajDist <= 0 || trajDist > maxDistance) continue;
+
+        if (trajDist >= tp_obstacles_single_path(trajIdx, localObstacles, ptg))
+            continue;
+
+        uint32_t ptg_step;
+        if (!ptg.getPathStepForDist(trajIdx, trajDist, ptg_step)) continue;
+
+        MoveEdgeSE2_TPS edge;
+        edge.ptgDist        = trajDist;
+        edge.ptgIndex       = ptgIdx;
+        edge.ptgPathIndex   = trajIdx;
+        edge.targetRelSpeed = 1.0;
+        edge.stateFrom      = from;
+        edge.stateTo.pose   = from.pose + ptg.getPathPose(trajIdx, ptg_step);
+        // The PTG twist is relative to the `from` frame:
+        (edge.stateTo.vel = ptg.getPathTwist(trajIdx, ptg_step))
+            .rotate(from.pose.phi);
+        interpolate_edge(edge, ptg, ptg_step, nSeg);
+        edge.cost = cost_path_segment(edge);
+
+        if (!bestEdge || edge.cost < bestEdge->cost) bestEdge = edge;
+    }
+    return bestEdge;
+}
+
+std::shared_ptr<const CostToGoField> Planner::cost_to_go_field(
+    const PlannerInput& in, const double resolution,
+    const bool inflateObstacles)
+{
+    mrpt::system::CTimeLoggerEntry tle(profiler_, "cost_to_go_field");
+
+    CostToGoField::Parameters p;
+    p.resolution = resolution;
+    if (inflateObstacles &&
+        std::holds_alternative<robot_radius_t>(in.ptgs.robotShape))
+        p.obstacleInflation = std::get<robot_radius_t>(in.ptgs.robotShape);
+
+    const mrpt::math::TPoint2D goal(in.stateGoal.pose.x, in.stateGoal.pose.y);
+    const mrpt::math::TPoint2D bboxMin(in.worldBboxMin.x, in.worldBboxMin.y);
+    const mrpt::math::TPoint2D bboxMax(in.worldBboxMax.x, in.worldBboxMax.y);
+
+    if (costToGoCache_)
+        return costToGoCache_->get(goal, bboxMin, bboxMax, in.obstacles, p);
+
+    std::vector<mrpt::maps::CPointsMap::Ptr> staticObstacles;
+    for (const auto& os : in.obstacles)
+        if (os && !os->dynamic()) staticObstacles.emplace_back(os->obstacles());
+
+    return std::make_shared<const CostToGoField>(
+        CostToGoField::Compute(goal, bboxMin, bboxMax, staticObstacles, p));
+}
+
+void selfdriving::random_seed_to_yaml(
+    mrpt::containers::yaml& c, const std::optional<uint32_t>& randomSeed)
+{
+    c["randomSeed"] = randomSeed ? static_cast<int64_t>(*randomSeed) : -1;
+}
+
+void selfdriving::random_seed_from_yaml(
+    const mrpt::containers::yaml& c, std::optional<uint32_t>& randomSeed)
+{
+    if (!c.has("randomSeed")) return;
+
+    const auto seed = c["randomSeed"].as<int64_t>();
+    ASSERT_LE_(seed, std::numeric_limits<uint32_t>::max());
+
+    if (seed >= 0)
+        randomSeed = static_cast<uint32_t>(seed);
+    else
+        randomSeed.reset();
+}
+
+uint32_t selfdriving::actual_random_seed(
+    const std::optional<uint32_t>& randomSeed)
+{
+    if (randomSeed) return *randomSeed;
+    return static_cast<uint32_t>(std::random_device()());
+}
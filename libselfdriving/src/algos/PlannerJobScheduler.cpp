@@ -0,0 +1,160 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#include <mrpt/core/exceptions.h>
+#include <mrpt/core/lock_helper.h>
+#include <mrpt/system/datetime.h>
+#include <mrpt/system/thread_name.h>
+#include <selfdriving/algos/PlannerJobScheduler.h>
+
+#include <algorithm>
+
+using namespace selfdriving;
+
+PlannerJobScheduler::PlannerJobScheduler(
+    size_t numWorkers, const std::string& threadsName)
+{
+    MRPT_START
+
+    ASSERT_GT_(numWorkers, 0U);
+
+    workersState_.resize(numWorkers);
+    for (size_t i = 0; i < numWorkers; i++)
+    {
+        workers_.emplace_back([this, i]() { worker_loop(i); });
+        mrpt::system::thread_name(
+            threadsName + std::to_string(i), workers_.back());
+    }
+
+    MRPT_END
+}
+
+PlannerJobScheduler::~PlannerJobScheduler()
+{
+    {
+        auto lck  = mrpt::lockHelper(mtx_);
+        shutdown_ = true;
+        for (auto& q : queues_)
+            for (auto& job : q) job.token.cancel();
+        for (auto& w : workersState_) w.token.cancel();
+    }
+    cv_.notify_all();
+
+    for (auto& t : workers_)
+        if (t.joinable()) t.join();
+}
+
+void PlannerJobScheduler::push_job(
+    const PlannerJobClass jobClass, const CancellationToken& token,
+    std::function<void()>&& run)
+{
+    const auto classIdx = static_cast<size_t>(jobClass);
+    ASSERT_LT_(classIdx, NUM_CLASSES);
+
+    {
+        auto lck = mrpt::lockHelper(mtx_);
+
+        Job job;
+        job.jobClass = jobClass;
+        job.token    = token;
+        job.run      = std::move(run);
+        job.enqueued = mrpt::Clock::now();
+        queues_[classIdx].push_back(std::move(job));
+
+        // Jobs that will run before or together with this one:
+        size_t pending = 0;
+        for (size_t c = 0; c <= classIdx; c++) pending += queues_[c].size();
+
+        const size_t idle = std::count_if(
+            workersState_.begin(), workersState_.end(),
+            [](const WorkerState& w) { return !w.jobClass.has_value(); });
+
+        // Preemption: cancel the running job with the lowest priority below
+        // this one, if there is no worker for it:
+        if (pending > idle)
+        {
+            WorkerState* victim = nullptr;
+            for (auto& w : workersState_)
+            {
+                if (!w.jobClass || *w.jobClass <= jobClass) continue;
+                if (w.token.cancelled()) continue;  // Already preempted
+                if (!victim || *w.jobClass > *victim->jobClass) victim = &w;
+            }
+            if (victim)
+            {
+                victim->token.cancel();
+                stats_[static_cast<size_t>(*victim->jobClass)].preempted++;
+            }
+        }
+    }
+    cv_.notify_one();
+}
+
+void PlannerJobScheduler::worker_loop(size_t workerIdx)
+{
+    for (;;)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lck(mtx_);
+            cv_.wait(lck, [this]() {
+                return shutdown_ ||
+                       std::any_of(
+                           queues_.begin(), queues_.end(),
+                           [](const auto& q) { return !q.empty(); });
+            });
+            if (shutdown_) return;
+
+            // Highest priority first, then FIFO:
+            for (auto& q : queues_)
+            {
+                if (q.empty()) continue;
+                job = std::move(q.front());
+                q.pop_front();
+                break;
+            }
+
+            auto& st = stats_[static_cast<size_t>(job.jobClass)];
+            const double queueTime =
+                mrpt::system::timeDifference(job.enqueued, mrpt::Clock::now());
+            st.started++;
+            st.sumQueueTime += queueTime;
+            st.maxQueueTime = std::max(st.maxQueueTime, queueTime);
+
+            workersState_[workerIdx].jobClass = job.jobClass;
+            workersState_[workerIdx].token    = job.token;
+        }
+
+        const auto tStart = mrpt::Clock::now();
+        job.run();  // Exceptions are stored in the job future
+        const double runTime =
+            mrpt::system::timeDifference(tStart, mrpt::Clock::now());
+
+        auto  lck = mrpt::lockHelper(mtx_);
+        auto& st  = stats_[static_cast<size_t>(job.jobClass)];
+        st.jobs++;
+        st.sumRunTime += runTime;
+
+        workersState_[workerIdx] = WorkerState();
+    }
+}
+
+PlannerJobScheduler::ClassStats PlannerJobScheduler::stats(
+    const PlannerJobClass jobClass) const
+{
+    auto lck = mrpt::lockHelper(mtx_);
+
+    const auto& st = stats_.at(static_cast<size_t>(jobClass));
+
+    ClassStats ret;
+    ret.started      = st.started;
+    ret.jobs         = st.jobs;
+    ret.preempted    = st.preempted;
+    ret.maxQueueTime = st.maxQueueTime;
+    if (st.started > 0) ret.meanQueueTime = st.sumQueueTime / st.started;
+    if (st.jobs > 0) ret.meanRunTime = st.sumRunTime / st.jobs;
+    return ret;
+}
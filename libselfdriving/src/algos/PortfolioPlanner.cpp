@@ -0,0 +1,234 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#include <mrpt/system/datetime.h>
+#include <selfdriving/algos/PortfolioPlanner.h>
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <thread>
+
+using namespace selfdriving;
+
+mrpt::containers::yaml PortfolioPlanner_Parameters::as_yaml()
+{
+    mrpt::containers::yaml c = mrpt::containers::yaml::Map();
+
+    MCP_SAVE(c, numInstances);
+    MCP_SAVE(c, maxPlanningTime);
+    MCP_SAVE(c, returnFirstSolution);
+
+    return c;
+}
+
+void PortfolioPlanner_Parameters::load_from_yaml(
+    const mrpt::containers::yaml& c)
+{
+    ASSERT_(c.isMap());
+
+    MCP_LOAD_OPT(c, numInstances);
+    MCP_LOAD_OPT(c, maxPlanningTime);
+    MCP_LOAD_OPT(c, returnFirstSolution);
+}
+
+PortfolioPlanner_Parameters PortfolioPlanner_Parameters::FromYAML(
+    const mrpt::containers::yaml& c)
+{
+    PortfolioPlanner_Parameters p;
+    p.load_from_yaml(c);
+    return p;
+}
+
+PortfolioPlanner::PortfolioPlanner()
+    : mrpt::system::COutputLogger("PortfolioPlanner")
+{
+}
+
+std::vector<TPS_RRTstar_Parameters> PortfolioPlanner::build_instances_params(
+    const size_t numInstances) const
+{
+    std::vector<TPS_RRTstar_Parameters> ps = instancesParams_;
+    if (ps.size() > numInstances) ps.resize(numInstances);
+
+    const TPS_RRTstar_Parameters base =
+        !ps.empty() ? ps.front() : TPS_RRTstar_Parameters();
+
+    for (size_t i = ps.size(); i < numInstances; i++)
+    {
+        auto& p = ps.emplace_back(base);
+
+        // Diversify: alternate sampling spaces, with increasing goal bias:
+        if (i % 2 == 1) p.drawInTPS = !base.drawInTPS;
+        p.drawBiasTowardsGoal =
+            std::min(0.5, base.drawBiasTowardsGoal * (1 + (i / 2)));
+
+        // (unsigned wrap-around is fine for seeds)
+        if (base.randomSeed)
+            p.randomSeed = *base.randomSeed + static_cast<uint32_t>(i);
+    }
+
+    // No need to keep refining a path that would be discarded anyway:
+    if (params_.returnFirstSolution)
+        for (auto& p : ps) p.stopAtFirstSolution = true;
+
+    return ps;
+}
+
+PlannerOutput PortfolioPlanner::plan(const PlannerInput& in)
+{
+    MRPT_START
+    using namespace std::chrono_literals;
+
+    mrpt::system::CTimeLoggerEntry tleg(profiler_, "plan");
+
+    const auto tStart = mrpt::Clock::now();
+
+    ASSERT_(in.ptgs.initialized());
+
+    size_t nInstances = params_.numInstances;
+    if (nInstances == 0)
+        nInstances = std::max(1U, std::thread::hardware_concurrency());
+
+    if (!pool_ || poolSize_ != nInstances)
+    {
+        poolSize_ = nInstances;
+        pool_     = std::make_unique<mrpt::WorkerThreadsPool>(
+            nInstances, mrpt::WorkerThreadsPool::POLICY_FIFO,
+            "portfolio_planner");
+    }
+
+    // Prepare instances:
+    const auto instParams = build_instances_params(nInstances);
+
+    // Each instance needs its own PTG objects, expensive to copy:
+    if (ptgsCopiesSource_ != in.ptgs.ptgs) ptgsCopies_.clear();
+    ptgsCopiesSource_ = in.ptgs.ptgs;
+
+    while (ptgsCopies_.size() < nInstances)
+    {
+        auto& copies = ptgsCopies_.emplace_back();
+        for (const auto& ptg : in.ptgs.ptgs)
+        {
+            copies.push_back(
+                std::dynamic_pointer_cast<ptg_t>(ptg->duplicateGetSmartPtr()));
+            ASSERT_(copies.back());
+        }
+    }
+
+    // Fresh token for this run, so cancelling the instances does not affect
+    // our public cancellationToken_:
+    CancellationToken instancesToken;
+
+    std::vector<std::unique_ptr<TPS_RRTstar>> planners;
+    std::vector<PlannerInput>                 inputs;
+
+    for (size_t i = 0; i < nInstances; i++)
+    {
+        auto& planner = planners.emplace_back(std::make_unique<TPS_RRTstar>());
+        planner->setLoggerName(mrpt::format(
+            "PortfolioPlanner[%u]", static_cast<unsigned int>(i)));
+        planner->setMinLoggingLevel(getMinLoggingLevel());
+        planner->params_            = instParams.at(i);
+        planner->costEvaluators_    = costEvaluators_;
+        planner->cancellationToken_ = instancesToken;
+
+        auto& pi     = inputs.emplace_back(in);
+        pi.ptgs.ptgs = ptgsCopies_.at(i);
+    }
+
+    // Launch all instances:
+    std::vector<std::future<PlannerOutput>> futures;
+    for (size_t i = 0; i < nInstances; i++)
+    {
+        futures.emplace_back(pool_->enqueue(
+            [&planners, &inputs](size_t idx) {
+                return planners[idx]->plan(inputs[idx]);
+            },
+            i));
+    }
+
+    // Wait for them:
+    std::vector<std::optional<PlannerOutput>> results(nInstances);
+    std::vector<bool>                         done(nInstances, false);
+    std::optional<size_t>                     firstSuccess;
+
+    size_t nPending = nInstances;
+    while (nPending > 0)
+    {
+        for (size_t i = 0; i < nInstances; i++)
+        {
+            if (done[i] ||
+                futures[i].wait_for(5ms) != std::future_status::ready)
+                continue;
+
+            done[i] = true;
+            nPending--;
+            try
+            {
+                results[i] = futures[i].get();
+            }
+            catch (const std::exception& e)
+            {
+                MRPT_LOG_WARN_STREAM(
+                    "Instance #" << i << " failed with exception:\n"
+                                 << mrpt::exception_to_str(e));
+                continue;
+            }
+
+            if (results[i]->success && !firstSuccess)
+            {
+                firstSuccess = i;
+                if (params_.returnFirstSolution) instancesToken.cancel();
+            }
+        }
+
+        if (!instancesToken.cancelled() &&
+            (cancellationToken_.cancelled() ||
+             (params_.maxPlanningTime > 0 &&
+              mrpt::system::timeDifference(tStart, mrpt::Clock::now()) >
+                  params_.maxPlanningTime)))
+        {
+            MRPT_LOG_DEBUG("Deadline reached or cancelled: stopping all.");
+            instancesToken.cancel();
+        }
+    }
+
+    // Pick the result:
+    std::optional<size_t> best;
+    if (params_.returnFirstSolution)
+        best = firstSuccess;
+    else
+    {
+        for (size_t i = 0; i < nInstances; i++)
+        {
+            if (!results[i] || !results[i]->success) continue;
+            if (!best || results[i]->pathCost < results[*best]->pathCost)
+                best = i;
+        }
+    }
+    if (!best)
+    {
+        // No solution at all: return any of the (partial) trees:
+        for (size_t i = 0; i < nInstances && !best; i++)
+            if (results[i]) best = i;
+    }
+    if (!best) THROW_EXCEPTION("All portfolio planner instances failed.");
+
+    PlannerOutput po = std::move(results[*best].value());
+    po.originalInput = in;
+    po.computationTime =
+        mrpt::system::timeDifference(tStart, mrpt::Clock::now());
+
+    MRPT_LOG_DEBUG_FMT(
+        "Picked instance #%u/%u: success=%s pathCost=%f randomSeed=%u",
+        static_cast<unsigned int>(*best),
+        static_cast<unsigned int>(nInstances), po.success ? "YES" : "NO",
+        po.pathCost, static_cast<unsigned int>(po.randomSeed));
+
+    return po;
+    MRPT_END
+}
@@ -0,0 +1,421 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#include <mrpt/maps/CSimplePointsMap.h>
+#include <mrpt/system/datetime.h>
+#include <selfdriving/algos/TPS_Astar.h>
+
+#include <functional>
+#include <queue>
+#include <tuple>
+#include <unordered_map>
+
+using namespace selfdriving;
+
+IMPLEMENTS_MRPT_OBJECT(TPS_Astar, Planner, selfdriving)
+
+mrpt::containers::yaml TPS_Astar_Parameters::as_yaml()
+{
+    mrpt::containers::yaml c = mrpt::containers::yaml::Map();
+
+    MCP_SAVE(c, gridResolutionXY);
+    MCP_SAVE_DEG(c, gridResolutionYaw);
+    MCP_SAVE(c, gridResolutionLinearVel);
+    MCP_SAVE_DEG(c, gridResolutionAngularVel);
+    MCP_SAVE(c, trajectoriesPerPTG);
+    MCP_SAVE(c, minStepLength);
+    MCP_SAVE(c, maxStepLength);
+    MCP_SAVE(c, numStepLengths);
+    MCP_SAVE(c, maxExpandedNodes);
+    MCP_SAVE(c, heuristicGridResolution);
+    MCP_SAVE(c, heuristicWeight);
+    MCP_SAVE(c, ptgDynStateLinearVelQuantization);
+    MCP_SAVE_DEG(c, ptgDynStateAngularVelQuantization);
+    MCP_SAVE(c, pathInterpolatedSegments);
+
+    return c;
+}
+
+void TPS_Astar_Parameters::load_from_yaml(const mrpt::containers::yaml& c)
+{
+    ASSERT_(c.isMap());
+
+    MCP_LOAD_OPT(c, gridResolutionXY);
+    MCP_LOAD_OPT_DEG(c, gridResolutionYaw);
+    MCP_LOAD_OPT(c, gridResolutionLinearVel);
+    MCP_LOAD_OPT_DEG(c, gridResolutionAngularVel);
+    MCP_LOAD_OPT(c, trajectoriesPerPTG);
+    MCP_LOAD_OPT(c, minStepLength);
+    MCP_LOAD_OPT(c, maxStepLength);
+    MCP_LOAD_OPT(c, numStepLengths);
+    MCP_LOAD_OPT(c, maxExpandedNodes);
+    MCP_LOAD_OPT(c, heuristicGridResolution);
+    MCP_LOAD_OPT(c, heuristicWeight);
+    MCP_LOAD_OPT(c, ptgDynStateLinearVelQuantization);
+    MCP_LOAD_OPT_DEG(c, ptgDynStateAngularVelQuantization);
+    MCP_LOAD_OPT(c, pathInterpolatedSegments);
+}
+
+TPS_Astar_Parameters TPS_Astar_Parameters::FromYAML(
+    const mrpt::containers::yaml& c)
+{
+    TPS_Astar_Parameters p;
+    p.load_from_yaml(c);
+    return p;
+}
+
+TPS_Astar::TPS_Astar() : Planner("TPS_Astar") {}
+
+namespace
+{
+/** Discretized state, the key of the closed set */
+struct LatticeCell
+{
+    int32_t x = 0, y = 0;
+    int16_t yaw = 0, linVel = 0, angVel = 0;
+
+    bool operator==(const LatticeCell& o) const
+    {
+        return x == o.x && y == o.y && yaw == o.yaw && linVel == o.linVel &&
+               angVel == o.angVel;
+    }
+};
+
+struct LatticeCellHash
+{
+    size_t operator()(const LatticeCell& c) const
+    {
+        size_t h = std::hash<int32_t>()(c.x);
+        h        = h * 31 + std::hash<int32_t>()(c.y);
+        h        = h * 31 + std::hash<int16_t>()(c.yaw);
+        h        = h * 31 + std::hash<int16_t>()(c.linVel);
+        h        = h * 31 + std::hash<int16_t>()(c.angVel);
+        return h;
+    }
+};
+
+/** A node of the search (open or closed) */
+struct SearchNode
+{
+    SE2_KinState state;
+    cost_t       g = 0;
+
+    /** The parent node index, and the motion from it. Empty for the start */
+    std::optional<size_t>          parent;
+    std::optional<MoveEdgeSE2_TPS> edge;
+
+    bool closed = false;
+
+    /** Its ID in the output tree, once expanded */
+    std::optional<TNodeID> treeId;
+};
+
+}  // namespace
+
+PlannerOutput TPS_Astar::plan(const PlannerInput& in)
+{
+    MRPT_START
+    mrpt::system::CTimeLoggerEntry tleg(profiler_, "plan");
+
+    const auto tStart = mrpt::Clock::now();
+
+    // Sanity checks on inputs:
+    ASSERT_(in.ptgs.initialized());
+    ASSERT_(in.worldBboxMin != in.worldBboxMax);
+    ASSERT_GT_(params_.gridResolutionXY, .0);
+    ASSERT_GT_(params_.gridResolutionYaw, .0);
+    ASSERT_GT_(params_.gridResolutionLinearVel, .0);
+    ASSERT_GT_(params_.gridResolutionAngularVel, .0);
+    ASSERT_GE_(params_.trajectoriesPerPTG, 1U);
+    ASSERT_GE_(params_.numStepLengths, 1U);
+    ASSERT_GE_(params_.maxStepLength, params_.minStepLength);
+
+    PlannerOutput po;
+    po.originalInput = in;
+
+    // PTGs may have been used by someone else since our last call:
+    ptgDynStateCache_.clear();
+    ptgDynStateCache_.linearVelocityQuantization =
+        params_.ptgDynStateLinearVelQuantization;
+    ptgDynStateCache_.angularVelocityQuantization =
+        params_.ptgDynStateAngularVelQuantization;
+
+    double MAX_XY_DIST = 0;
+    for (const auto& ptg : in.ptgs.ptgs)
+        mrpt::keep_max(MAX_XY_DIST, ptg->getRefDistance());
+    ASSERT_(MAX_XY_DIST > 0);
+
+    std::vector<mrpt::maps::CPointsMap::Ptr> obstaclePoints;
+    for (const auto& os : in.obstacles)
+        if (os) obstaclePoints.emplace_back(os->obstacles());
+
+    // Heuristic: without obstacle inflation, to remain admissible
+    // ---------------------------------------------------------------------
+    const auto heuristicField = cost_to_go_field(
+        in, params_.heuristicGridResolution, false /*inflateObstacles*/);
+
+    const auto lambdaH = [&](const mrpt::math::TPose2D& p) {
+        return params_.heuristicWeight * heuristicField->heuristic({p.x, p.y});
+    };
+
+    // Fixed motion primitives: trajectory indices and distances
+    // ---------------------------------------------------------------------
+    std::vector<distance_t> stepLengths;
+    for (size_t i = 0; i < params_.numStepLengths; i++)
+    {
+        stepLengths.push_back(
+            params_.numStepLengths == 1
+                ? params_.maxStepLength
+                : params_.minStepLength +
+                      (params_.maxStepLength - params_.minStepLength) * i /
+                          (params_.numStepLengths - 1));
+    }
+
+    const auto lambdaTrajIndices = [&](const ptg_t& ptg) {
+        const size_t nK = ptg.getAlphaValuesCount();
+        const size_t n  = std::min(params_.trajectoriesPerPTG, nK);
+
+        std::vector<trajectory_index_t> ks;
+        for (size_t i = 0; i < n; i++)
+            ks.push_back(n == 1 ? nK / 2 : (i * (nK - 1)) / (n - 1));
+        return ks;
+    };
+
+    const auto lambdaCell = [&](const SE2_KinState& s) {
+        const auto   localVel = s.vel.rotated(-s.pose.phi);
+        const double resXY    = params_.gridResolutionXY;
+
+        LatticeCell c;
+        c.x = static_cast<int32_t>(std::floor(s.pose.x / resXY));
+        c.y = static_cast<int32_t>(std::floor(s.pose.y / resXY));
+        c.yaw = static_cast<int16_t>(std::round(
+            mrpt::math::wrapToPi(s.pose.phi) / params_.gridResolutionYaw));
+        c.linVel = static_cast<int16_t>(std::round(
+            std::hypot(localVel.vx, localVel.vy) /
+            params_.gridResolutionLinearVel));
+        c.angVel = static_cast<int16_t>(
+            std::round(localVel.omega / params_.gridResolutionAngularVel));
+        return c;
+    };
+
+    const auto lambdaWithinBbox = [&](const mrpt::math::TPose2D& p) {
+        return p.x > in.worldBboxMin.x && p.y > in.worldBboxMin.y &&
+               p.x < in.worldBboxMax.x && p.y < in.worldBboxMax.y;
+    };
+
+    // A* search
+    // ---------------------------------------------------------------------
+    std::vector<SearchNode>                                 nodes;
+    std::unordered_map<LatticeCell, size_t, LatticeCellHash> cellToNode;
+
+    // Open set: (f, insertion order, node index). The insertion order breaks
+    // ties deterministically.
+    using open_entry_t = std::tuple<cost_t, size_t, size_t>;
+    std::priority_queue<
+        open_entry_t, std::vector<open_entry_t>, std::greater<open_entry_t>>
+        open;
+    size_t openCounter = 0;
+
+    // The goal is a special node, only reached by direct motions:
+    std::optional<size_t> goalNodeIdx;
+
+    {
+        SearchNode start;
+        start.state = in.stateStart;
+        nodes.push_back(start);
+        cellToNode[lambdaCell(in.stateStart)] = 0;
+        open.emplace(lambdaH(in.stateStart.pose), openCounter++, 0);
+    }
+
+    const auto lambdaAddCandidate = [&](const size_t          parentIdx,
+                                        const MoveEdgeSE2_TPS& edge,
+                                        const bool             isGoal) {
+        const cost_t g = nodes[parentIdx].g + edge.cost;
+
+        std::optional<size_t> idx;
+        if (isGoal)
+            idx = goalNodeIdx;
+        else if (auto it = cellToNode.find(lambdaCell(edge.stateTo));
+                 it != cellToNode.end())
+            idx = it->second;
+
+        if (idx)
+        {
+            auto& n = nodes[*idx];
+            if (n.closed || n.g <= g) return;
+        }
+        else
+        {
+            idx = nodes.size();
+            nodes.emplace_back();
+            if (isGoal)
+                goalNodeIdx = idx;
+            else
+                cellToNode[lambdaCell(edge.stateTo)] = *idx;
+        }
+
+        auto& n  = nodes[*idx];
+        n.state  = edge.stateTo;
+        n.g      = g;
+        n.parent = parentIdx;
+        n.edge   = edge;
+
+        const cost_t h = isGoal ? .0 : lambdaH(n.state.pose);
+        open.emplace(g + h, openCounter++, *idx);
+    };
+
+    auto& tree = po.motionTree;
+    tree.root  = tree.next_free_node_ID();
+    tree.insert_root_node(tree.root, in.stateStart);
+    tree.edges_to_children.clear();
+    nodes[0].treeId = tree.root;
+
+    mrpt::maps::CSimplePointsMap localObstacles;
+    size_t                       numExpanded = 0;
+
+    while (!open.empty())
+    {
+        if (cancellationToken_.cancelled()) break;
+
+        const size_t idx = std::get<2>(open.top());
+        open.pop();
+
+        if (nodes[idx].closed) continue;  // duplicated entry
+        nodes[idx].closed = true;
+
+        if (goalNodeIdx && idx == *goalNodeIdx) break;  // Done!
+
+        // Move into the output tree:
+        if (nodes[idx].parent)
+        {
+            auto& e    = nodes[idx].edge.value();
+            e.parentId = nodes[nodes[idx].parent.value()].treeId.value();
+
+            const TNodeID newId = tree.next_free_node_ID();
+            tree.insert_node_and_edge(e.parentId, newId, nodes[idx].state, e);
+            nodes[idx].treeId = newId;
+        }
+
+        if (numExpanded++ >= params_.maxExpandedNodes) break;
+
+        // Expand: note that `nodes` may be reallocated below
+        const SE2_KinState s = nodes[idx].state;
+
+        {
+            mrpt::system::CTimeLoggerEntry tle(profiler_, "plan.local_obs");
+            localObstacles.clear();
+            for (const auto& obs : obstaclePoints)
+                transform_pc_square_clipping(
+                    *obs, mrpt::poses::CPose2D(s.pose), MAX_XY_DIST,
+                    localObstacles);
+        }
+
+        mrpt::system::CTimeLoggerEntry tle(profiler_, "plan.expand");
+
+        for (ptg_index_t ptgIdx = 0; ptgIdx < in.ptgs.ptgs.size(); ptgIdx++)
+        {
+            auto& ptg = *in.ptgs.ptgs.at(ptgIdx);
+            set_ptg_dynamic_state(ptg, s);
+
+            const auto lambdaEdge = [&](const trajectory_index_t k,
+                                        const distance_t         d,
+                                        const uint32_t           step) {
+                MoveEdgeSE2_TPS edge;
+                edge.ptgDist        = d;
+                edge.ptgIndex       = ptgIdx;
+                edge.ptgPathIndex   = k;
+                edge.targetRelSpeed = 1.0;
+                edge.stateFrom      = s;
+                edge.stateTo.pose   = s.pose + ptg.getPathPose(k, step);
+                (edge.stateTo.vel = ptg.getPathTwist(k, step))
+                    .rotate(s.pose.phi);
+                interpolate_edge(
+                    edge, ptg, step, params_.pathInterpolatedSegments);
+                edge.cost = cost_path_segment(edge);
+                return edge;
+            };
+
+            // 1) Fixed lattice motions:
+            for (const auto k : lambdaTrajIndices(ptg))
+            {
+                const distance_t freeDist =
+                    tp_obstacles_single_path(k, localObstacles, ptg);
+
+                for (const auto d : stepLengths)
+                {
+                    if (d >= freeDist) break;
+
+                    uint32_t step;
+                    if (!ptg.getPathStepForDist(k, d, step)) continue;
+
+                    const auto edge = lambdaEdge(k, d, step);
+                    if (!lambdaWithinBbox(edge.stateTo.pose)) continue;
+
+                    lambdaAddCandidate(idx, edge, false);
+                }
+            }
+        }
+
+        // 2) Direct motion to the goal, ignoring its heading:
+        if (auto edge = best_edge_towards(
+                s, in.stateGoal.pose, true /*ignoreTargetHeading*/,
+                mrpt::DEG2RAD(180.0), params_.maxStepLength, in.ptgs,
+                localObstacles, params_.pathInterpolatedSegments);
+            edge)
+        {
+            edge->stateTo = in.stateGoal;
+            lambdaAddCandidate(idx, *edge, true);
+        }
+    }
+
+    // Dummy goal node, as in TPS_RRTstar, and the found path to it, if any:
+    const TNodeID goalNodeId = tree.next_free_node_ID();
+    po.goalNodeId            = goalNodeId;
+    {
+        MoveEdgeSE2_TPS dummyEdge;
+        dummyEdge.cost      = std::numeric_limits<cost_t>::max();
+        dummyEdge.parentId  = tree.root;
+        dummyEdge.stateFrom = in.stateStart;
+        dummyEdge.stateTo   = in.stateGoal;
+        tree.insert_node_and_edge(
+            tree.root, goalNodeId, in.stateGoal, dummyEdge);
+    }
+
+    // Note that the goal may have been reached but not popped from the open
+    // set yet, if the search was aborted. Its parent is always expanded.
+    if (goalNodeIdx)
+    {
+        const auto& goalNode = nodes[*goalNodeIdx];
+
+        auto e     = goalNode.edge.value();
+        e.parentId = nodes[goalNode.parent.value()].treeId.value();
+        tree.rewire_node_parent(goalNodeId, e);
+        po.success = true;
+    }
+
+    po.pathCost = tree.nodes().at(goalNodeId).cost_;
+    po.update_extra_goal_results();
+    po.computationTime =
+        mrpt::system::timeDifference(tStart, mrpt::Clock::now());
+
+    MRPT_LOG_DEBUG_FMT(
+        "plan(): %s after expanding %u nodes (%u generated), cost=%f",
+        po.success ? "success" : "failure",
+        static_cast<unsigned int>(numExpanded),
+        static_cast<unsigned int>(nodes.size()), po.pathCost);
+
+    return po;
+    MRPT_END
+}
+
+void TPS_Astar::set_ptg_dynamic_state(ptg_t& ptg, const SE2_KinState& s)
+{
+    ptg_t::TNavDynamicState ds;
+    (ds.curVelLocal = s.vel).rotate(-s.pose.phi);
+    ds.relTarget      = {1.0, 0, 0};
+    ds.targetRelSpeed = 1.0;
+    ptgDynStateCache_.update(ptg, ds);
+}
@@ -0,0 +1,468 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#include <mrpt/system/datetime.h>
+#include <selfdriving/algos/TPS_BITstar.h>
+
+#include <queue>
+#include <set>
+
+using namespace selfdriving;
+
+IMPLEMENTS_MRPT_OBJECT(TPS_BITstar, Planner, selfdriving)
+
+mrpt::containers::yaml TPS_BITstar_Parameters::as_yaml()
+{
+    mrpt::containers::yaml c = mrpt::containers::yaml::Map();
+
+    MCP_SAVE(c, samplesPerBatch);
+    MCP_SAVE(c, maxBatches);
+    MCP_SAVE(c, maxPlanningTime);
+    MCP_SAVE(c, connectionRadius);
+    MCP_SAVE_DEG(c, headingToleranceGenerate);
+    MCP_SAVE_DEG(c, headingToleranceMetric);
+    MCP_SAVE(c, metricDistanceEpsilon);
+    MCP_SAVE(c, ptgDynStateLinearVelQuantization);
+    MCP_SAVE_DEG(c, ptgDynStateAngularVelQuantization);
+    MCP_SAVE(c, pathInterpolatedSegments);
+    random_seed_to_yaml(c, randomSeed);
+
+    return c;
+}
+
+void TPS_BITstar_Parameters::load_from_yaml(const mrpt::containers::yaml& c)
+{
+    ASSERT_(c.isMap());
+
+    MCP_LOAD_OPT(c, samplesPerBatch);
+    MCP_LOAD_OPT(c, maxBatches);
+    MCP_LOAD_OPT(c, maxPlanningTime);
+    MCP_LOAD_OPT(c, connectionRadius);
+    MCP_LOAD_OPT_DEG(c, headingToleranceGenerate);
+    MCP_LOAD_OPT_DEG(c, headingToleranceMetric);
+    MCP_LOAD_OPT(c, metricDistanceEpsilon);
+    MCP_LOAD_OPT(c, ptgDynStateLinearVelQuantization);
+    MCP_LOAD_OPT_DEG(c, ptgDynStateAngularVelQuantization);
+    MCP_LOAD_OPT(c, pathInterpolatedSegments);
+    random_seed_from_yaml(c, randomSeed);
+}
+
+TPS_BITstar_Parameters TPS_BITstar_Parameters::FromYAML(
+    const mrpt::containers::yaml& c)
+{
+    TPS_BITstar_Parameters p;
+    p.load_from_yaml(c);
+    return p;
+}
+
+TPS_BITstar::TPS_BITstar() : Planner("TPS_BITstar") {}
+
+namespace
+{
+/** Admissible heuristic for the cost between two poses: PTG path lengths are
+ * never shorter than the straight line, and cost evaluators only add to it.
+ */
+cost_t heuristic_cost(
+    const mrpt::math::TPose2D& a, const mrpt::math::TPose2D& b)
+{
+    return std::hypot(b.x - a.x, b.y - a.y);
+}
+
+/** An entry in the edge queue */
+struct QueuedEdge
+{
+    enum class Target : uint8_t
+    {
+        Sample = 0,
+        Vertex,
+        Goal
+    };
+
+    cost_t  key = 0;  //!< g(src) + c^(src,target) + h^(target)
+    TNodeID src = INVALID_NODEID;
+    Target  targetType;
+    size_t  target = 0;  //!< Sample index, or node ID
+
+    bool operator>(const QueuedEdge& o) const { return key > o.key; }
+};
+
+using edge_queue_t = std::priority_queue<
+    QueuedEdge, std::vector<QueuedEdge>, std::greater<QueuedEdge>>;
+
+/** (key=g(v)+h^(v), node ID) */
+using vertex_queue_t = std::priority_queue<
+    std::pair<cost_t, TNodeID>, std::vector<std::pair<cost_t, TNodeID>>,
+    std::greater<std::pair<cost_t, TNodeID>>>;
+
+}  // namespace
+
+PlannerOutput TPS_BITstar::plan(const PlannerInput& in)
+{
+    MRPT_START
+    mrpt::system::CTimeLoggerEntry tleg(profiler_, "plan");
+
+    const auto tStart = mrpt::Clock::now();
+
+    // Sanity checks on inputs:
+    ASSERT_(in.ptgs.initialized());
+    ASSERT_(in.worldBboxMin != in.worldBboxMax);
+    ASSERT_(params_.samplesPerBatch > 0);
+
+    PlannerOutput po;
+    po.originalInput = in;
+
+    auto& tree = po.motionTree;  // shortcut
+
+    po.randomSeed = actual_random_seed(params_.randomSeed);
+    rng_.randomize(po.randomSeed);
+
+    // PTGs may have been used by someone else since our last call:
+    ptgDynStateCache_.clear();
+    ptgDynStateCache_.linearVelocityQuantization =
+        params_.ptgDynStateLinearVelQuantization;
+    ptgDynStateCache_.angularVelocityQuantization =
+        params_.ptgDynStateAngularVelQuantization;
+
+    // clipping dist for all ptgs:
+    double MAX_XY_DIST = 0;
+    for (const auto& ptg : in.ptgs.ptgs)
+        mrpt::keep_max(MAX_XY_DIST, ptg->getRefDistance());
+    ASSERT_(MAX_XY_DIST > 0);
+
+    std::vector<mrpt::maps::CPointsMap::Ptr> obstaclePoints;
+    for (const auto& os : in.obstacles)
+        if (os) obstaclePoints.emplace_back(os->obstacles());
+
+    // Root and (dummy) goal nodes, as in TPS_RRTstar:
+    tree.root = tree.next_free_node_ID();
+    tree.insert_root_node(tree.root, in.stateStart);
+    tree.edges_to_children.clear();
+
+    const TNodeID goalNodeId = tree.next_free_node_ID();
+    po.goalNodeId            = goalNodeId;
+    {
+        MoveEdgeSE2_TPS dummyEdge;
+        dummyEdge.cost      = std::numeric_limits<cost_t>::max();
+        dummyEdge.parentId  = tree.root;
+        dummyEdge.stateFrom = in.stateStart;
+        dummyEdge.stateTo   = in.stateGoal;
+        tree.insert_node_and_edge(
+            tree.root, goalNodeId, in.stateGoal, dummyEdge);
+    }
+
+    const auto& goalPose = in.stateGoal.pose;
+    const auto  lambdaH  = [&](const mrpt::math::TPose2D& p) {
+        return heuristic_cost(p, goalPose);
+    };
+    const auto lambdaBestCost = [&]() {
+        return tree.nodes().at(goalNodeId).cost_;
+    };
+    const double r = params_.connectionRadius;
+
+    // Unconnected samples (contiguous in memory), and whether they have
+    // already become a tree node:
+    std::vector<mrpt::math::TPose2D> samples;
+    std::vector<bool>                sampleUsed;
+
+    size_t nEdgesQueued = 0, nEdgesEvaluated = 0, nEdgesAccepted = 0;
+
+    for (size_t batch = 0; batch < params_.maxBatches; batch++)
+    {
+        if (cancellationToken_.cancelled()) break;
+        if (params_.maxPlanningTime > 0 &&
+            mrpt::system::timeDifference(tStart, mrpt::Clock::now()) >
+                params_.maxPlanningTime)
+            break;
+
+        mrpt::system::CTimeLoggerEntry tle1(profiler_, "plan.batch");
+
+        // Prune samples that can no longer improve the solution, then add a
+        // new batch within the informed set:
+        const cost_t bestCostAtStart = lambdaBestCost();
+        {
+            std::vector<mrpt::math::TPose2D> kept;
+            for (size_t i = 0; i < samples.size(); i++)
+            {
+                if (sampleUsed[i]) continue;
+                if (heuristic_cost(in.stateStart.pose, samples[i]) +
+                        lambdaH(samples[i]) >=
+                    bestCostAtStart)
+                    continue;
+                kept.push_back(samples[i]);
+            }
+            samples = std::move(kept);
+        }
+        draw_samples_batch(in, bestCostAtStart, samples);
+        sampleUsed.assign(samples.size(), false);
+
+        // Vertices existing before this batch do not need rewiring edges
+        // towards other old vertices:
+        std::set<TNodeID> oldVertices;
+        vertex_queue_t    vertexQueue;
+        for (const auto& [id, node] : tree.nodes())
+        {
+            if (id == goalNodeId) continue;
+            if (node.cost_ + lambdaH(node.pose) >= bestCostAtStart) continue;
+            if (batch != 0) oldVertices.insert(id);
+            vertexQueue.emplace(node.cost_ + lambdaH(node.pose), id);
+        }
+
+        edge_queue_t edgeQueue;
+
+        const auto lambdaExpandVertex = [&](const TNodeID vId) {
+            const auto&  v      = tree.nodes().at(vId);
+            const cost_t best   = lambdaBestCost();
+            const bool   vIsOld = oldVertices.count(vId) != 0;
+
+            for (size_t i = 0; i < samples.size(); i++)
+            {
+                if (sampleUsed[i]) continue;
+                const cost_t c = heuristic_cost(v.pose, samples[i]);
+                if (c > r) continue;
+                const cost_t key = v.cost_ + c + lambdaH(samples[i]);
+                if (key >= best) continue;
+                edgeQueue.push({key, vId, QueuedEdge::Target::Sample, i});
+                nEdgesQueued++;
+            }
+            if (const cost_t c = lambdaH(v.pose);
+                c <= r && v.cost_ + c < best)
+            {
+                edgeQueue.push(
+                    {v.cost_ + c, vId, QueuedEdge::Target::Goal, goalNodeId});
+                nEdgesQueued++;
+            }
+            if (vIsOld) return;
+
+            // Rewiring candidates:
+            for (const auto& [wId, w] : tree.nodes())
+            {
+                if (wId == vId || wId == goalNodeId || wId == tree.root)
+                    continue;
+                const cost_t c = heuristic_cost(v.pose, w.pose);
+                if (c > r || v.cost_ + c >= w.cost_) continue;
+                const cost_t key = v.cost_ + c + lambdaH(w.pose);
+                if (key >= best) continue;
+                edgeQueue.push({key, vId, QueuedEdge::Target::Vertex, wId});
+                nEdgesQueued++;
+            }
+        };
+
+        // Process the queues in order of heuristic total cost:
+        for (;;)
+        {
+            if (cancellationToken_.cancelled()) break;
+
+            while (!vertexQueue.empty() &&
+                   (edgeQueue.empty() ||
+                    vertexQueue.top().first <= edgeQueue.top().key))
+            {
+                const TNodeID vId = vertexQueue.top().second;
+                vertexQueue.pop();
+                lambdaExpandVertex(vId);
+            }
+            if (edgeQueue.empty()) break;
+
+            const QueuedEdge e = edgeQueue.top();
+            edgeQueue.pop();
+
+            // No queued edge can improve the solution: batch is done.
+            if (e.key >= lambdaBestCost()) break;
+
+            if (e.targetType == QueuedEdge::Target::Sample &&
+                sampleUsed[e.target])
+                continue;  // already connected by a better edge
+
+            const auto& src = tree.nodes().at(e.src);
+
+            mrpt::math::TPose2D targetPose;
+            double              headingTol;
+            switch (e.targetType)
+            {
+                case QueuedEdge::Target::Sample:
+                    targetPose = samples[e.target];
+                    headingTol = params_.headingToleranceGenerate;
+                    break;
+                case QueuedEdge::Target::Goal:
+                    targetPose = goalPose;
+                    headingTol = params_.headingToleranceMetric;
+                    break;
+                case QueuedEdge::Target::Vertex:
+                default:
+                    if (src.cost_ + heuristic_cost(
+                                        src.pose,
+                                        tree.nodes().at(e.target).pose) >=
+                        tree.nodes().at(e.target).cost_)
+                        continue;
+                    targetPose = tree.nodes().at(e.target).pose;
+                    headingTol = params_.headingToleranceMetric;
+                    break;
+            }
+
+            // Exact (expensive) evaluation, only for promising edges:
+            nEdgesEvaluated++;
+            auto edge = evaluate_edge(
+                tree, e.src, targetPose, headingTol,
+                e.targetType == QueuedEdge::Target::Goal, in.ptgs,
+                obstaclePoints, MAX_XY_DIST);
+            if (!edge) continue;
+
+            const cost_t newCost = src.cost_ + edge->cost;
+            if (newCost + lambdaH(edge->stateTo.pose) >= lambdaBestCost())
+                continue;
+
+            switch (e.targetType)
+            {
+                case QueuedEdge::Target::Sample:
+                {
+                    // Samples closer than epsilon to existing nodes are not
+                    // worth it:
+                    bool tooClose = false;
+                    for (const auto& [id, n] : tree.nodes())
+                    {
+                        if (heuristic_cost(n.pose, edge->stateTo.pose) <
+                                params_.metricDistanceEpsilon &&
+                            std::abs(mrpt::math::angDistance(
+                                n.pose.phi, edge->stateTo.pose.phi)) <
+                                params_.headingToleranceMetric)
+                        {
+                            tooClose = true;
+                            break;
+                        }
+                    }
+                    sampleUsed[e.target] = true;
+                    if (tooClose) break;
+
+                    const TNodeID newId = tree.next_free_node_ID();
+                    tree.insert_node_and_edge(
+                        e.src, newId, edge->stateTo, *edge);
+                    vertexQueue.emplace(
+                        newCost + lambdaH(edge->stateTo.pose), newId);
+                    nEdgesAccepted++;
+                }
+                break;
+                case QueuedEdge::Target::Goal:
+                case QueuedEdge::Target::Vertex:
+                default:
+                {
+                    const auto& trg = tree.nodes().at(e.target);
+                    if (newCost >= trg.cost_) break;
+                    edge->stateTo = trg;
+                    tree.rewire_node_parent(e.target, *edge);
+                    nEdgesAccepted++;
+                }
+                break;
+            }
+        }
+
+        MRPT_LOG_DEBUG_FMT(
+            "batch: %3u nodes=%5u samples=%5u goal_cost=%s",
+            static_cast<unsigned int>(batch),
+            static_cast<unsigned int>(tree.nodes().size()),
+            static_cast<unsigned int>(samples.size()),
+            lambdaBestCost() == std::numeric_limits<cost_t>::max()
+                ? "Inf"
+                : std::to_string(lambdaBestCost()).c_str());
+    }
+
+    // Collect the result:
+    const auto foundPath = tree.backtrack_path(goalNodeId);
+    po.success           = true;
+    for (const auto& step : foundPath)
+    {
+        if (step.cost_ == std::numeric_limits<cost_t>::max())
+        {
+            po.success = false;
+            break;
+        }
+    }
+    po.pathCost = tree.nodes().at(goalNodeId).cost_;
+    po.update_extra_goal_results();
+    po.computationTime =
+        mrpt::system::timeDifference(tStart, mrpt::Clock::now());
+
+    MRPT_LOG_DEBUG_FMT(
+        "Edges: %u queued, %u evaluated, %u accepted",
+        static_cast<unsigned int>(nEdgesQueued),
+        static_cast<unsigned int>(nEdgesEvaluated),
+        static_cast<unsigned int>(nEdgesAccepted));
+
+    return po;
+    MRPT_END
+}
+
+void TPS_BITstar::draw_samples_batch(
+    const PlannerInput& pi, const cost_t bestCost,
+    std::vector<mrpt::math::TPose2D>& samples)
+{
+    auto tle = mrpt::system::CTimeLoggerEntry(profiler_, "draw_samples_batch");
+
+    std::vector<mrpt::maps::CPointsMap::Ptr> obstacles;
+    for (const auto& os : pi.obstacles)
+        if (os) obstacles.emplace_back(os->obstacles());
+
+    const auto& bbMin = pi.worldBboxMin;
+    const auto& bbMax = pi.worldBboxMax;
+
+    // Give up after too many rejections, e.g. if the informed set is tiny:
+    const size_t maxAttempts = 100 * params_.samplesPerBatch;
+
+    for (size_t nNew = 0, attempt = 0;
+         nNew < params_.samplesPerBatch && attempt < maxAttempts; attempt++)
+    {
+        const auto q = mrpt::math::TPose2D(
+            rng_.drawUniform(bbMin.x, bbMax.x),
+            rng_.drawUniform(bbMin.y, bbMax.y),
+            rng_.drawUniform(bbMin.phi, bbMax.phi));
+
+        // Informed set:
+        if (heuristic_cost(pi.stateStart.pose, q) +
+                heuristic_cost(q, pi.stateGoal.pose) >=
+            bestCost)
+            continue;
+
+        bool isCollision = false;
+        for (const auto& o : obstacles)
+        {
+            mrpt::math::TPoint2D closestObs;
+            float                closestDistSqr;
+            o->kdTreeClosestPoint2D({q.x, q.y}, closestObs, closestDistSqr);
+
+            const auto closestObsWrtRobot = q.inverseComposePoint(closestObs);
+
+            if (selfdriving::obstaclePointCollides(
+                    closestObsWrtRobot, pi.ptgs))
+            {
+                isCollision = true;
+                break;
+            }
+        }
+        if (isCollision) continue;
+
+        samples.push_back(q);
+        nNew++;
+    }
+}
+
+std::optional<MoveEdgeSE2_TPS> TPS_BITstar::evaluate_edge(
+    const MotionPrimitivesTreeSE2& tree, const TNodeID srcNodeId,
+    const mrpt::math::TPose2D& target, const double headingTolerance,
+    const bool ignoreTargetHeading, const TrajectoriesAndRobotShape& trs,
+    const std::vector<mrpt::maps::CPointsMap::Ptr>& globalObstacles,
+    const double                                    MAX_XY_DIST)
+{
+    auto tle = mrpt::system::CTimeLoggerEntry(profiler_, "evaluate_edge");
+
+    const auto& localObstacles =
+        cached_local_obstacles(tree, srcNodeId, globalObstacles, MAX_XY_DIST);
+
+    auto edge = best_edge_towards(
+        tree.nodes().at(srcNodeId), target, ignoreTargetHeading,
+        headingTolerance, MAX_XY_DIST, trs, *localObstacles,
+        params_.pathInterpolatedSegments);
+    if (edge) edge->parentId = srcNodeId;
+
+    return edge;
+}
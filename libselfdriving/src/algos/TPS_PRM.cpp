@@ -0,0 +1,604 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#include <mrpt/maps/CSimplePointsMap.h>
+#include <mrpt/system/datetime.h>
+#include <selfdriving/algos/TPS_PRM.h>
+
+#include <algorithm>
+#include <map>
+#include <queue>
+
+using namespace selfdriving;
+
+IMPLEMENTS_MRPT_OBJECT(TPS_PRM, Planner, selfdriving)
+
+mrpt::containers::yaml TPS_PRM_Parameters::as_yaml()
+{
+    mrpt::containers::yaml c = mrpt::containers::yaml::Map();
+
+    MCP_SAVE(c, numNodes);
+    MCP_SAVE(c, uniformSamplingProbability);
+    MCP_SAVE(c, minStepLength);
+    MCP_SAVE(c, maxStepLength);
+    MCP_SAVE(c, connectionRadius);
+    MCP_SAVE(c, maxNeighbors);
+    MCP_SAVE_DEG(c, headingToleranceMetric);
+    MCP_SAVE(c, maxLazyValidationRounds);
+    MCP_SAVE(c, pathInterpolatedSegments);
+    random_seed_to_yaml(c, randomSeed);
+
+    return c;
+}
+
+void TPS_PRM_Parameters::load_from_yaml(const mrpt::containers::yaml& c)
+{
+    ASSERT_(c.isMap());
+
+    MCP_LOAD_OPT(c, numNodes);
+    MCP_LOAD_OPT(c, uniformSamplingProbability);
+    MCP_LOAD_OPT(c, minStepLength);
+    MCP_LOAD_OPT(c, maxStepLength);
+    MCP_LOAD_OPT(c, connectionRadius);
+    MCP_LOAD_OPT(c, maxNeighbors);
+    MCP_LOAD_OPT_DEG(c, headingToleranceMetric);
+    MCP_LOAD_OPT(c, maxLazyValidationRounds);
+    MCP_LOAD_OPT(c, pathInterpolatedSegments);
+    random_seed_from_yaml(c, randomSeed);
+}
+
+TPS_PRM_Parameters TPS_PRM_Parameters::FromYAML(
+    const mrpt::containers::yaml& c)
+{
+    TPS_PRM_Parameters p;
+    p.load_from_yaml(c);
+    return p;
+}
+
+TPS_PRM::TPS_PRM() : Planner("TPS_PRM") {}
+
+static bool pose_is_free(
+    const mrpt::math::TPose2D&                      q,
+    const std::vector<mrpt::maps::CPointsMap::Ptr>& obstacles,
+    const TrajectoriesAndRobotShape&                trs)
+{
+    for (const auto& o : obstacles)
+    {
+        mrpt::math::TPoint2D closestObs;
+        float                closestDistSqr;
+        o->kdTreeClosestPoint2D({q.x, q.y}, closestObs, closestDistSqr);
+
+        const auto closestObsWrtRobot = q.inverseComposePoint(closestObs);
+
+        if (selfdriving::obstaclePointCollides(closestObsWrtRobot, trs))
+            return false;
+    }
+    return true;
+}
+
+void TPS_PRM::build_roadmap(const PlannerInput& in)
+{
+    MRPT_START
+    mrpt::system::CTimeLoggerEntry tle(profiler_, "build_roadmap");
+
+    ASSERT_(in.ptgs.initialized());
+    ASSERT_(in.worldBboxMin != in.worldBboxMax);
+
+    rng_.randomize(actual_random_seed(params_.randomSeed));
+    ptgDynStateCache_.clear();
+
+    roadmap_->clear();
+    for (size_t i = 0; i < in.ptgs.ptgs.size(); i++)
+        roadmap_->ptgSignatures.push_back(in.ptgs.ptg_signature_hash(i));
+    roadmap_->mapSignature =
+        PTGRoadmap::static_obstacles_signature(in.obstacles);
+
+    std::vector<mrpt::maps::CPointsMap::Ptr> obstaclePoints;
+    for (const auto& os : in.obstacles)
+        if (os) obstaclePoints.emplace_back(os->obstacles());
+
+    const auto& bbMin = in.worldBboxMin;
+    const auto& bbMax = in.worldBboxMax;
+
+    const auto lambdaWithinBbox = [&](const mrpt::math::TPose2D& p) {
+        return p.x > bbMin.x && p.y > bbMin.y && p.x < bbMax.x &&
+               p.y < bbMax.y;
+    };
+
+    mrpt::maps::CSimplePointsMap localObs;
+
+    const size_t maxAttempts = 100 * params_.numNodes;
+    for (size_t attempt = 0;
+         roadmap_->nodes.size() < params_.numNodes && attempt < maxAttempts;
+         attempt++)
+    {
+        // 1) Draw a new node, either uniformly or as a PTG extension of an
+        // existing node:
+        mrpt::math::TPose2D                     q;
+        std::optional<PTGRoadmap::node_index_t> srcIdx;
+
+        if (roadmap_->empty() ||
+            rng_.drawUniform(0.0, 1.0) < params_.uniformSamplingProbability)
+        {
+            q = mrpt::math::TPose2D(
+                rng_.drawUniform(bbMin.x, bbMax.x),
+                rng_.drawUniform(bbMin.y, bbMax.y),
+                rng_.drawUniform(bbMin.phi, bbMax.phi));
+        }
+        else
+        {
+            srcIdx = rng_.drawUniform32bit() % roadmap_->nodes.size();
+
+            const auto ptgIdx = rng_.drawUniform32bit() % in.ptgs.ptgs.size();
+            auto&      ptg    = *in.ptgs.ptgs.at(ptgIdx);
+            set_ptg_dynamic_state(ptg, {0, 0, 0});
+
+            const trajectory_index_t k =
+                rng_.drawUniform32bit() % ptg.getAlphaValuesCount();
+            const double d = rng_.drawUniform(
+                params_.minStepLength, params_.maxStepLength);
+
+            uint32_t step;
+            if (!ptg.getPathStepForDist(k, d, step)) continue;
+
+            q = roadmap_->nodes.at(*srcIdx) + ptg.getPathPose(k, step);
+        }
+
+        if (!lambdaWithinBbox(q) || !pose_is_free(q, obstaclePoints, in.ptgs))
+            continue;
+
+        // Too close to an existing node?
+        const auto neighbors = nearby_roadmap_nodes(q);
+        if (!neighbors.empty())
+        {
+            const auto& closest = roadmap_->nodes.at(neighbors.front());
+            if (std::hypot(closest.x - q.x, closest.y - q.y) <
+                    0.5 * params_.minStepLength &&
+                std::abs(mrpt::math::angDistance(closest.phi, q.phi)) <
+                    params_.headingToleranceMetric)
+                continue;
+        }
+
+        // The extension motion must be collision-free:
+        std::optional<PTGRoadmap::edge_t> extEdge;
+        if (srcIdx)
+        {
+            const SE2_KinState src{roadmap_->nodes.at(*srcIdx), {0, 0, 0}};
+            local_obstacles(src.pose, obstaclePoints, in.ptgs, localObs);
+            extEdge = connect(
+                src, q, false, in.ptgs, localObs, *srcIdx,
+                roadmap_->nodes.size());
+            if (!extEdge) continue;
+        }
+
+        const auto idx = roadmap_->add_node(q);
+        if (extEdge) roadmap_->add_edge(*extEdge);
+
+        // 2) Try to connect with other nearby nodes, in both directions:
+        const SE2_KinState newState{q, {0, 0, 0}};
+        local_obstacles(q, obstaclePoints, in.ptgs, localObs);
+        for (const auto j : neighbors)
+        {
+            if (srcIdx && j == *srcIdx) continue;
+            if (auto e = connect(
+                    newState, roadmap_->nodes.at(j), false, in.ptgs, localObs,
+                    idx, j);
+                e)
+                roadmap_->add_edge(*e);
+        }
+        for (const auto j : neighbors)
+        {
+            if (srcIdx && j == *srcIdx) continue;
+            const SE2_KinState nState{roadmap_->nodes.at(j), {0, 0, 0}};
+            mrpt::maps::CSimplePointsMap nObs;
+            local_obstacles(nState.pose, obstaclePoints, in.ptgs, nObs);
+            if (auto e = connect(nState, q, false, in.ptgs, nObs, j, idx); e)
+                roadmap_->add_edge(*e);
+        }
+    }
+
+    MRPT_LOG_INFO_FMT(
+        "Roadmap built: %u nodes, %u edges",
+        static_cast<unsigned int>(roadmap_->nodes.size()),
+        static_cast<unsigned int>(roadmap_->edges.size()));
+
+    MRPT_END
+}
+
+PlannerOutput TPS_PRM::plan(const PlannerInput& in)
+{
+    MRPT_START
+    mrpt::system::CTimeLoggerEntry tleg(profiler_, "plan");
+
+    const auto tStart = mrpt::Clock::now();
+
+    ASSERT_(in.ptgs.initialized());
+    ASSERTMSG_(
+        !roadmap_->empty(),
+        "Roadmap is empty: call build_roadmap() or load it from a file");
+    ASSERTMSG_(
+        roadmap_->compatible_with(in.ptgs),
+        "Roadmap was built for a different set of PTGs");
+
+    PlannerOutput po;
+    po.originalInput = in;
+
+    ptgDynStateCache_.clear();
+
+    std::vector<mrpt::maps::CPointsMap::Ptr> obstaclePoints;
+    for (const auto& os : in.obstacles)
+        if (os) obstaclePoints.emplace_back(os->obstacles());
+
+    using node_index_t = PTGRoadmap::node_index_t;
+    using edge_index_t = PTGRoadmap::edge_index_t;
+
+    // Start and goal are appended as two virtual nodes:
+    const size_t       N        = roadmap_->nodes.size();
+    const node_index_t startIdx = N, goalIdx = N + 1;
+
+    const auto lambdaPose = [&](const node_index_t i) {
+        if (i == startIdx) return in.stateStart.pose;
+        if (i == goalIdx) return in.stateGoal.pose;
+        return roadmap_->nodes.at(i);
+    };
+    const auto lambdaState = [&](const node_index_t i) {
+        if (i == startIdx) return in.stateStart;
+        return SE2_KinState{lambdaPose(i), {0, 0, 0}};
+    };
+
+    // 1) Connect start and goal with the roadmap. These edges are checked
+    // against all obstacles now:
+    // ---------------------------------------------------------------------
+    std::vector<PTGRoadmap::edge_t>                   queryEdges;
+    std::map<node_index_t, std::vector<edge_index_t>> queryOutEdges;
+
+    const auto lambdaAddQueryEdge = [&](const PTGRoadmap::edge_t& e) {
+        queryEdges.push_back(e);
+        queryOutEdges[e.from].push_back(
+            roadmap_->edges.size() + queryEdges.size() - 1);
+    };
+    const auto lambdaEdge =
+        [&](const edge_index_t i) -> const PTGRoadmap::edge_t& {
+        if (i < roadmap_->edges.size()) return roadmap_->edges[i];
+        return queryEdges.at(i - roadmap_->edges.size());
+    };
+
+    {
+        mrpt::system::CTimeLoggerEntry tle(profiler_, "plan.connect_query");
+        mrpt::maps::CSimplePointsMap   localObs;
+
+        local_obstacles(in.stateStart.pose, obstaclePoints, in.ptgs, localObs);
+        for (const auto j : nearby_roadmap_nodes(in.stateStart.pose))
+        {
+            if (auto e = connect(
+                    in.stateStart, roadmap_->nodes.at(j), false, in.ptgs,
+                    localObs, startIdx, j);
+                e)
+                lambdaAddQueryEdge(*e);
+        }
+        // Direct start -> goal motion?
+        if (auto e = connect(
+                in.stateStart, in.stateGoal.pose, true /*ignore heading*/,
+                in.ptgs, localObs, startIdx, goalIdx);
+            e)
+            lambdaAddQueryEdge(*e);
+
+        // As in TPS_RRTstar, the goal heading is not enforced:
+        for (const auto j : nearby_roadmap_nodes(in.stateGoal.pose))
+        {
+            local_obstacles(
+                roadmap_->nodes.at(j), obstaclePoints, in.ptgs, localObs);
+            if (auto e = connect(
+                    lambdaState(j), in.stateGoal.pose, true, in.ptgs, localObs,
+                    j, goalIdx);
+                e)
+                lambdaAddQueryEdge(*e);
+        }
+    }
+
+    // 2) A* search + lazy validation of roadmap edges against the current
+    // obstacles:
+    // ---------------------------------------------------------------------
+    std::set<edge_index_t>       blockedEdges;
+    std::vector<MoveEdgeSE2_TPS> pathEdges;
+
+    const auto lambdaH = [&](const node_index_t i) {
+        const auto p = lambdaPose(i);
+        return std::hypot(p.x - in.stateGoal.pose.x, p.y - in.stateGoal.pose.y);
+    };
+
+    const auto lambdaAstar = [&]() {
+        mrpt::system::CTimeLoggerEntry tle(profiler_, "plan.astar");
+
+        std::vector<cost_t> g(N + 2, std::numeric_limits<cost_t>::max());
+        std::vector<std::optional<edge_index_t>> via(N + 2);
+
+        using entry_t = std::pair<cost_t, node_index_t>;
+        std::priority_queue<
+            entry_t, std::vector<entry_t>, std::greater<entry_t>>
+            open;
+
+        g[startIdx] = 0;
+        open.emplace(lambdaH(startIdx), startIdx);
+
+        const auto lambdaRelax = [&](const node_index_t u,
+                                     const edge_index_t ei) {
+            if (blockedEdges.count(ei)) return;
+            const auto&  e  = lambdaEdge(ei);
+            const cost_t ng = g[u] + e.cost;
+            if (ng >= g[e.to]) return;
+            g[e.to]   = ng;
+            via[e.to] = ei;
+            open.emplace(ng + lambdaH(e.to), e.to);
+        };
+
+        while (!open.empty())
+        {
+            const auto [f, u] = open.top();
+            open.pop();
+            if (u == goalIdx) break;
+            if (f > g[u] + lambdaH(u) + 1e-9) continue;  // stale entry
+
+            if (u < N)
+                for (const auto ei : roadmap_->outEdges.at(u))
+                    lambdaRelax(u, ei);
+            if (auto it = queryOutEdges.find(u); it != queryOutEdges.end())
+                for (const auto ei : it->second) lambdaRelax(u, ei);
+        }
+
+        std::vector<edge_index_t> path;
+        if (!via[goalIdx]) return path;
+        for (node_index_t n = goalIdx; n != startIdx;)
+        {
+            const auto ei = via[n].value();
+            path.push_back(ei);
+            n = lambdaEdge(ei).from;
+        }
+        std::reverse(path.begin(), path.end());
+        return path;
+    };
+
+    // Roadmap motions were built at zero velocity: re-evaluate them for the
+    // actual state the vehicle arrives with at each node (the real end of
+    // the former edge, which may not be exactly the node pose), which only
+    // depends on the incoming edges, so results are reused among rounds:
+    std::map<edge_index_t, std::pair<SE2_KinState, MoveEdgeSE2_TPS>> resolved;
+
+    const auto lambdaSameState = [](const SE2_KinState& a,
+                                    const SE2_KinState& b) {
+        return a.pose.x == b.pose.x && a.pose.y == b.pose.y &&
+               a.pose.phi == b.pose.phi && a.vel == b.vel;
+    };
+
+    for (size_t round = 0; round < params_.maxLazyValidationRounds; round++)
+    {
+        if (cancellationToken_.cancelled()) break;
+
+        const auto candidate = lambdaAstar();
+        if (candidate.empty()) break;  // No path at all
+
+        std::vector<MoveEdgeSE2_TPS> edges;
+        SE2_KinState                 from = in.stateStart;
+        for (const auto ei : candidate)
+        {
+            const auto& e = lambdaEdge(ei);
+
+            const auto it = resolved.find(ei);
+            if (it != resolved.end() &&
+                lambdaSameState(it->second.first, from))
+            {
+                edges.push_back(it->second.second);
+            }
+            else if (auto edge = resolve_edge(
+                         e, from, lambdaPose(e.to), e.to == goalIdx, in.ptgs,
+                         obstaclePoints);
+                     edge)
+            {
+                resolved[ei] = {from, *edge};
+                edges.push_back(*edge);
+            }
+            else
+            {
+                blockedEdges.insert(ei);
+                break;
+            }
+            from = edges.back().stateTo;
+        }
+        if (edges.size() == candidate.size())
+        {
+            pathEdges = std::move(edges);
+            break;
+        }
+    }
+
+    // 3) Build the output tree, with the same structure than TPS_RRTstar:
+    // ---------------------------------------------------------------------
+    auto& tree = po.motionTree;
+    tree.root  = tree.next_free_node_ID();
+    tree.insert_root_node(tree.root, in.stateStart);
+    tree.edges_to_children.clear();
+
+    const TNodeID goalNodeId = tree.next_free_node_ID();
+    po.goalNodeId            = goalNodeId;
+    {
+        MoveEdgeSE2_TPS dummyEdge;
+        dummyEdge.cost      = std::numeric_limits<cost_t>::max();
+        dummyEdge.parentId  = tree.root;
+        dummyEdge.stateFrom = in.stateStart;
+        dummyEdge.stateTo   = in.stateGoal;
+        tree.insert_node_and_edge(
+            tree.root, goalNodeId, in.stateGoal, dummyEdge);
+    }
+
+    TNodeID parentId = tree.root;
+    for (size_t i = 0; i < pathEdges.size(); i++)
+    {
+        auto& edge    = pathEdges[i];
+        edge.parentId = parentId;
+
+        if (i + 1 == pathEdges.size())
+        {
+            // It reached the goal within tolerance, as in TPS_RRTstar:
+            edge.stateTo = in.stateGoal;
+            tree.rewire_node_parent(goalNodeId, edge);
+            break;
+        }
+
+        const TNodeID newId = tree.next_free_node_ID();
+        tree.insert_node_and_edge(parentId, newId, edge.stateTo, edge);
+        parentId = newId;
+    }
+
+    po.success  = !pathEdges.empty();
+    po.pathCost = tree.nodes().at(goalNodeId).cost_;
+    po.update_extra_goal_results();
+    po.computationTime =
+        mrpt::system::timeDifference(tStart, mrpt::Clock::now());
+
+    MRPT_LOG_DEBUG_FMT(
+        "Query: %u start/goal edges, %u blocked roadmap edges, success=%s",
+        static_cast<unsigned int>(queryEdges.size()),
+        static_cast<unsigned int>(blockedEdges.size()),
+        po.success ? "YES" : "NO");
+
+    return po;
+    MRPT_END
+}
+
+std::optional<PTGRoadmap::edge_t> TPS_PRM::connect(
+    const SE2_KinState& from, const mrpt::math::TPose2D& to,
+    const bool ignoreTargetHeading, const TrajectoriesAndRobotShape& trs,
+    const mrpt::maps::CPointsMap&  localObstacles,
+    const PTGRoadmap::node_index_t fromNodeIdx,
+    const PTGRoadmap::node_index_t toNodeIdx)
+{
+    const auto edge = best_edge_towards(
+        from, to, ignoreTargetHeading, params_.headingToleranceMetric,
+        params_.connectionRadius, trs, localObstacles,
+        params_.pathInterpolatedSegments);
+    if (!edge) return {};
+
+    PTGRoadmap::edge_t e;
+    e.from         = fromNodeIdx;
+    e.to           = toNodeIdx;
+    e.ptgIndex     = edge->ptgIndex;
+    e.ptgPathIndex = edge->ptgPathIndex;
+    e.ptgDist      = edge->ptgDist;
+    e.cost         = edge->cost;
+    return e;
+}
+
+std::optional<MoveEdgeSE2_TPS> TPS_PRM::resolve_edge(
+    const PTGRoadmap::edge_t& e, const SE2_KinState& from,
+    const mrpt::math::TPose2D& to, const bool ignoreTargetHeading,
+    const TrajectoriesAndRobotShape&                trs,
+    const std::vector<mrpt::maps::CPointsMap::Ptr>& globalObstacles)
+{
+    auto tle = mrpt::system::CTimeLoggerEntry(profiler_, "edge_validation");
+
+    mrpt::maps::CSimplePointsMap localObs;
+    local_obstacles(from.pose, globalObstacles, trs, localObs);
+
+    auto& ptg = *trs.ptgs.at(e.ptgIndex);
+    set_ptg_dynamic_state(ptg, from.vel.rotated(-from.pose.phi));
+
+    std::optional<MoveEdgeSE2_TPS> edge;
+
+    // Does the original motion still reach `to` from this state?
+    uint32_t ptg_step;
+    if (ptg.getPathStepForDist(e.ptgPathIndex, e.ptgDist, ptg_step))
+    {
+        const auto reached =
+            from.pose + ptg.getPathPose(e.ptgPathIndex, ptg_step);
+
+        if (std::hypot(reached.x - to.x, reached.y - to.y) <
+                0.5 * params_.minStepLength &&
+            (ignoreTargetHeading ||
+             std::abs(mrpt::math::angDistance(reached.phi, to.phi)) <
+                 params_.headingToleranceMetric))
+        {
+            if (e.ptgDist >=
+                tp_obstacles_single_path(e.ptgPathIndex, localObs, ptg))
+                return {};  // blocked
+
+            auto& ed          = edge.emplace();
+            ed.ptgDist        = e.ptgDist;
+            ed.ptgIndex       = e.ptgIndex;
+            ed.ptgPathIndex   = e.ptgPathIndex;
+            ed.targetRelSpeed = 1.0;
+            ed.cost           = e.cost;
+            ed.stateFrom      = from;
+            ed.stateTo.pose   = reached;
+            (ed.stateTo.vel = ptg.getPathTwist(e.ptgPathIndex, ptg_step))
+                .rotate(from.pose.phi);
+            interpolate_edge(
+                ed, ptg, ptg_step, params_.pathInterpolatedSegments);
+        }
+    }
+
+    // Otherwise (velocity-dependent PTGs), look for another motion:
+    if (!edge)
+    {
+        edge = best_edge_towards(
+            from, to, ignoreTargetHeading, params_.headingToleranceMetric,
+            params_.connectionRadius, trs, localObs,
+            params_.pathInterpolatedSegments);
+        if (!edge) return {};
+    }
+
+    // Note: edge->stateTo keeps the real end pose of the motion, which is
+    // where the next edge starts from.
+    return edge;
+}
+
+void TPS_PRM::local_obstacles(
+    const mrpt::math::TPose2D&                      p,
+    const std::vector<mrpt::maps::CPointsMap::Ptr>& globalObstacles,
+    const TrajectoriesAndRobotShape& trs, mrpt::maps::CPointsMap& out)
+{
+    double MAX_XY_DIST = 0;
+    for (const auto& ptg : trs.ptgs)
+        mrpt::keep_max(MAX_XY_DIST, ptg->getRefDistance());
+
+    out.clear();
+    for (const auto& obs : globalObstacles)
+    {
+        ASSERT_(obs);
+        transform_pc_square_clipping(
+            *obs, mrpt::poses::CPose2D(p), MAX_XY_DIST, out);
+    }
+}
+
+std::vector<PTGRoadmap::node_index_t> TPS_PRM::nearby_roadmap_nodes(
+    const mrpt::math::TPose2D& p) const
+{
+    std::multimap<double, PTGRoadmap::node_index_t> byDist;
+    for (PTGRoadmap::node_index_t i = 0; i < roadmap_->nodes.size(); i++)
+    {
+        const auto&  n = roadmap_->nodes[i];
+        const double d = std::hypot(n.x - p.x, n.y - p.y);
+        if (d > params_.connectionRadius) continue;
+        byDist.emplace(d, i);
+    }
+
+    std::vector<PTGRoadmap::node_index_t> out;
+    for (const auto& [d, i] : byDist)
+    {
+        if (out.size() >= params_.maxNeighbors) break;
+        out.push_back(i);
+    }
+    return out;
+}
+
+void TPS_PRM::set_ptg_dynamic_state(
+    ptg_t& ptg, const mrpt::math::TTwist2D& vel)
+{
+    ptg_t::TNavDynamicState ds;
+    ds.curVelLocal    = vel;
+    ds.relTarget      = {1.0, 0, 0};
+    ds.targetRelSpeed = 1.0;
+    ptgDynStateCache_.update(ptg, ds);
+}
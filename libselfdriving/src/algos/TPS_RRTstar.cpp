@@ -7,10 +7,13 @@
 #include <mrpt/maps/COccupancyGridMap2D.h>
 #include <mrpt/maps/CSimplePointsMap.h>
 #include <mrpt/opengl/COpenGLScene.h>
-#include <mrpt/random/RandomGenerators.h>
+#include <mrpt/poses/CPose3D.h>
+#include <mrpt/system/datetime.h>
 #include <selfdriving/algos/TPS_RRTstar.h>
 #include <selfdriving/algos/render_tree.h>
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
 using namespace selfdriving;
@@ -24,14 +27,34 @@ mrpt::containers::yaml TPS_RRTstar_Parameters::as_yaml()
     MCP_SAVE(c, minStepLength);
     MCP_SAVE(c, maxStepLength);
     MCP_SAVE(c, maxIterations);
+    MCP_SAVE(c, searchRadiusGamma);
+    MCP_SAVE(c, minSearchRadius);
+    MCP_SAVE(c, maxNeighbors);
     MCP_SAVE(c, metricDistanceEpsilon);
     MCP_SAVE(c, SE2_metricAngleWeight);
+    MCP_SAVE(c, ptgDynStateLinearVelQuantization);
+    MCP_SAVE_DEG(c, ptgDynStateAngularVelQuantization);
     MCP_SAVE(c, drawInTPS);
     MCP_SAVE(c, drawBiasTowardsGoal);
+    c["samplingSequence"] =
+        mrpt::typemeta::TEnumType<SamplingSequence>::value2name(
+            samplingSequence);
     MCP_SAVE_DEG(c, headingToleranceGenerate);
     MCP_SAVE_DEG(c, headingToleranceMetric);
     MCP_SAVE(c, pathInterpolatedSegments);
     MCP_SAVE(c, saveDebugVisualizationDecimation);
+    MCP_SAVE(c, maxDrawAttempts);
+    MCP_SAVE(c, proposalBinsPerPTG);
+    MCP_SAVE(c, minProposalWeight);
+    random_seed_to_yaml(c, randomSeed);
+    MCP_SAVE(c, maxPlanningTime);
+    MCP_SAVE(c, stopAtFirstSolution);
+    MCP_SAVE(c, bidirectional);
+    MCP_SAVE(c, bidirectionalConnectCandidates);
+    MCP_SAVE(c, coarseGridGuidance);
+    MCP_SAVE(c, coarseGridResolution);
+    MCP_SAVE(c, corridorWidth);
+    MCP_SAVE(c, corridorSamplingProbability);
 
     return c;
 }
@@ -44,14 +67,35 @@ void TPS_RRTstar_Parameters::load_from_yaml(const mrpt::containers::yaml& c)
     MCP_LOAD_OPT(c, minStepLength);
     MCP_LOAD_OPT(c, maxStepLength);
     MCP_LOAD_OPT(c, maxIterations);
+    MCP_LOAD_OPT(c, searchRadiusGamma);
+    MCP_LOAD_OPT(c, minSearchRadius);
+    MCP_LOAD_OPT(c, maxNeighbors);
     MCP_LOAD_OPT(c, metricDistanceEpsilon);
     MCP_LOAD_OPT(c, SE2_metricAngleWeight);
+    MCP_LOAD_OPT(c, ptgDynStateLinearVelQuantization);
+    MCP_LOAD_OPT_DEG(c, ptgDynStateAngularVelQuantization);
     MCP_LOAD_OPT(c, drawInTPS);
     MCP_LOAD_OPT(c, drawBiasTowardsGoal);
+    if (c.has("samplingSequence"))
+        samplingSequence =
+            mrpt::typemeta::TEnumType<SamplingSequence>::name2value(
+                c["samplingSequence"].as<std::string>());
     MCP_LOAD_OPT_DEG(c, headingToleranceGenerate);
     MCP_LOAD_OPT_DEG(c, headingToleranceMetric);
     MCP_LOAD_OPT(c, pathInterpolatedSegments);
     MCP_LOAD_OPT(c, saveDebugVisualizationDecimation);
+    MCP_LOAD_OPT(c, maxDrawAttempts);
+    MCP_LOAD_OPT(c, proposalBinsPerPTG);
+    MCP_LOAD_OPT(c, minProposalWeight);
+    random_seed_from_yaml(c, randomSeed);
+    MCP_LOAD_OPT(c, maxPlanningTime);
+    MCP_LOAD_OPT(c, stopAtFirstSolution);
+    MCP_LOAD_OPT(c, bidirectional);
+    MCP_LOAD_OPT(c, bidirectionalConnectCandidates);
+    MCP_LOAD_OPT(c, coarseGridGuidance);
+    MCP_LOAD_OPT(c, coarseGridResolution);
+    MCP_LOAD_OPT(c, corridorWidth);
+    MCP_LOAD_OPT(c, corridorSamplingProbability);
 }
 
 TPS_RRTstar_Parameters TPS_RRTstar_Parameters::FromYAML(
@@ -89,7 +133,14 @@ TPS_RRTstar_Parameters TPS_RRTstar_Parameters::FromYAML(
  */
 // clang-format on
 
-TPS_RRTstar::TPS_RRTstar() : mrpt::system::COutputLogger("TPS_RRTstar") {}
+IMPLEMENTS_MRPT_OBJECT(TPS_RRTstar, Planner, selfdriving)
+
+TPS_RRTstar::TPS_RRTstar() : Planner("TPS_RRTstar") {}
+
+// The neighbors of each new sample are searched for once per iteration,
+// within a slightly larger radius than searchRadius, since the actual new
+// node (the end of a PTG path) may not exactly coincide with the sample:
+static constexpr double NEIGHBORHOOD_RADIUS_MARGIN = 1.2;
 
 static bool within_bbox(
     const mrpt::math::TPose2D& p, const mrpt::math::TPose2D& max,
@@ -104,17 +155,57 @@ PlannerOutput TPS_RRTstar::plan(const PlannerInput& in)
     MRPT_START
     mrpt::system::CTimeLoggerEntry tleg(profiler_, "plan");
 
+    const auto tStart = mrpt::Clock::now();
+
     // Sanity checks on inputs:
     ASSERT_(in.ptgs.initialized());
     ASSERT_(in.worldBboxMin != in.worldBboxMax);
     ASSERT_(within_bbox(in.stateStart.pose, in.worldBboxMax, in.worldBboxMin));
     ASSERT_(within_bbox(in.stateGoal.pose, in.worldBboxMax, in.worldBboxMin));
+    for (const auto& g : in.extraGoals)
+        ASSERT_(within_bbox(g.state.pose, in.worldBboxMax, in.worldBboxMin));
 
     PlannerOutput po;
     po.originalInput = in;
 
     auto& tree = po.motionTree;  // shortcut
 
+    // Seed our own random generator, so plans are reproducible and
+    // independent of other planners running in parallel:
+    po.randomSeed = actual_random_seed(params_.randomSeed);
+    rng_.randomize(po.randomSeed);
+    MRPT_LOG_DEBUG_STREAM("plan(): using randomSeed=" << po.randomSeed);
+
+    euclideanSequence_.reset();
+    tpsSequence_.reset();
+    if (params_.samplingSequence != SamplingSequence::Random)
+    {
+        std::optional<uint32_t> scrambleSeed;
+        if (params_.samplingSequence == SamplingSequence::ScrambledHalton)
+            scrambleSeed = po.randomSeed;
+
+        euclideanSequence_.emplace(3, scrambleSeed);
+        tpsSequence_.emplace(4, scrambleSeed);
+    }
+
+    planDeadline_.reset();
+    if (params_.maxPlanningTime > 0)
+        planDeadline_ =
+            tStart + std::chrono::microseconds(static_cast<int64_t>(
+                         params_.maxPlanningTime * 1e6));
+
+    proposalBins_.assign(in.ptgs.ptgs.size(), {});
+    for (auto& bins : proposalBins_) bins.resize(params_.proposalBinsPerPTG);
+
+    nodeIndices_.clear();
+
+    // PTGs may have been used by someone else since our last call:
+    ptgDynStateCache_.clear();
+    ptgDynStateCache_.linearVelocityQuantization =
+        params_.ptgDynStateLinearVelQuantization;
+    ptgDynStateCache_.angularVelocityQuantization =
+        params_.ptgDynStateAngularVelQuantization;
+
     // clipping dist for all ptgs:
     double MAX_XY_DIST = 0;
     for (const auto& ptg : in.ptgs.ptgs)
@@ -145,27 +236,122 @@ PlannerOutput TPS_RRTstar::plan(const PlannerInput& in)
             tree.root, goalNodeId, in.stateGoal, dummyEdge);
     }
 
-    // Dynamic search radius:
+    // Dynamic search radius (updated at each iteration, see searchRadiusGamma):
     double searchRadius = params_.initialSearchRadius;
 
-    // Prepare draw params:
-    const DrawFreePoseParams drawParams(in, tree, searchRadius, goalNodeId);
-
     // obstacles (TODO: dynamic over future time?):
     std::vector<mrpt::maps::CPointsMap::Ptr> obstaclePoints;
     for (const auto& os : in.obstacles)
         if (os) obstaclePoints.emplace_back(os->obstacles());
 
+    // Hierarchical planning: coarse grid search first
+    std::shared_ptr<const CostToGoField> costToGo, costToGoBound;
+    PlanningCorridor                     corridor;
+    if (params_.coarseGridGuidance)
+    {
+        mrpt::system::CTimeLoggerEntry tle(profiler_, "plan.coarse_grid");
+
+        // The corridor and goal bias follow the path with obstacles inflated
+        // by the robot radius, but pruning must rely on a lower bound of the
+        // cost, hence the non-inflated field:
+        costToGo = cost_to_go_field(in, params_.coarseGridResolution);
+        costToGoBound =
+            cost_to_go_field(in, params_.coarseGridResolution, false);
+
+        corridor = PlanningCorridor::FromPath(
+            costToGo->path_from({in.stateStart.pose.x, in.stateStart.pose.y}),
+            params_.corridorWidth, params_.coarseGridResolution);
+
+        if (corridor.empty())
+            MRPT_LOG_WARN(
+                "Coarse grid search found no path to goal: sampling over "
+                "the whole world bbox");
+    }
+
+    // Prepare draw params:
+    const DrawFreePoseParams drawParams(
+        in, tree, searchRadius, goalNodeId, costToGo.get(),
+        costToGoBound.get(), corridor.empty() ? nullptr : &corridor);
+
+    // Bidirectional search: reverse tree, rooted at the goal:
+    MotionPrimitivesTreeSE2 goalTree;
+    if (params_.bidirectional)
+        goalTree.insert_root_node(goalTree.next_free_node_ID(), in.stateGoal);
+
+    // Returns the IDs of the (up to) N nodes in `t` nearest to `p`:
+    const auto lambdaNearestIds = [&](const MotionPrimitivesTreeSE2& t,
+                                      const mrpt::math::TPose2D&     p) {
+        std::vector<TNodeID> ids;
+        for (const auto& [d, node] : find_nearby_nodes(t, p, searchRadius))
+        {
+            if (ids.size() >= params_.bidirectionalConnectCandidates) break;
+            if (&t == &tree && node.get().nodeID_ == goalNodeId) continue;
+            ids.push_back(node.get().nodeID_);
+        }
+        return ids;
+    };
+
     //  3  |  for i \in [1,N] do
     for (size_t rrtIter = 0; rrtIter < params_.maxIterations; rrtIter++)
     {
+        // Stop conditions other than the number of iterations:
+        if (cancellationToken_.cancelled())
+        {
+            MRPT_LOG_DEBUG_STREAM("iter: " << rrtIter << ", cancelled.");
+            break;
+        }
+        if (params_.maxPlanningTime > 0 &&
+            mrpt::system::timeDifference(tStart, mrpt::Clock::now()) >
+                params_.maxPlanningTime)
+        {
+            MRPT_LOG_DEBUG_STREAM("iter: " << rrtIter << ", time out.");
+            break;
+        }
+
         mrpt::system::CTimeLoggerEntry tle1(profiler_, "plan.iter");
 
+        // Dynamic search radius, shrinking with the tree size:
+        if (params_.searchRadiusGamma > 0)
+        {
+            const double n = static_cast<double>(tree.nodes().size());
+            searchRadius   = std::max(
+                params_.minSearchRadius,
+                std::min(
+                    params_.initialSearchRadius,
+                    params_.searchRadiusGamma *
+                        std::pow(std::log(n) / n, 1.0 / 3.0)));
+        }
+
+        // Bidirectional search: grow the reverse tree and try to reach the
+        // new node from the main tree:
+        if (params_.bidirectional)
+        {
+            if (const auto revId = extend_reverse_tree(
+                    goalTree, in, obstaclePoints, MAX_XY_DIST, searchRadius);
+                revId.has_value())
+            {
+                const auto& revPose = goalTree.nodes().at(*revId).pose;
+                for (const TNodeID id : lambdaNearestIds(tree, revPose))
+                {
+                    if (connect_to_reverse_tree(
+                            tree, id, goalTree, *revId, goalNodeId, in,
+                            obstaclePoints, MAX_XY_DIST, searchRadius))
+                        break;
+                }
+            }
+        }
+
         // 4  |   q_i ← SAMPLE( Q_free )
         // ------------------------------------------------------------------
         // (TODO: What about dynamic obstacles that depend on time?)
-        const auto [qi, qiExistingID, qiNearbyNodes] =
-            draw_random_free_pose(drawParams);
+        const auto drawn = draw_random_free_pose(drawParams);
+        po.drawAttempts += drawAttempts_;
+        if (!drawn)
+        {
+            po.drawFailures++;
+            continue;
+        }
+        const auto& [qi, qiExistingID, qiNearbyNodes] = *drawn;
 
         //  5  |   {x_best, x_i} ← argmin{x ∈ Tree | cost[x, q_i ] < r ∧
         //  CollisionFree(pi(x,q_i)}( cost[x] + cost[x,x_i] )
@@ -180,15 +366,35 @@ PlannerOutput TPS_RRTstar::plan(const PlannerInput& in)
         std::optional<cost_t>          bestCost;
         size_t                         nValidCandidateSourceNodes = 0;
 
+        // Evaluate candidates by increasing lower bound of their cost
+        // (cost-to-come plus PTG distance), so we can stop as soon as no
+        // remaining candidate can beat the best one found so far:
+        std::vector<std::pair<cost_t, path_to_nodes_list_t::mapped_type>>
+            candidates;
         for (const auto& tupl : closeNodes)
         {
-            // std::tuple<TNodeID, ptg_index_t, trajectory_index_t, distance_t>
-            const auto [nodeId, ptgIdx, trajIdx, trajDist] = tupl.second;
+            const TNodeID nodeId = std::get<0>(tupl.second);
 
             // Do not pick "goal" as source node (!), only as target, in the
             // next rewiring step:
             if (nodeId == goalNodeId) continue;
 
+            candidates.emplace_back(
+                tree.nodes().at(nodeId).cost_ + std::get<3>(tupl.second),
+                tupl.second);
+        }
+        std::stable_sort(
+            candidates.begin(), candidates.end(),
+            [](const auto& a, const auto& b) { return a.first < b.first; });
+
+        for (const auto& [lowerBoundCost, tupl] : candidates)
+        {
+            if (bestCost.has_value() && *bestCost <= lowerBoundCost) break;
+            if (cannot_improve_solution(drawParams, qi, lowerBoundCost)) break;
+
+            // std::tuple<TNodeID, ptg_index_t, trajectory_index_t, distance_t>
+            const auto [nodeId, ptgIdx, trajIdx, trajDist] = tupl;
+
             // Only nodes sufficiently apart from each other:
             // const distance_t dist = tupl.first;
 
@@ -204,7 +410,7 @@ PlannerOutput TPS_RRTstar::plan(const PlannerInput& in)
             (ds.curVelLocal = srcNode.vel).rotate(-srcNode.pose.phi);
             ds.relTarget      = qi - srcNode.pose;
             ds.targetRelSpeed = 1.0;
-            ptg.updateNavDynamicState(ds);
+            ptgDynStateCache_.update(ptg, ds);
 
             const distance_t freeDistance =
                 tp_obstacles_single_path(trajIdx, *localObstacles, ptg);
@@ -249,19 +455,8 @@ PlannerOutput TPS_RRTstar::plan(const PlannerInput& in)
             tentativeEdge.targetRelSpeed = ds.targetRelSpeed;
             tentativeEdge.stateFrom      = srcNode;
             tentativeEdge.stateTo        = x_i;
-            // interpolated path:
-            if (const auto nSeg = params_.pathInterpolatedSegments; nSeg > 0)
-            {
-                auto& ip = tentativeEdge.interpolatedPath.emplace();
-                ip.emplace_back(0, 0, 0);  // fixed
-                // interpolated:
-                for (size_t i = 0; i < nSeg; i++)
-                {
-                    const auto iStep = ((i + 1) * ptg_step) / (nSeg + 2);
-                    ip.emplace_back(ptg.getPathPose(trajIdx, iStep));
-                }
-                ip.emplace_back(reconstrRelPose);  // already known
-            }
+            interpolate_edge(
+                tentativeEdge, ptg, ptg_step, params_.pathInterpolatedSegments);
 
             // Let's compute its cost:
             tentativeEdge.cost = cost_path_segment(tentativeEdge);
@@ -343,7 +538,7 @@ PlannerOutput TPS_RRTstar::plan(const PlannerInput& in)
             MRPT_TODO("Include target node speed!");
             ds.relTarget      = {1.0, 0, 0};
             ds.targetRelSpeed = 1.0;
-            ptg.updateNavDynamicState(ds);
+            ptgDynStateCache_.update(ptg, ds);
 
             const distance_t freeDistance =
                 tp_obstacles_single_path(trajIdx, *localObstaclesNewNode, ptg);
@@ -386,19 +581,8 @@ PlannerOutput TPS_RRTstar::plan(const PlannerInput& in)
             rewiredEdge.targetRelSpeed = ds.targetRelSpeed;
             rewiredEdge.stateFrom      = newNodeState;
             rewiredEdge.stateTo        = trgNode;
-            // interpolated path:
-            if (const auto nSeg = params_.pathInterpolatedSegments; nSeg > 0)
-            {
-                auto& ip = rewiredEdge.interpolatedPath.emplace();
-                ip.emplace_back(0, 0, 0);  // fixed
-                // interpolated:
-                for (size_t i = 0; i < nSeg; i++)
-                {
-                    const auto iStep = ((i + 1) * ptg_step) / (nSeg + 2);
-                    ip.emplace_back(ptg.getPathPose(trajIdx, iStep));
-                }
-                ip.emplace_back(reconstrRelPose);  // already known
-            }
+            interpolate_edge(
+                rewiredEdge, ptg, ptg_step, params_.pathInterpolatedSegments);
 
             // Let's compute the tentative cost of rewiring the tree
             // such that `srcNode` is more easily reachable from `newNode`:
@@ -417,6 +601,20 @@ PlannerOutput TPS_RRTstar::plan(const PlannerInput& in)
             }
         }
 
+        // Bidirectional search: try to reach the reverse tree from the new
+        // node:
+        if (params_.bidirectional)
+        {
+            const auto& newPose = tree.nodes().at(newNodeId).pose;
+            for (const TNodeID revId : lambdaNearestIds(goalTree, newPose))
+            {
+                if (connect_to_reverse_tree(
+                        tree, newNodeId, goalTree, revId, goalNodeId, in,
+                        obstaclePoints, MAX_XY_DIST, searchRadius))
+                    break;
+            }
+        }
+
         const auto goalCost = tree.nodes().at(goalNodeId).cost_;
 
         MRPT_LOG_DEBUG_FMT(
@@ -443,6 +641,10 @@ PlannerOutput TPS_RRTstar::plan(const PlannerInput& in)
                 static_cast<unsigned int>(rrtIter)));
         }
 
+        if (params_.stopAtFirstSolution &&
+            goalCost != std::numeric_limits<cost_t>::max())
+            break;
+
     }  // for each rrtIter
 
     // RRT ended, now collect the result:
@@ -462,98 +664,151 @@ PlannerOutput TPS_RRTstar::plan(const PlannerInput& in)
 
     po.pathCost = tree.nodes().at(goalNodeId).cost_;
 
+    po.update_extra_goal_results();
+
+    po.computationTime =
+        mrpt::system::timeDifference(tStart, mrpt::Clock::now());
+
+    for (size_t i = 0; i < po.extraGoals.size(); i++)
+    {
+        MRPT_LOG_DEBUG_FMT(
+            "Extra goal #%u: success=%s pathCost=%f",
+            static_cast<unsigned int>(i),
+            po.extraGoals[i].success ? "YES" : "NO",
+            po.extraGoals[i].pathCost);
+    }
+
+    if (params_.bidirectional)
+    {
+        MRPT_LOG_DEBUG_FMT(
+            "Bidirectional search: reverse tree has %u nodes",
+            static_cast<unsigned int>(goalTree.nodes().size()));
+    }
+
+    MRPT_LOG_DEBUG_FMT(
+        "Sampling: %u attempts, %u iterations without valid samples",
+        static_cast<unsigned int>(po.drawAttempts),
+        static_cast<unsigned int>(po.drawFailures));
+
+    MRPT_LOG_DEBUG_FMT(
+        "PTG dynamic state cache: %u hits, %u misses",
+        static_cast<unsigned int>(ptgDynStateCache_.hits()),
+        static_cast<unsigned int>(ptgDynStateCache_.misses()));
+
     return po;
     MRPT_END
 }
 
-void TPS_RRTstar::transform_pc_square_clipping(
-    const mrpt::maps::CPointsMap& inMap, const mrpt::poses::CPose2D& asSeenFrom,
-    const double MAX_DIST_XY, mrpt::maps::CPointsMap& outMap,
-    bool appendToOutMap)
+bool TPS_RRTstar::draw_budget_exhausted(size_t attempt) const
 {
-    size_t       nObs;
-    const float *obs_xs, *obs_ys, *obs_zs;
-    inMap.getPointsBuffer(nObs, obs_xs, obs_ys, obs_zs);
+    if (attempt >= params_.maxDrawAttempts) return true;
 
-    if (!appendToOutMap) outMap.clear();
-    // Prealloc mem for speed-up
-    outMap.reserve(nObs);
+    // Do not query the clock too often:
+    return planDeadline_ && (attempt % 64) == 63 &&
+           mrpt::Clock::now() > *planDeadline_;
+}
 
-    const mrpt::poses::CPose2D invPose = -asSeenFrom;
-    // We can safely discard the rest of obstacles, since they cannot be
-    // converted into TP-Obstacles anyway!
+double TPS_RRTstar::proposal_weight(const ProposalBin& b) const
+{
+    // Laplace-smoothed rate of valid samples:
+    const double rate = (b.successes + 1.0) / (b.successes + b.failures + 2.0);
+    return std::max(params_.minProposalWeight, rate);
+}
 
-    for (size_t obs = 0; obs < nObs; obs++)
+trajectory_index_t TPS_RRTstar::draw_trajectory_index(
+    ptg_index_t ptgIdx, size_t trajCount, double u) const
+{
+    const auto& bins = proposalBins_.at(ptgIdx);
+    if (bins.empty())
+        return static_cast<trajectory_index_t>(
+            std::min(trajCount - 1, static_cast<size_t>(u * trajCount)));
+
+    // Inverse of the cumulative distribution over bins, then uniform within
+    // the bin. This keeps the properties of low-discrepancy sequences.
+    double total = 0;
+    for (const auto& b : bins) total += proposal_weight(b);
+
+    double       target = u * total;
+    const size_t nBins  = bins.size();
+    for (size_t i = 0; i < nBins; i++)
     {
-        const double gx = obs_xs[obs], gy = obs_ys[obs];
-
-        if (std::abs(gx - asSeenFrom.x()) > MAX_DIST_XY ||
-            std::abs(gy - asSeenFrom.y()) > MAX_DIST_XY)
+        const double w = proposal_weight(bins[i]);
+        if (target >= w && i + 1 < nBins)
         {
-            // ignore this obstacle: anyway, I don't know how to map it to
-            // TP-Obs!
+            target -= w;
             continue;
         }
-
-        double ox, oy;
-        invPose.composePoint(gx, gy, ox, oy);
-
-        outMap.insertPointFast(ox, oy, 0);
+        const double frac = std::min(std::max(target / w, 0.0), 1.0 - 1e-9);
+        return static_cast<trajectory_index_t>(std::min(
+            trajCount - 1,
+            static_cast<size_t>((i + frac) * trajCount / nBins)));
     }
+    return static_cast<trajectory_index_t>(trajCount - 1);  // Never reached
 }
 
-distance_t TPS_RRTstar::tp_obstacles_single_path(
-    const trajectory_index_t      tp_space_k_direction,
-    const mrpt::maps::CPointsMap& localObstacles, const ptg_t& ptg)
+void TPS_RRTstar::update_proposal(
+    ptg_index_t ptgIdx, trajectory_index_t trajIdx, size_t trajCount,
+    bool success)
 {
-    MRPT_START
-    // Take "k_rand"s and "distances" such that the collision hits the
-    // obstacles
-    // in the "grid" of the given PT
-    // --------------------------------------------------------------------
-    size_t       nObs;
-    const float *obs_xs, *obs_ys, *obs_zs;
-    localObstacles.getPointsBuffer(nObs, obs_xs, obs_ys, obs_zs);
-
-    // Init obs ranges:
-    normalized_distance_t out_TPObstacle_k = 0;
-    ptg.initTPObstacleSingle(tp_space_k_direction, out_TPObstacle_k);
-
-    for (size_t obs = 0; obs < nObs; obs++)
-    {
-        const float ox = obs_xs[obs];
-        const float oy = obs_ys[obs];
+    auto& bins = proposalBins_.at(ptgIdx);
+    if (bins.empty()) return;
 
-        ptg.updateTPObstacleSingle(
-            ox, oy, tp_space_k_direction, out_TPObstacle_k);
-    }
+    const size_t binIdx =
+        static_cast<size_t>(trajIdx) * bins.size() / trajCount;
 
-    // Leave distances in out_TPObstacles un-normalized, so they
-    // just represent real distances in "pseudo-meters".
-    return out_TPObstacle_k;
-
-    MRPT_END
+    auto& b = bins.at(std::min(bins.size() - 1, binIdx));
+    if (success)
+        b.successes++;
+    else
+        b.failures++;
 }
 
-TPS_RRTstar::draw_pose_return_t TPS_RRTstar::draw_random_free_pose(
-    const TPS_RRTstar::DrawFreePoseParams& p)
+std::optional<TPS_RRTstar::draw_pose_return_t>
+    TPS_RRTstar::draw_random_free_pose(const TPS_RRTstar::DrawFreePoseParams& p)
 {
     auto tle =
         mrpt::system::CTimeLoggerEntry(profiler_, "draw_random_free_pose");
 
-    if (params_.drawInTPS)
-        return draw_random_tps(p);
-    else
-        return draw_random_euclidean(p);
+    drawAttempts_ = 0;
+
+    auto ret =
+        params_.drawInTPS ? draw_random_tps(p) : draw_random_euclidean(p);
+
+    profiler_.registerUserMeasure(
+        "draw_random_free_pose.attempts", drawAttempts_);
+
+    if (!ret)
+    {
+        MRPT_LOG_DEBUG_STREAM(
+            "Could not draw collision-free random pose after "
+            << drawAttempts_ << " attempts");
+        return {};
+    }
+
+    // k-nearest cap, always keeping the goal as a candidate for REWIRE:
+    if (params_.maxNeighbors > 0)
+    {
+        auto&  nearbyNodes = std::get<2>(*ret);
+        size_t count       = 0;
+        for (auto it = nearbyNodes.begin(); it != nearbyNodes.end();)
+        {
+            if (count++ < params_.maxNeighbors ||
+                it->second.get().nodeID_ == p.goalNodeId_)
+                ++it;
+            else
+                it = nearbyNodes.erase(it);
+        }
+    }
+    return ret;
 }
 
-TPS_RRTstar::draw_pose_return_t TPS_RRTstar::draw_random_euclidean(
-    const TPS_RRTstar::DrawFreePoseParams& p)
+std::optional<TPS_RRTstar::draw_pose_return_t>
+    TPS_RRTstar::draw_random_euclidean(const TPS_RRTstar::DrawFreePoseParams& p)
 {
     auto tle = mrpt::system::CTimeLoggerEntry(
         profiler_, "draw_random_free_pose.euclidean");
 
-    auto& rng = mrpt::random::getRandomGenerator();
+    auto& rng = rng_;
 
     std::vector<mrpt::maps::CPointsMap::Ptr> obstacles;
     for (const auto& os : p.pi_.obstacles)
@@ -563,17 +818,34 @@ TPS_RRTstar::draw_pose_return_t TPS_RRTstar::draw_random_euclidean(
     const auto& bbMin = p.pi_.worldBboxMin;
     const auto& bbMax = p.pi_.worldBboxMax;
 
-    const size_t maxAttempts = 1000000;
-    for (size_t attempt = 0; attempt < maxAttempts; attempt++)
+    for (size_t attempt = 0; !draw_budget_exhausted(attempt); attempt++)
     {
+        drawAttempts_++;
+
         // tentative pose:
-        const auto q = mrpt::math::TPose2D(
-            rng.drawUniform(bbMin.x, bbMax.x),
-            rng.drawUniform(bbMin.y, bbMax.y),
-            rng.drawUniform(bbMin.phi, bbMax.phi));
+        const auto u = draw_unit_sample<3>(euclideanSequence_);
 
-        closest_lie_nodes_list_t closeNodes =
-            find_nearby_nodes(p.tree_, q, p.searchRadius_ * 1.2);
+        auto q = mrpt::math::TPose2D(
+            bbMin.x + u[0] * (bbMax.x - bbMin.x),
+            bbMin.y + u[1] * (bbMax.y - bbMin.y),
+            bbMin.phi + u[2] * (bbMax.phi - bbMin.phi));
+
+        if (p.corridor_ &&
+            rng.drawUniform(0.0, 1.0) < params_.corridorSamplingProbability)
+        {
+            const auto pt = p.corridor_->draw_uniform(rng);
+            q.x           = pt.x;
+            q.y           = pt.y;
+            if (!within_bbox(q, bbMax, bbMin)) continue;
+        }
+
+        const auto& start = p.pi_.stateStart.pose;
+        if (cannot_improve_solution(
+                p, q, std::hypot(q.x - start.x, q.y - start.y)))
+            continue;
+
+        closest_lie_nodes_list_t closeNodes = find_nearby_nodes(
+            p.tree_, q, p.searchRadius_ * NEIGHBORHOOD_RADIUS_MARGIN);
 
         const double minFoundDistance = closeNodes.empty()
                                             ? params_.metricDistanceEpsilon
@@ -585,7 +857,7 @@ TPS_RRTstar::draw_pose_return_t TPS_RRTstar::draw_random_euclidean(
             // Return a match with an existing node ID:
             const auto existingId = closeNodes.begin()->second.get().nodeID_;
             closeNodes.erase(closeNodes.begin());
-            return {q, existingId, closeNodes};
+            return draw_pose_return_t(q, existingId, closeNodes);
         }
 
         // TODO: More flexible check? Variable no. of points?
@@ -606,29 +878,37 @@ TPS_RRTstar::draw_pose_return_t TPS_RRTstar::draw_random_euclidean(
                 break;
             }
         }
-        if (!isCollision) return {q, std::nullopt, closeNodes};
+        if (!isCollision)
+            return draw_pose_return_t(q, std::nullopt, closeNodes);
     }
-    THROW_EXCEPTION("Could not draw collision-free random pose!");
+    return {};
 }
 
-TPS_RRTstar::draw_pose_return_t TPS_RRTstar::draw_random_tps(
+std::optional<TPS_RRTstar::draw_pose_return_t> TPS_RRTstar::draw_random_tps(
     const TPS_RRTstar::DrawFreePoseParams& p)
 {
     auto tle =
         mrpt::system::CTimeLoggerEntry(profiler_, "draw_random_free_pose.tps");
 
-    auto& rng = mrpt::random::getRandomGenerator();
+    auto& rng = rng_;
 
     std::vector<mrpt::maps::CPointsMap::Ptr> obstacles;
     for (const auto& os : p.pi_.obstacles)
         if (os) obstacles.emplace_back(os->obstacles());
 
-    const size_t maxAttempts = 1000000;
-    for (size_t attempt = 0; attempt < maxAttempts; attempt++)
+    for (size_t attempt = 0; !draw_budget_exhausted(attempt); attempt++)
     {
+        drawAttempts_++;
+
         // draw source node, then ptg index, then trajectory index, then
         // distance:
-        const auto nodeIdx = rng.drawUniform32bit() % p.tree_.nodes().size();
+        const auto u = draw_unit_sample<4>(tpsSequence_);
+
+        const auto lambdaIndex = [](double v, size_t count) {
+            return std::min(count - 1, static_cast<size_t>(v * count));
+        };
+
+        const auto nodeIdx = lambdaIndex(u[0], p.tree_.nodes().size());
 
         // Cannot pick the dummy goal node as *start* pose, it's only a *final*
         // node:
@@ -636,7 +916,10 @@ TPS_RRTstar::draw_pose_return_t TPS_RRTstar::draw_random_tps(
 
         const auto& node = p.tree_.nodes().at(nodeIdx);
 
-        const auto  ptgIdx = rng.drawUniform32bit() % p.pi_.ptgs.ptgs.size();
+        // Do not expand nodes that cannot lead to a better solution:
+        if (cannot_improve_solution(p, node.pose, node.cost_)) continue;
+
+        const auto  ptgIdx = lambdaIndex(u[1], p.pi_.ptgs.ptgs.size());
         const auto& ptg    = p.pi_.ptgs.ptgs.at(ptgIdx);
 
         // Let the PTG know about the current local velocity:
@@ -644,7 +927,7 @@ TPS_RRTstar::draw_pose_return_t TPS_RRTstar::draw_random_tps(
         (ds.curVelLocal = node.vel).rotate(-node.pose.phi);
         ds.relTarget      = {1.0, 0, 0};
         ds.targetRelSpeed = 1.0;
-        ptg->updateNavDynamicState(ds);
+        ptgDynStateCache_.update(*ptg, ds);
 
         // Select trajectory:
         constexpr auto invalidTrajIdx =
@@ -654,8 +937,29 @@ TPS_RRTstar::draw_pose_return_t TPS_RRTstar::draw_random_tps(
 
         if (rng.drawUniform(0.0, 1.0) < params_.drawBiasTowardsGoal)
         {
-            // Bias towards goal:
-            const auto relGoalPose = p.pi_.stateGoal.pose - node.pose;
+            // Bias towards goal, or any of the extra goals. With a cost-to-go
+            // field, aim at a point ahead along its path instead, to go
+            // around walls:
+            const auto& extraGoals = p.pi_.extraGoals;
+            const auto  goalIdx =
+                extraGoals.empty()
+                    ? 0
+                    : rng.drawUniform32bit() % (extraGoals.size() + 1);
+
+            const auto& goalPose = goalIdx == 0
+                                       ? p.pi_.stateGoal.pose
+                                       : extraGoals[goalIdx - 1].state.pose;
+
+            mrpt::math::TPoint2D target(goalPose.x, goalPose.y);
+            if (p.costToGo_ && goalIdx == 0)
+            {
+                if (const auto pt = p.costToGo_->lookahead_point(
+                        {node.pose.x, node.pose.y}, params_.maxStepLength);
+                    pt)
+                    target = *pt;
+            }
+
+            const auto relGoalPose = node.pose.inverseComposePoint(target);
             int        relTrg_k;
             double     relTrg_d;
             if (ptg->inverseMap_WS2TP(
@@ -666,20 +970,28 @@ TPS_RRTstar::draw_pose_return_t TPS_RRTstar::draw_random_tps(
             }
         }
 
+        const size_t trajCount = ptg->getAlphaValuesCount();
+
         if (trajIdx == invalidTrajIdx)
         {
-            // Draw random direction:
-            trajIdx = rng.drawUniform32bit() % ptg->getAlphaValuesCount();
+            // Draw random direction, from the adaptive proposal:
+            trajIdx = draw_trajectory_index(ptgIdx, trajCount, u[2]);
         }
 
-        const auto trajDist = rng.drawUniform(
-            params_.minStepLength,
-            std::min(params_.maxStepLength, p.searchRadius_));
+        const double maxDist =
+            std::min(params_.maxStepLength, p.searchRadius_);
+        const auto trajDist =
+            params_.minStepLength + u[3] * (maxDist - params_.minStepLength);
 
         // Predict the path segment:
         uint32_t ptg_step;
         bool     stepOk = ptg->getPathStepForDist(trajIdx, trajDist, ptg_step);
-        if (!stepOk) continue;  // No solution with this ptg
+        if (!stepOk)
+        {
+            // No solution with this ptg
+            update_proposal(ptgIdx, trajIdx, trajCount, false);
+            continue;
+        }
 
         const auto reconstrRelPose = ptg->getPathPose(trajIdx, ptg_step);
 
@@ -692,27 +1004,16 @@ TPS_RRTstar::draw_pose_return_t TPS_RRTstar::draw_random_tps(
             q.y > p.pi_.worldBboxMax.y || q.phi > p.pi_.worldBboxMax.phi)
         {
             // Out of allowed space:
+            update_proposal(ptgIdx, trajIdx, trajCount, false);
             continue;
         }
 
-        // Check: minimum distance to any other pose:
-        // In this case, do NOT use TPS, but the real SE(2) metric space,
-        // to avoid the lack of existing paths to hide nodes that are really
-        // close to this tentative pose sample:
-
-        closest_lie_nodes_list_t closeNodes =
-            find_nearby_nodes(p.tree_, q, p.searchRadius_);
-
-        // Match with existing node?
-        if (!closeNodes.empty() &&
-            closeNodes.begin()->first < params_.metricDistanceEpsilon)
-        {
-            // Return the ID of the existing node so we can reconsider it:
-            const auto closestNodeId = closeNodes.begin()->second.get().nodeID_;
-            closeNodes.erase(closeNodes.begin());
+        // Coarse corridor and cost-to-go pruning:
+        if (p.corridor_ && !p.corridor_->contains({q.x, q.y}) &&
+            rng.drawUniform(0.0, 1.0) < params_.corridorSamplingProbability)
+            continue;
 
-            return {q, closestNodeId, closeNodes};
-        }
+        if (cannot_improve_solution(p, q, node.cost_ + trajDist)) continue;
 
         // Approximate check for collisions:
         // TODO: More flexible check? Variable no. of points?
@@ -734,16 +1035,265 @@ TPS_RRTstar::draw_pose_return_t TPS_RRTstar::draw_random_tps(
             }
         }
 
-        if (!isCollision)
+        update_proposal(ptgIdx, trajIdx, trajCount, !isCollision);
+
+        if (isCollision) continue;
+
+        // Ok, good sample has been drawn. Find its neighbors, only once for
+        // this iteration: EXTEND and REWIRE will reuse this list.
+        // In this case, do NOT use TPS, but the real SE(2) metric space,
+        // to avoid the lack of existing paths to hide nodes that are really
+        // close to this tentative pose sample:
+        closest_lie_nodes_list_t closeNodes = find_nearby_nodes(
+            p.tree_, q, p.searchRadius_ * NEIGHBORHOOD_RADIUS_MARGIN);
+
+        // Match with existing node?
+        if (!closeNodes.empty() &&
+            closeNodes.begin()->first < params_.metricDistanceEpsilon)
+        {
+            // Return the ID of the existing node so we can reconsider it:
+            const auto closestNodeId = closeNodes.begin()->second.get().nodeID_;
+            closeNodes.erase(closeNodes.begin());
+
+            return draw_pose_return_t(q, closestNodeId, closeNodes);
+        }
+
+        return draw_pose_return_t(q, std::nullopt, closeNodes);
+    }
+    return {};
+}
+
+PlannerOutput TPS_RRTstar::repair(
+    const PlannerOutput& previous, const mrpt::maps::CPointsMap& newObstacles)
+{
+    MRPT_START
+    mrpt::system::CTimeLoggerEntry tleg(profiler_, "repair");
+
+    const auto tStart = mrpt::Clock::now();
+
+    constexpr cost_t UNREACHABLE = std::numeric_limits<cost_t>::max();
+
+    PlannerOutput po         = previous;
+    const auto&   in         = po.originalInput;
+    auto&         tree       = po.motionTree;
+    const TNodeID goalNodeId = po.goalNodeId;
+
+    ASSERT_(in.ptgs.initialized());
+    ASSERT_(goalNodeId != INVALID_NODEID);
+
+    // PTGs may have been used by someone else, and obstacles have changed:
+    ptgDynStateCache_.clear();
+    ptgDynStateCache_.linearVelocityQuantization =
+        params_.ptgDynStateLinearVelQuantization;
+    ptgDynStateCache_.angularVelocityQuantization =
+        params_.ptgDynStateAngularVelQuantization;
+    local_obstacles_cache_.clear();
+    nodeIndices_.clear();
+
+    double MAX_XY_DIST = 0, maxRobotRadius = 0;
+    for (const auto& ptg : in.ptgs.ptgs)
+    {
+        mrpt::keep_max(MAX_XY_DIST, ptg->getRefDistance());
+        mrpt::keep_max(maxRobotRadius, ptg->getMaxRobotRadius());
+    }
+    ASSERT_(MAX_XY_DIST > 0);
+
+    auto newObs = mrpt::maps::CSimplePointsMap::Create();
+    newObs->insertAnotherMap(&newObstacles, mrpt::poses::CPose3D::Identity());
+
+    std::vector<mrpt::maps::CPointsMap::Ptr> obstaclePoints;
+    for (const auto& os : in.obstacles)
+        if (os) obstaclePoints.emplace_back(os->obstacles());
+    obstaclePoints.emplace_back(newObs);
+
+    // 1) Find edges whose swept path is blocked by the new obstacles:
+    // ---------------------------------------------------------------------
+    std::vector<TNodeID> blockedEdgesTo;
+    {
+        mrpt::system::CTimeLoggerEntry tle(profiler_, "repair.find_blocked");
+
+        const auto& xs = newObs->getPointsBufferRef_x();
+        const auto& ys = newObs->getPointsBufferRef_y();
+
+        // Bucket the new obstacles in a coarse grid, so each edge only
+        // looks at those around it:
+        const double cellSize = std::max(0.25 * MAX_XY_DIST, 0.5);  // [m]
+        mrpt::math::TPoint2D gridMin(0, 0);
+        int                  nCx = 0, nCy = 0;
+
+        const auto lambdaCellX = [&](const double x) {
+            return static_cast<int>(std::floor((x - gridMin.x) / cellSize));
+        };
+        const auto lambdaCellY = [&](const double y) {
+            return static_cast<int>(std::floor((y - gridMin.y) / cellSize));
+        };
+
+        if (!newObs->empty())
+        {
+            const auto bbox = newObs->boundingBox();
+            gridMin         = {bbox.min.x, bbox.min.y};
+            nCx             = lambdaCellX(bbox.max.x) + 1;
+            nCy             = lambdaCellY(bbox.max.y) + 1;
+        }
+
+        std::vector<std::vector<uint32_t>> grid(size_t(nCx) * nCy);
+        for (size_t i = 0; i < xs.size(); i++)
+            grid[lambdaCellX(xs[i]) + nCx * lambdaCellY(ys[i])].push_back(i);
+
+        mrpt::maps::CSimplePointsMap localObs;
+
+        for (const auto& [parentId, children] : tree.edges_to_children)
         {
-            // Ok, good sample has been drawn:
-            closest_lie_nodes_list_t closeNodes =
-                find_nearby_nodes(p.tree_, q, p.searchRadius_ * 1.2);
+            for (const auto& e : children)
+            {
+                const auto& edge = e.data;
+                if (edge.cost == UNREACHABLE) continue;  // e.g. dummy goal
+
+                // New obstacles within the swept circle, in the edge frame:
+                const auto&  from      = edge.stateFrom.pose;
+                const double maxDist   = edge.ptgDist + maxRobotRadius;
+                const double maxDistSq = mrpt::square(maxDist);
+
+                const int cx0 = std::max(0, lambdaCellX(from.x - maxDist));
+                const int cx1 =
+                    std::min(nCx - 1, lambdaCellX(from.x + maxDist));
+                const int cy0 = std::max(0, lambdaCellY(from.y - maxDist));
+                const int cy1 =
+                    std::min(nCy - 1, lambdaCellY(from.y + maxDist));
+
+                localObs.clear();
+                for (int cy = cy0; cy <= cy1; cy++)
+                {
+                    for (int cx = cx0; cx <= cx1; cx++)
+                    {
+                        for (const auto i : grid[cx + nCx * cy])
+                        {
+                            const double dx = xs[i] - from.x,
+                                         dy = ys[i] - from.y;
+                            if (dx * dx + dy * dy >= maxDistSq) continue;
+                            const auto p = from.inverseComposePoint(
+                                mrpt::math::TPoint2D(xs[i], ys[i]));
+                            localObs.insertPointFast(p.x, p.y, 0);
+                        }
+                    }
+                }
+                if (localObs.empty()) continue;
+
+                // Exact check along the PTG path:
+                auto&                   ptg = *in.ptgs.ptgs.at(edge.ptgIndex);
+                ptg_t::TNavDynamicState ds;
+                (ds.curVelLocal = edge.stateFrom.vel).rotate(-from.phi);
+                ds.relTarget      = {1.0, 0, 0};
+                ds.targetRelSpeed = 1.0;
+                ptgDynStateCache_.update(ptg, ds);
+
+                if (tp_obstacles_single_path(
+                        edge.ptgPathIndex, localObs, ptg) <= edge.ptgDist)
+                    blockedEdgesTo.push_back(e.id);
+            }
+        }
+    }
+    for (const auto id : blockedEdgesTo) tree.invalidate_edge_to(id);
+
+    // 2) Rewiring cascade: reattach unreachable nodes to the cheapest
+    // reachable parent nearby. Each reattached node makes its subtree
+    // reachable again, and may enable further reattachments.
+    // ---------------------------------------------------------------------
+    std::vector<TNodeID> orphans;
+    for (const auto& [id, node] : tree.nodes())
+        if (node.cost_ == UNREACHABLE) orphans.push_back(id);
+
+    const size_t numOrphans = orphans.size();
+    size_t       numRewired = 0;
+
+    for (bool progress = !orphans.empty(); progress;)
+    {
+        mrpt::system::CTimeLoggerEntry tle(profiler_, "repair.rewire_pass");
+
+        if (cancellationToken_.cancelled()) break;
+
+        progress = false;
+        for (const auto id : orphans)
+        {
+            // Already reachable via a reattached ancestor?
+            if (tree.nodes().at(id).cost_ != UNREACHABLE) continue;
+
+            const auto& node   = tree.nodes().at(id);
+            const bool  isGoal = (id == goalNodeId);
+
+            std::optional<MoveEdgeSE2_TPS> bestEdge;
+            cost_t                         bestCost = UNREACHABLE;
+
+            const auto nearby = find_nearby_nodes(
+                tree, node.pose, params_.initialSearchRadius);
+            for (const auto& [d, candidate] : nearby)
+            {
+                const auto& c = candidate.get();
+                // Unreachable candidates include all descendants of `id`,
+                // so no cycle can be formed:
+                if (c.cost_ == UNREACHABLE || c.nodeID_ == goalNodeId)
+                    continue;
+                if (c.cost_ >= bestCost) continue;
+
+                const auto edge = direct_edge_towards(
+                    tree, c.nodeID_, node.pose, isGoal, in.ptgs,
+                    obstaclePoints, MAX_XY_DIST, params_.initialSearchRadius);
+                if (!edge || c.cost_ + edge->cost >= bestCost) continue;
+
+                bestCost = c.cost_ + edge->cost;
+                bestEdge = edge;
+            }
+            if (!bestEdge) continue;
+
+            if (isGoal) bestEdge->stateTo = in.stateGoal;
+
+            tree.rewire_node_parent(id, *bestEdge);
+            tree.propagate_cost_to_descendants(id);
+            numRewired++;
+            progress = true;
+        }
+    }
 
-            return {q, std::nullopt, closeNodes};
+    // Collect the result:
+    // ---------------------------------------------------------------------
+    po.success = true;
+    for (const auto& step : tree.backtrack_path(goalNodeId))
+    {
+        if (step.cost_ == UNREACHABLE)
+        {
+            po.success = false;
+            break;
         }
     }
-    THROW_EXCEPTION("Could not draw collision-free random pose!");
+    po.pathCost = tree.nodes().at(goalNodeId).cost_;
+    po.update_extra_goal_results();
+    po.computationTime =
+        mrpt::system::timeDifference(tStart, mrpt::Clock::now());
+
+    MRPT_LOG_DEBUG_FMT(
+        "repair(): %u blocked edges, %u unreachable nodes, %u rewired, "
+        "success=%s",
+        static_cast<unsigned int>(blockedEdgesTo.size()),
+        static_cast<unsigned int>(numOrphans),
+        static_cast<unsigned int>(numRewired), po.success ? "YES" : "NO");
+
+    return po;
+    MRPT_END
+}
+
+bool TPS_RRTstar::cannot_improve_solution(
+    const DrawFreePoseParams& p, const mrpt::math::TPose2D& q,
+    const cost_t costToCome) const
+{
+    if (!p.costToGoBound_) return false;
+
+    // Samples useless for the main goal may still lead to the extra ones:
+    if (!p.pi_.extraGoals.empty()) return false;
+
+    const cost_t bestCost = p.tree_.nodes().at(p.goalNodeId_).cost_;
+    if (bestCost == std::numeric_limits<cost_t>::max()) return false;
+
+    return costToCome + p.costToGoBound_->heuristic({q.x, q.y}) > bestCost;
 }
 
 // See docs in .h
@@ -764,25 +1314,46 @@ TPS_RRTstar::path_to_nodes_list_t TPS_RRTstar::find_source_nodes_towards(
     ASSERT_(nPTGs >= 1);
 
     std::vector<PoseDistanceMetric_TPS<SE2_KinState>> distEvaluators;
-    for (auto& ptg : trs.ptgs)
-        distEvaluators.emplace_back(*ptg, params_.headingToleranceMetric);
+    for (size_t i = 0; i < nPTGs; i++)
+    {
+        distEvaluators.emplace_back(
+            *trs.ptgs.at(i), params_.headingToleranceMetric,
+            &ptgDynStateCache_,
+            i < trs.reachableRegions.size() ? &trs.reachableRegions.at(i)
+                                            : nullptr);
+    }
+
+    using metric_t = PoseDistanceMetric_TPS<SE2_KinState>;
 
     path_to_nodes_list_t closestNodes;
 
-    for (const auto& distNodeId : hintCloseNodes)
+    // Candidate source nodes, grouped by their (quantized) local velocity, so
+    // the TPS distances of each group can be evaluated as one batch:
+    // quantized local vel => list of (nodeId, relative pose of query)
+    std::map<
+        std::tuple<double, double, double>,
+        std::vector<std::pair<TNodeID, mrpt::math::TPose2D>>>
+        candidatesByVel;
+
+    std::vector<metric_t::batch_query_t>  queries;
+    std::vector<metric_t::batch_result_t> results;
+
+    for (ptg_index_t ptgIdx = 0; ptgIdx < distEvaluators.size(); ptgIdx++)
     {
-        const auto nodeId = distNodeId.second.get().nodeID_;
+        auto& de = distEvaluators.at(ptgIdx);
 
-        if (nodeId == goalNodeToIgnore) continue;  // ignore
+        candidatesByVel.clear();
+        for (const auto& distNodeId : hintCloseNodes)
+        {
+            const auto& [node, relQuery] = distNodeId.second;
+            const auto  nodeId             = node.get().nodeID_;
 
-        // Don't take into account too short segments:
-        // if (distNodeId.first < params_.minStepLength) continue;
+            if (nodeId == goalNodeToIgnore) continue;  // ignore
 
-        const SE2_KinState& nodeState = tree.nodes().at(nodeId);
+            // Don't take into account too short segments:
+            // if (distNodeId.first < params_.minStepLength) continue;
 
-        for (ptg_index_t ptgIdx = 0; ptgIdx < distEvaluators.size(); ptgIdx++)
-        {
-            auto& de = distEvaluators.at(ptgIdx);
+            const SE2_KinState& nodeState = tree.nodes().at(nodeId);
 
             // Skip the more expensive calculation of exact distance:
             if (de.cannotBeNearerThan(nodeState, query, maxDistance))
@@ -791,32 +1362,49 @@ TPS_RRTstar::path_to_nodes_list_t TPS_RRTstar::find_source_nodes_towards(
                 continue;
             }
 
-            // Exact look up in the PTG manifold of poses:
-            const auto ret =
-                de.distance(nodeState, query, false /*dont ignore heading*/);
-            if (!ret.has_value())
-            {
-                // No exact solution with this ptg, skip:
-                continue;
-            }
-            const auto [distance, trajIndex] = *ret;
-            ASSERTMSG_(distance > 0, "Repeated pose node in tree?");
-
             if (nodeState.pose == query)
             {
-                std::cout << "repeated: dist=" << distance << "\n";
                 ASSERTMSG_(false, "Repeated pose node in tree? (bis)");
             }
 
-            if (distance > maxDistance)
+            const auto localVel = ptgDynStateCache_.quantized_velocity(
+                nodeState.vel.rotated(-nodeState.pose.phi));
+
+            // The relative pose was already computed in find_nearby_nodes():
+            candidatesByVel[{localVel.vx, localVel.vy, localVel.omega}]
+                .emplace_back(nodeId, relQuery);
+        }
+
+        for (const auto& [vel, candidates] : candidatesByVel)
+        {
+            queries.clear();
+            for (const auto& c : candidates)
+                queries.push_back({c.second, false /*dont ignore heading*/});
+
+            // Exact look up in the PTG manifold of poses:
+            const auto [vx, vy, omega] = vel;
+            de.distance_batch({vx, vy, omega}, queries, results);
+
+            for (size_t i = 0; i < candidates.size(); i++)
             {
-                // Too far, skip:
-                continue;
+                const auto& r = results.at(i);
+                if (!r.valid())
+                {
+                    // No exact solution with this ptg, skip:
+                    continue;
+                }
+                ASSERTMSG_(r.d > 0, "Repeated pose node in tree?");
+
+                if (r.d > maxDistance)
+                {
+                    // Too far, skip:
+                    continue;
+                }
+                // Ok, accept it:
+                closestNodes.emplace(
+                    r.d, path_to_nodes_list_t::mapped_type(
+                             candidates[i].first, ptgIdx, r.k, r.d));
             }
-            // Ok, accept it:
-            closestNodes.emplace(
-                distance, path_to_nodes_list_t::mapped_type(
-                              nodeId, ptgIdx, trajIndex, distance));
         }
     }
     return closestNodes;
@@ -839,34 +1427,51 @@ TPS_RRTstar::path_to_nodes_list_t TPS_RRTstar::find_reachable_nodes_from(
 
     const auto& query = nodes.at(queryNodeId);
 
-    MRPT_TODO("Build list of nearby nodes once between these two methods");
-
     // Prepare distance evaluators for each PTG:
     const auto nPTGs = trs.ptgs.size();
     ASSERT_(nPTGs >= 1);
 
     std::vector<PoseDistanceMetric_TPS<SE2_KinState>> distEvaluators;
-    for (auto& ptg : trs.ptgs)
-        distEvaluators.emplace_back(*ptg, params_.headingToleranceMetric);
+    for (size_t i = 0; i < nPTGs; i++)
+    {
+        distEvaluators.emplace_back(
+            *trs.ptgs.at(i), params_.headingToleranceMetric,
+            &ptgDynStateCache_,
+            i < trs.reachableRegions.size() ? &trs.reachableRegions.at(i)
+                                            : nullptr);
+    }
+
+    using metric_t = PoseDistanceMetric_TPS<SE2_KinState>;
 
     path_to_nodes_list_t closestNodes;
 
-    for (const auto& distNodeId : hintCloseNodes)
-    {
-        const auto& node   = distNodeId.second.get();
-        const auto  nodeId = node.nodeID_;
+    // All target nodes share the same source (query) velocity, so they are
+    // evaluated as a single batch per PTG:
+    const auto queryLocalVel = query.vel.rotated(-query.pose.phi);
 
-        const SE2_KinState& nodeState = node;
+    std::vector<TNodeID>                  candidateIds;
+    std::vector<metric_t::batch_query_t>  queries;
+    std::vector<metric_t::batch_result_t> results;
 
-        // Don't rewire to myself ;-)
-        if (nodeId == queryNodeId) continue;
+    for (ptg_index_t ptgIdx = 0; ptgIdx < distEvaluators.size(); ptgIdx++)
+    {
+        auto& de = distEvaluators.at(ptgIdx);
 
-        // Don't take into account too short segments:
-        if (distNodeId.first < params_.minStepLength) continue;
+        candidateIds.clear();
+        queries.clear();
 
-        for (ptg_index_t ptgIdx = 0; ptgIdx < distEvaluators.size(); ptgIdx++)
+        for (const auto& distNodeId : hintCloseNodes)
         {
-            auto& de = distEvaluators.at(ptgIdx);
+            const auto& node   = distNodeId.second.get();
+            const auto  nodeId = node.nodeID_;
+
+            const SE2_KinState& nodeState = node;
+
+            // Don't rewire to myself ;-)
+            if (nodeId == queryNodeId) continue;
+
+            // Don't take into account too short segments:
+            if (distNodeId.first < params_.minStepLength) continue;
 
             // Skip the more expensive calculation of exact distance:
             if (de.cannotBeNearerThan(query, nodeState.pose, maxDistance))
@@ -875,106 +1480,97 @@ TPS_RRTstar::path_to_nodes_list_t TPS_RRTstar::find_reachable_nodes_from(
                 continue;
             }
 
-            // Exact look up in the PTG manifold of poses:
-            MRPT_TODO("Target velocity not accounted for!!!");
-
             const bool ignoreNodeHeading =
                 nodeToIgnoreHeading.has_value() &&
                 nodeToIgnoreHeading.value() == nodeId;
 
-            const auto ret = de.distance(
-                /*from*/ query, /*to*/ nodeState.pose, ignoreNodeHeading);
-            if (!ret.has_value())
+            candidateIds.push_back(nodeId);
+            queries.push_back({nodeState.pose - query.pose, ignoreNodeHeading});
+        }
+
+        // Exact look up in the PTG manifold of poses:
+        MRPT_TODO("Target velocity not accounted for!!!");
+        de.distance_batch(queryLocalVel, queries, results);
+
+        for (size_t i = 0; i < candidateIds.size(); i++)
+        {
+            const auto& r = results.at(i);
+            if (!r.valid())
             {
                 // No exact solution with this ptg, skip:
                 continue;
             }
-            const auto [distance, trajIndex] = *ret;
-            ASSERTMSG_(distance > 0, "Repeated pose node in tree?");
+            ASSERTMSG_(r.d > 0, "Repeated pose node in tree?");
 
-            if (distance > maxDistance)
+            if (r.d > maxDistance)
             {
                 // Too far, skip:
                 continue;
             }
             // Ok, accept it:
             closestNodes.emplace(
-                distance, path_to_nodes_list_t::mapped_type(
-                              nodeId, ptgIdx, trajIndex, distance));
+                r.d, path_to_nodes_list_t::mapped_type(
+                         candidateIds[i], ptgIdx, r.k, r.d));
         }
     }
     return closestNodes;
 }
 
-mrpt::maps::CPointsMap::Ptr TPS_RRTstar::cached_local_obstacles(
-    const MotionPrimitivesTreeSE2& tree, const TNodeID nodeID,
-    const std::vector<mrpt::maps::CPointsMap::Ptr>& globalObstacles,
-    double                                          MAX_XY_DIST)
-{
-    // reuse?
-    const auto& node = tree.nodes().at(nodeID);
-
-    auto itOc = local_obstacles_cache_.find(nodeID);
-    if (itOc != local_obstacles_cache_.end() &&
-        itOc->second.globalNodePose == node.pose)
-    {  // cache hit
-        return itOc->second.obs;
-    }
-
-    // create/update
-    auto& loc = local_obstacles_cache_[nodeID];
-
-    loc.globalNodePose = node.pose;
-    if (!loc.obs)
-        loc.obs = mrpt::maps::CSimplePointsMap::Create();
-    else
-        loc.obs->clear();
-
-    for (const auto& obs : globalObstacles)
-    {
-        ASSERT_(obs);
-        transform_pc_square_clipping(
-            *obs, mrpt::poses::CPose2D(node.pose), MAX_XY_DIST, *loc.obs);
-    }
-
-    return loc.obs;
-}
-
-cost_t TPS_RRTstar::cost_path_segment(const MoveEdgeSE2_TPS& edge) const
-{
-    // Base cost: distance
-    cost_t c = edge.ptgDist;
-
-    // Additional optional cost evaluators:
-    for (const auto& ce : costEvaluators_)
-    {
-        ASSERT_(ce);
-        c += (*ce)(edge);
-    }
-
-    return c;
-}
-
 TPS_RRTstar::closest_lie_nodes_list_t TPS_RRTstar::find_nearby_nodes(
     const MotionPrimitivesTreeSE2& tree, const mrpt::math::TPose2D& query,
     const double maxDistance)
 {
     auto tle = mrpt::system::CTimeLoggerEntry(profiler_, "find_nearby_nodes");
 
+    const double cellSize = std::max(params_.minSearchRadius, 0.1);
+    const auto   lambdaCell = [cellSize](const double v) {
+        return static_cast<int32_t>(std::floor(v / cellSize));
+    };
+    const auto lambdaKey = [](const int32_t cx, const int32_t cy) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(cx)) << 32) |
+               static_cast<uint32_t>(cy);
+    };
+
+    // Index the nodes added since the last call:
+    const auto& nodes = tree.nodes();
+    auto&       index = nodeIndices_[&tree];
+    if (index.numIndexed > nodes.size()) index = NodeGridIndex();
+    for (auto it = std::next(nodes.begin(), index.numIndexed);
+         it != nodes.end(); ++it)
+    {
+        const auto& p = it->second.pose;
+        index.cells[lambdaKey(lambdaCell(p.x), lambdaCell(p.y))].push_back(
+            it->first);
+    }
+    index.numIndexed = nodes.size();
+
     closest_lie_nodes_list_t             out;
     PoseDistanceMetric_Lie<SE2_KinState> de(params_.SE2_metricAngleWeight);
 
-    // TODO: Use KD-tree with nanoflann!
-    for (const auto& node : tree.nodes())
+    const int32_t cx0 = lambdaCell(query.x - maxDistance),
+                  cx1 = lambdaCell(query.x + maxDistance);
+    const int32_t cy0 = lambdaCell(query.y - maxDistance),
+                  cy1 = lambdaCell(query.y + maxDistance);
+
+    for (int32_t cy = cy0; cy <= cy1; cy++)
     {
-        const SE2_KinState& nodeState = node.second;
+        for (int32_t cx = cx0; cx <= cx1; cx++)
+        {
+            const auto itCell = index.cells.find(lambdaKey(cx, cy));
+            if (itCell == index.cells.end()) continue;
 
-        // Skip the more expensive calculation of exact distance:
-        if (de.cannotBeNearerThan(query, nodeState.pose, maxDistance))
-            continue;  // It's too far, skip:
+            for (const TNodeID id : itCell->second)
+            {
+                const auto& node = nodes.at(id);
+
+                // Skip the more expensive calculation of exact distance:
+                if (de.cannotBeNearerThan(query, node.pose, maxDistance))
+                    continue;  // It's too far, skip:
 
-        if (auto d = de.distance(query, nodeState.pose); d < maxDistance)
-            out.emplace(d, std::ref(node.second));
+                if (auto d = de.distance(query, node.pose); d < maxDistance)
+                    out.emplace(d, NearbyNode(node, query - node.pose));
+            }
+        }
     }
     return out;
 }
@@ -1005,3 +1601,222 @@ std::tuple<distance_t, TNodeID> TPS_RRTstar::find_closest_node(
     }
     return {minDist, closestNodeId};
 }
+
+// See docs in .h
+std::optional<TNodeID> TPS_RRTstar::extend_reverse_tree(
+    MotionPrimitivesTreeSE2& goalTree, const PlannerInput& pi,
+    const std::vector<mrpt::maps::CPointsMap::Ptr>& globalObstacles,
+    const double MAX_XY_DIST, const distance_t searchRadius)
+{
+    auto tle = mrpt::system::CTimeLoggerEntry(profiler_, "extend_reverse_tree");
+
+    // Draw the target node (already in the reverse tree), then ptg index,
+    // then trajectory index, then distance:
+    const TNodeID nodeId = rng_.drawUniform32bit() % goalTree.nodes().size();
+    const auto&   node   = goalTree.nodes().at(nodeId);
+
+    const auto ptgIdx = rng_.drawUniform32bit() % pi.ptgs.ptgs.size();
+    auto&      ptg    = *pi.ptgs.ptgs.at(ptgIdx);
+
+    // The velocity at the (yet unknown) source pose is not known: use the
+    // one of the target node as an approximation. Motions are validated
+    // again in the forward direction in connect_to_reverse_tree():
+    ptg_t::TNavDynamicState ds;
+    (ds.curVelLocal = node.vel).rotate(-node.pose.phi);
+    ds.relTarget      = {1.0, 0, 0};
+    ds.targetRelSpeed = 1.0;
+    ptgDynStateCache_.update(ptg, ds);
+
+    trajectory_index_t trajIdx = -1;
+    if (rng_.drawUniform(0.0, 1.0) < params_.drawBiasTowardsGoal)
+    {
+        // Bias towards the start: pick the path that, started at the start
+        // pose, would reach this node:
+        const auto relPose = node.pose - pi.stateStart.pose;
+        int        k;
+        double     d;
+        if (ptg.inverseMap_WS2TP(relPose.x, relPose.y, k, d)) trajIdx = k;
+    }
+    if (trajIdx < 0)
+        trajIdx = rng_.drawUniform32bit() % ptg.getAlphaValuesCount();
+
+    const auto trajDist = rng_.drawUniform(
+        params_.minStepLength, std::min(params_.maxStepLength, searchRadius));
+
+    uint32_t ptg_step;
+    if (!ptg.getPathStepForDist(trajIdx, trajDist, ptg_step)) return {};
+
+    // Reversed motion: the new node `x` is such that `x (+) relPose = node`
+    const auto relPose = ptg.getPathPose(trajIdx, ptg_step);
+
+    SE2_KinState x;
+    x.pose = (mrpt::poses::CPose2D(node.pose) +
+              (-mrpt::poses::CPose2D(relPose)))
+                 .asTPose();
+    // This is not exact: see comment above on velocities.
+    (x.vel = ptg.getPathTwist(trajIdx, 0)).rotate(x.pose.phi);
+
+    if (!within_bbox(x.pose, pi.worldBboxMax, pi.worldBboxMin)) return {};
+
+    // Too close to an existing node?
+    if (const auto closeNodes = find_nearby_nodes(
+            goalTree, x.pose, params_.metricDistanceEpsilon);
+        !closeNodes.empty())
+        return {};
+
+    // Collision check, as seen from the new node:
+    mrpt::maps::CSimplePointsMap localObstacles;
+    for (const auto& obs : globalObstacles)
+    {
+        ASSERT_(obs);
+        transform_pc_square_clipping(
+            *obs, mrpt::poses::CPose2D(x.pose), MAX_XY_DIST, localObstacles);
+    }
+    const distance_t freeDistance =
+        tp_obstacles_single_path(trajIdx, localObstacles, ptg);
+    if (trajDist >= freeDistance) return {};
+
+    MoveEdgeSE2_TPS edge;
+    edge.parentId       = nodeId;
+    edge.ptgDist        = trajDist;
+    edge.ptgIndex       = ptgIdx;
+    edge.ptgPathIndex   = trajIdx;
+    edge.targetRelSpeed = ds.targetRelSpeed;
+    edge.stateFrom      = x;
+    edge.stateTo        = node;
+    interpolate_edge(edge, ptg, ptg_step, params_.pathInterpolatedSegments);
+    edge.cost = cost_path_segment(edge);
+
+    // In this tree, node costs are costs to the goal:
+    const TNodeID newNodeId = goalTree.next_free_node_ID();
+    goalTree.insert_node_and_edge(nodeId, newNodeId, x, edge);
+
+    return newNodeId;
+}
+
+// See docs in .h
+bool TPS_RRTstar::connect_to_reverse_tree(
+    MotionPrimitivesTreeSE2& tree, const TNodeID fromNodeId,
+    const MotionPrimitivesTreeSE2& goalTree, const TNodeID goalTreeNodeId,
+    const TNodeID goalNodeId, const PlannerInput& pi,
+    const std::vector<mrpt::maps::CPointsMap::Ptr>& globalObstacles,
+    const double MAX_XY_DIST, const distance_t searchRadius)
+{
+    auto tle =
+        mrpt::system::CTimeLoggerEntry(profiler_, "connect_to_reverse_tree");
+
+    // Do not even try if this cannot improve the current solution:
+    if (tree.nodes().at(fromNodeId).cost_ +
+            goalTree.nodes().at(goalTreeNodeId).cost_ >=
+        tree.nodes().at(goalNodeId).cost_)
+        return false;
+
+    const cost_t bestCost = tree.nodes().at(goalNodeId).cost_;
+
+    // The whole chain is validated before modifying the tree. The hops start
+    // at `startId`, and each one ends at the actual pose (up to PTG
+    // discretization) and velocity reached by the former one:
+    TNodeID                      startId = fromNodeId;
+    cost_t                       cost    = tree.nodes().at(startId).cost_;
+    std::vector<MoveEdgeSE2_TPS> hops;
+
+    TNodeID revId = goalTreeNodeId;
+    for (;;)
+    {
+        const auto& revNode = goalTree.nodes().at(revId);
+        const bool  isGoal  = !revNode.parentID_.has_value();
+
+        // The goal heading is not enforced, as in the REWIRE stage:
+        std::optional<MoveEdgeSE2_TPS> edge;
+        if (hops.empty())
+        {
+            edge = direct_edge_towards(
+                tree, startId, revNode.pose, isGoal, pi.ptgs, globalObstacles,
+                MAX_XY_DIST, searchRadius);
+        }
+        else
+        {
+            const auto& from = hops.back().stateTo;
+
+            mrpt::maps::CSimplePointsMap localObstacles;
+            for (const auto& obs : globalObstacles)
+            {
+                ASSERT_(obs);
+                transform_pc_square_clipping(
+                    *obs, mrpt::poses::CPose2D(from.pose), MAX_XY_DIST,
+                    localObstacles);
+            }
+            edge = best_edge_towards(
+                from, revNode.pose, isGoal, params_.headingToleranceMetric,
+                searchRadius, pi.ptgs, localObstacles,
+                params_.pathInterpolatedSegments);
+        }
+        if (!edge) return false;
+
+        cost += edge->cost;
+        if (cost >= bestCost) return false;  // Cannot improve the solution
+
+        hops.push_back(*edge);
+        if (isGoal) break;
+
+        // Reuse an existing node at (almost) the same pose, if it is not
+        // more expensive, restarting the chain from it:
+        for (const auto& [d, n] : find_nearby_nodes(
+                 tree, edge->stateTo.pose, params_.metricDistanceEpsilon))
+        {
+            const auto& existing = n.get();
+            if (existing.nodeID_ == goalNodeId) continue;
+
+            // A cheaper duplicate of the existing node would require
+            // rewiring its subtree: leave that to the REWIRE stage.
+            if (existing.cost_ > cost) return false;
+
+            startId = existing.nodeID_;
+            cost    = existing.cost_;
+            hops.clear();
+            break;
+        }
+
+        revId = revNode.parentID_.value();
+    }
+
+    // Graft the chain into the main tree:
+    TNodeID parentId = startId;
+    for (size_t i = 0; i < hops.size(); i++)
+    {
+        auto& edge    = hops[i];
+        edge.parentId = parentId;
+
+        if (i + 1 == hops.size())
+        {
+            edge.stateTo = tree.nodes().at(goalNodeId);
+            tree.rewire_node_parent(goalNodeId, edge);
+            break;
+        }
+
+        const TNodeID newId = tree.next_free_node_ID();
+        tree.insert_node_and_edge(parentId, newId, edge.stateTo, edge);
+        parentId = newId;
+    }
+    return true;
+}
+
+// See docs in .h
+std::optional<MoveEdgeSE2_TPS> TPS_RRTstar::direct_edge_towards(
+    const MotionPrimitivesTreeSE2& tree, const TNodeID srcNodeId,
+    const mrpt::math::TPose2D& target, const bool ignoreTargetHeading,
+    const TrajectoriesAndRobotShape&                trs,
+    const std::vector<mrpt::maps::CPointsMap::Ptr>& globalObstacles,
+    const double MAX_XY_DIST, const distance_t maxDistance)
+{
+    const auto& localObstacles =
+        cached_local_obstacles(tree, srcNodeId, globalObstacles, MAX_XY_DIST);
+
+    auto edge = best_edge_towards(
+        tree.nodes().at(srcNodeId), target, ignoreTargetHeading,
+        params_.headingToleranceMetric, maxDistance, trs, *localObstacles,
+        params_.pathInterpolatedSegments);
+    if (edge) edge->parentId = srcNodeId;
+
+    return edge;
+}
@@ -4,13 +4,18 @@
  * See LICENSE for license information.
  * ------------------------------------------------------------------------- */
 
+#include <mrpt/core/bits_math.h>
 #include <mrpt/core/lock_helper.h>
+#include <mrpt/maps/CSimplePointsMap.h>
 #include <mrpt/math/TSegment2D.h>
 #include <mrpt/opengl/COpenGLScene.h>
+#include <mrpt/poses/CPose3D.h>
 #include <selfdriving/algos/CostEvaluatorCostMap.h>
 #include <selfdriving/algos/WaypointSequencer.h>
 #include <selfdriving/algos/render_tree.h>
 
+#include <cmath>
+
 using namespace selfdriving;
 
 constexpr double MIN_TIME_BETWEEN_POSE_UPDATES = 20e-3;  // [s]
@@ -19,6 +24,10 @@ constexpr double PREVIOUS_POSES_MAX_AGE        = 20;  // [s]
 WaypointSequencer::~WaypointSequencer()
 {
     // stop vehicle, etc.
+
+    // Stop threads before any member they use is destroyed:
+    pathTracker_.stop();
+    plannerScheduler_.reset();
 }
 
 void WaypointSequencer::initialize()
@@ -36,11 +45,173 @@ void WaypointSequencer::initialize()
     for (const auto& ptg : config_.ptgs.ptgs)
         ASSERT_GT_(ptg->getRefDistance(), config_.rrt_params.maxStepLength);
 
+    // Check that the planner class exists:
+    create_planner();
+
+    // PTGs may have changed since the last call:
+    {
+        auto lckPool = mrpt::lockHelper(ptgsCopies_.mtx);
+        ptgsCopies_.free.clear();
+        ptgsCopies_.generation++;
+    }
+
+    if (!plannerScheduler_ ||
+        plannerScheduler_->num_workers() != config_.planner_worker_threads)
+    {
+        // Jobs of the former scheduler are dropped with it, which would
+        // break the promises of their futures: forget about them first.
+        if (plannerScheduler_)
+        {
+            auto& _ = innerState_;
+            cancel_path_planner();
+            _.pathPlannerFuture = {};
+            _.pathPlannerTarget.reset();
+            _.pathPlannerIsPipelined   = false;
+            _.pathPlannerContinuesPath = false;
+            _.nextSegmentFuture        = {};
+        }
+
+        plannerScheduler_ = std::make_unique<PlannerJobScheduler>(
+            config_.planner_worker_threads, "path_planner");
+    }
+
+    pathTracker_.setMinLoggingLevel(this->getMinLoggingLevel());
+    pathTracker_.params_ = config_.path_tracker_params;
+    pathTracker_.start(config_.vehicleMotionInterface, config_.ptgs);
+
+    if (config_.prm_roadmap_file)
+        initialize_roadmap_planner();
+    else
+        roadmapPlanner_.reset();
+
+    plannerSupportsExtraGoals_ = create_planner()->supports_extra_goals();
+
     initialized_ = true;
 
     MRPT_END
 }
 
+void WaypointSequencer::initialize_roadmap_planner()
+{
+    MRPT_START
+
+    const auto& fileName = config_.prm_roadmap_file.value();
+
+    roadmapPlanner_ = std::make_shared<TPS_PRM>();
+    roadmapPlanner_->setMinLoggingLevel(this->getMinLoggingLevel());
+    roadmapPlanner_->profiler_.enable(false);
+    roadmapPlanner_->params_ = config_.prm_params;
+
+    auto& rm = *roadmapPlanner_->roadmap_;
+    if (rm.load_from_file(fileName) &&
+        rm.compatible_with(config_.ptgs, {config_.globalMapObstacleSource}))
+    {
+        MRPT_LOG_INFO_STREAM(
+            "[initialize] Loaded PTG roadmap from '"
+            << fileName << "' with " << rm.nodes.size() << " nodes.");
+        return;
+    }
+
+    MRPT_LOG_INFO_STREAM(
+        "[initialize] Building PTG roadmap (missing or stale file '"
+        << fileName << "')...");
+
+    // The roadmap covers the whole static map:
+    const auto obs = config_.globalMapObstacleSource->obstacles();
+    ASSERT_(obs && !obs->empty());
+    const auto bbox = obs->boundingBox();
+
+    PlannerInput pi;
+    pi.ptgs         = config_.ptgs;
+    pi.worldBboxMin = {bbox.min.x, bbox.min.y, -M_PI};
+    pi.worldBboxMax = {bbox.max.x, bbox.max.y, M_PI};
+    pi.obstacles.push_back(config_.globalMapObstacleSource);
+
+    roadmapPlanner_->build_roadmap(pi);
+
+    if (!rm.save_to_file(fileName))
+        MRPT_LOG_WARN_STREAM(
+            "[initialize] Could not save PTG roadmap to '" << fileName << "'");
+
+    MRPT_END
+}
+
+Planner::Ptr WaypointSequencer::create_planner() const
+{
+    MRPT_START
+
+    Planner::Ptr planner;
+    if (roadmapPlanner_)
+    {
+        // Multi-query: a new instance over the roadmap built in initialize()
+        auto prm      = std::make_shared<TPS_PRM>();
+        prm->params_  = config_.prm_params;
+        prm->roadmap_ = roadmapPlanner_->roadmap_;
+        planner       = prm;
+    }
+    else
+    {
+        planner = std::dynamic_pointer_cast<Planner>(
+            mrpt::rtti::classFactory(config_.planner_name));
+        ASSERTMSG_(
+            planner, mrpt::format(
+                         "'%s' is not a registered Planner class",
+                         config_.planner_name.c_str()));
+
+        if (auto rrt = std::dynamic_pointer_cast<TPS_RRTstar>(planner); rrt)
+            rrt->params_ = config_.rrt_params;
+        else if (!config_.planner_params.empty())
+            planner->params_from_yaml(config_.planner_params);
+    }
+
+    planner->profiler_.enable(false);
+    planner->setMinLoggingLevel(this->getMinLoggingLevel());
+    planner->costToGoCache_ = costToGoCache_;
+
+    return planner;
+    MRPT_END
+}
+
+std::pair<TrajectoriesAndRobotShape, size_t>
+    WaypointSequencer::acquire_ptgs_copy()
+{
+    MRPT_START
+
+    size_t generation;
+    {
+        auto lck   = mrpt::lockHelper(ptgsCopies_.mtx);
+        generation = ptgsCopies_.generation;
+        if (!ptgsCopies_.free.empty())
+        {
+            auto trs = std::move(ptgsCopies_.free.back());
+            ptgsCopies_.free.pop_back();
+            return {std::move(trs), generation};
+        }
+    }
+
+    // None available: make a new one, without holding the lock:
+    TrajectoriesAndRobotShape trs = config_.ptgs;
+    for (auto& ptg : trs.ptgs)
+    {
+        ptg = std::dynamic_pointer_cast<ptg_t>(ptg->duplicateGetSmartPtr());
+        ASSERT_(ptg);
+    }
+    return {std::move(trs), generation};
+
+    MRPT_END
+}
+
+void WaypointSequencer::release_ptgs_copy(
+    TrajectoriesAndRobotShape&& ptgs, const size_t generation)
+{
+    auto lck = mrpt::lockHelper(ptgsCopies_.mtx);
+
+    // Drop copies of outdated PTGs:
+    if (generation != ptgsCopies_.generation) return;
+
+    ptgsCopies_.free.push_back(std::move(ptgs));
+}
+
 void WaypointSequencer::request_navigation(const WaypointSequence& navRequest)
 {
     MRPT_START
@@ -50,6 +221,9 @@ void WaypointSequencer::request_navigation(const WaypointSequence& navRequest)
     const size_t N = navRequest.waypoints.size();
     ASSERTMSG_(N > 0, "List of waypoints is empty!");
 
+    // Stop planning for the former navigation, if any:
+    cancel_path_planner();
+
     // reset fields to default:
     innerState_.clear();
 
@@ -126,6 +300,7 @@ void WaypointSequencer::navigation_step()
                     "navigation "
                     "due to a NavStatus::NAV_ERROR state!");
 
+                pathTracker_.clear_path();
                 if (config_.vehicleMotionInterface)
                 {
                     config_.vehicleMotionInterface->stop(STOP_TYPE::REGULAR);
@@ -168,6 +343,9 @@ void WaypointSequencer::cancel()
     MRPT_LOG_DEBUG("WaypointSequencer::cancel() called.");
     navigationStatus_ = NavStatus::IDLE;
 
+    cancel_path_planner();
+    pathTracker_.clear_path();
+
     if (config_.vehicleMotionInterface)
     {
         config_.vehicleMotionInterface->stop(STOP_TYPE::REGULAR);
@@ -182,7 +360,13 @@ void WaypointSequencer::resume()
     MRPT_LOG_DEBUG("WaypointSequencer::resume() called.");
 
     if (navigationStatus_ == NavStatus::SUSPENDED)
+    {
         navigationStatus_ = NavStatus::NAVIGATING;
+
+        // The path tracker was stopped in suspend(), and the vehicle may have
+        // been moved meanwhile: plan again from the current state.
+        drop_active_plan();
+    }
 }
 void WaypointSequencer::suspend()
 {
@@ -194,6 +378,7 @@ void WaypointSequencer::suspend()
     if (navigationStatus_ == NavStatus::NAVIGATING)
     {
         navigationStatus_ = NavStatus::SUSPENDED;
+        pathTracker_.clear_path();
 
         if (config_.vehicleMotionInterface)
         {
@@ -328,6 +513,13 @@ void WaypointSequencer::impl_navigation_step()
     // Get current robot kinematic state:
     update_robot_kinematic_state();
 
+    // Have we reached the target of the path under execution?
+    check_active_target_reached();
+    if (navigationStatus_ != NavStatus::NAVIGATING) return;
+
+    // Is the path under execution still being followed?
+    check_path_tracking();
+
     // Checks whether we need to launch a new RRT* path planner:
     check_have_to_replan();
 
@@ -368,29 +560,35 @@ void WaypointSequencer::check_have_to_replan()
     {
         // find next target wp:
         auto nextWp = find_next_waypoint_for_planner();
+        ASSERT_(nextWp.has_value());
 
-        enqueue_path_planner_towards(nextWp);
+        enqueue_path_planner_towards(*nextWp);
     }
 }
 
-waypoint_idx_t WaypointSequencer::find_next_waypoint_for_planner()
+std::optional<waypoint_idx_t> WaypointSequencer::find_next_waypoint_for_planner(
+    const std::optional<waypoint_idx_t>& after)
 {
     auto& _ = innerState_;
 
     std::optional<waypoint_idx_t> firstWpIdx;
 
-    for (size_t i = 0; i < _.waypointNavStatus.waypoints.size(); i++)
+    for (size_t i = after ? *after + 1 : 0;
+         i < _.waypointNavStatus.waypoints.size(); i++)
     {
         const auto& wp = _.waypointNavStatus.waypoints.at(i);
         if (wp.reached) continue;
 
         firstWpIdx = i;
 
-        if (!wp.allowSkip) break;
+        // With look-ahead waypoints, whether to skip waypoints is decided
+        // upon the planner results, in check_new_rrtstar_output(), unless
+        // the planner does not search for them:
+        if (!wp.allowSkip ||
+            (config_.multitarget_look_ahead > 0 && plannerSupportsExtraGoals_))
+            break;
     }
-    ASSERT_(firstWpIdx.has_value());
-
-    return *firstWpIdx;
+    return firstWpIdx;
 }
 
 WaypointSequencer::PathPlannerOutput WaypointSequencer::path_planner_function(
@@ -415,6 +613,14 @@ WaypointSequencer::PathPlannerOutput WaypointSequencer::path_planner_function(
         bbox.updateWithPoint(ptStart + bboxMargin);
         bbox.updateWithPoint(ptGoal - bboxMargin);
         bbox.updateWithPoint(ptGoal + bboxMargin);
+
+        for (const auto& g : ppi.pi.extraGoals)
+        {
+            const auto pt =
+                mrpt::math::TPoint3Df(g.state.pose.x, g.state.pose.y, 0);
+            bbox.updateWithPoint(pt - bboxMargin);
+            bbox.updateWithPoint(pt + bboxMargin);
+        }
     }
 
     ppi.pi.worldBboxMax = {bbox.max.x, bbox.max.y, M_PI};
@@ -432,10 +638,8 @@ WaypointSequencer::PathPlannerOutput WaypointSequencer::path_planner_function(
         << ppi.pi.worldBboxMax.asString());
 
     // Do the path planning :
-    selfdriving::TPS_RRTstar planner;
-
-    // time profiler:
-    planner.profiler_.enable(false);
+    auto planner = create_planner();
+    planner->cancellationToken_ = ppi.cancellation;
 
     // ~~~~~~~~~~~~~~
     // Add cost maps
@@ -448,7 +652,7 @@ WaypointSequencer::PathPlannerOutput WaypointSequencer::path_planner_function(
         auto costmap =
             selfdriving::CostEvaluatorCostMap::FromStaticPointObstacles(
                 *obsPts);
-        planner.costEvaluators_.push_back(costmap);
+        planner->costEvaluators_.push_back(costmap);
     }
 #endif
 
@@ -465,29 +669,72 @@ WaypointSequencer::PathPlannerOutput WaypointSequencer::path_planner_function(
     if (config_.localSensedObstacleSource)
         ppi.pi.obstacles.push_back(config_.localSensedObstacleSource);
 
-    // verbosity level:
-    planner.setMinLoggingLevel(this->getMinLoggingLevel());
-
-    planner.params_ = config_.rrt_params;
     {
         std::stringstream ss;
-        planner.params_.as_yaml().printAsYAML(ss);
+        planner->params_as_yaml().printAsYAML(ss);
         MRPT_LOG_DEBUG_STREAM(
-            "[path_planner_function] RRT* planner parameters:\n"
-            << ss.str());
+            "[path_planner_function] " << config_.planner_name
+                                       << " parameters:\n"
+                                       << ss.str());
     }
 
-    // PTGs:
-    ppi.pi.ptgs = config_.ptgs;
+    // PTGs: a copy for this job only, since planners modify them:
+    auto [ptgsCopy, ptgsGeneration] = acquire_ptgs_copy();
+    ppi.pi.ptgs                      = std::move(ptgsCopy);
 
-    // ========== ACTUAL RRT* PLANNING ================
+    // ========== ACTUAL PATH PLANNING ================
     PathPlannerOutput ret;
-    ret.po = planner.plan(ppi.pi);
+    ret.extraGoalWaypoints = ppi.extraGoalWaypoints;
+    for (const auto& os : ppi.pi.obstacles)
+    {
+        ret.obstacleVersions.push_back(os->version());
+        ret.obstacleSnapshots.push_back(
+            os->dynamic() ? os->obstacles() : nullptr);
+    }
+
+    const auto tStart = mrpt::Clock::now();
+
+    // Skip jobs that were superseded while enqueued:
+    if (!ppi.cancellation.cancelled())
+    {
+        ret.po = planner->plan(ppi.pi);
+    }
+    ret.repairable = static_cast<bool>(
+        std::dynamic_pointer_cast<TPS_RRTstar>(planner));
     // ================================================
 
+    // The PTGs copy goes back to the pool. From now on, the output refers to
+    // config_.ptgs, only used from the navigation thread:
+    ret.po.originalInput.ptgs = config_.ptgs;
+    release_ptgs_copy(std::move(ppi.pi.ptgs), ptgsGeneration);
+
+    const auto dtUs = std::chrono::duration_cast<std::chrono::microseconds>(
+                          mrpt::Clock::now() - tStart)
+                          .count();
+    plannerTimeUs_ += dtUs;
+    if (ppi.cancellation.cancelled())
+    {
+        wastedPlannerTimeUs_ += dtUs;
+        ret.po.success = false;
+        MRPT_LOG_DEBUG_FMT(
+            "[path_planner_function] Plan cancelled after %.03f ms",
+            dtUs * 1e-3);
+    }
+
     return ret;
 }
 
+void WaypointSequencer::cancel_path_planner()
+{
+    auto& _ = innerState_;
+
+    _.pathPlannerCancellation.cancel();
+    _.pathPlannerCancellation = CancellationToken();
+    _.nextSegmentCancellation.cancel();
+    _.nextSegmentCancellation = CancellationToken();
+    _.nextSegmentTarget.reset();
+}
+
 void WaypointSequencer::enqueue_path_planner_towards(
     const waypoint_idx_t targetWpIdx)
 {
@@ -497,18 +744,79 @@ void WaypointSequencer::enqueue_path_planner_towards(
         "enqueue_path_planner_towards() called with targetWpIdx="
         << targetWpIdx);
 
+    // A former plan towards another target is no longer needed:
+    if (_.pathPlannerTarget && *_.pathPlannerTarget != targetWpIdx)
+        cancel_path_planner();
+
     // ----------------------------------
     // prepare planner request:
     // ----------------------------------
-    PathPlannerInput ppi;
+    PathPlannerInput ppi = make_planner_input(targetWpIdx);
 
-    // Starting pose and velocity:
-    // The current one plus a bit ahead in the future?
+    // Starting pose and velocity: the ones predicted for when the plan is
+    // expected to be ready, so it starts where the vehicle will be:
     // ---------------------------------------------------
-    MRPT_TODO("Add some pose delta to account for the computation time?");
-    ppi.pi.stateStart.pose = lastVehicleLocalization_.pose;
-    ppi.pi.stateStart.vel  = lastVehicleOdometry_.odometryVelocityLocal.rotated(
-        ppi.pi.stateGoal.pose.phi);
+    const double latency =
+        config_.plan_latency_ewma_alpha > 0
+            ? planLatencyEstimate_.value_or(config_.initial_plan_latency)
+            : 0.0;
+    ppi.pi.stateStart = predict_vehicle_state(latency);
+
+    // ----------------------------------
+    // send it for running of the worker thread:
+    // ----------------------------------
+    ppi.cancellation = _.pathPlannerCancellation;
+
+    _.pathPlannerFuture = plannerScheduler_->enqueue(
+        PlannerJobClass::URGENT, ppi.cancellation,
+        [this, ppi]() { return path_planner_function(ppi); });
+    _.pathPlannerTarget        = targetWpIdx;
+    _.pathPlannerIsPipelined   = false;
+    _.pathPlannerContinuesPath = false;
+    _.pathPlannerEnqueueTime = mrpt::Clock::now();
+}
+
+SE2_KinState WaypointSequencer::predict_vehicle_state(const double dt) const
+{
+    // No path under execution: the last command sent to the vehicle was a
+    // stop (e.g. tracking was lost), so it will be at rest, not far from
+    // where it is now (its braking distance is neglected):
+    if (dt > 0 && !pathTracker_.is_tracking())
+    {
+        SE2_KinState st;
+        st.pose = lastVehicleLocalization_.pose;
+        return st;
+    }
+
+    const auto& v = lastVehicleOdometry_.odometryVelocityLocal;
+
+    // Constant twist motion (a circular arc), in the vehicle frame:
+    mrpt::math::TPose2D delta;
+    if (std::abs(v.omega) < 1e-6)
+    {
+        delta = {v.vx * dt, v.vy * dt, 0};
+    }
+    else
+    {
+        const double th = v.omega * dt, s = std::sin(th), c = std::cos(th);
+        delta.x   = (v.vx * s - v.vy * (1 - c)) / v.omega;
+        delta.y   = (v.vx * (1 - c) + v.vy * s) / v.omega;
+        delta.phi = th;
+    }
+
+    SE2_KinState st;
+    st.pose = lastVehicleLocalization_.pose + delta;
+    // Velocities in the global frame:
+    st.vel = v.rotated(st.pose.phi);
+    return st;
+}
+
+WaypointSequencer::PathPlannerInput WaypointSequencer::make_planner_input(
+    const waypoint_idx_t targetWpIdx)
+{
+    auto& _ = innerState_;
+
+    PathPlannerInput ppi;
 
     ASSERT_LT_(targetWpIdx, _.waypointNavStatus.waypoints.size());
     const auto& wp          = _.waypointNavStatus.waypoints.at(targetWpIdx);
@@ -529,12 +837,254 @@ void WaypointSequencer::enqueue_path_planner_towards(
     // ppi.pi.stateGoal.vel;
     MRPT_TODO("Handle speed at target waypoint");
 
-    // ----------------------------------
-    // send it for running of the worker thread:
-    // ----------------------------------
-    _.pathPlannerFuture = pathPlannerPool_.enqueue(
-        &WaypointSequencer::path_planner_function, this, ppi);
-    _.pathPlannerTarget = targetWpIdx;
+    // Multi-goal planning: the next waypoints are served by the same plan:
+    for (int i = 1; i <= config_.multitarget_look_ahead; i++)
+    {
+        const waypoint_idx_t idx = targetWpIdx + i;
+        if (idx >= _.waypointNavStatus.waypoints.size()) break;
+
+        const auto& nextWp = _.waypointNavStatus.waypoints.at(idx);
+
+        PlannerGoal g;
+        g.state.pose.x      = nextWp.target.x;
+        g.state.pose.y      = nextWp.target.y;
+        g.distanceTolerance = nextWp.allowedDistance;
+        if (nextWp.targetHeading.has_value())
+        {
+            g.state.pose.phi   = nextWp.targetHeading.value();
+            g.headingTolerance = config_.waypoint_angle_tolerance;
+        }
+        ppi.pi.extraGoals.push_back(g);
+        ppi.extraGoalWaypoints.push_back(idx);
+    }
+
+    return ppi;
+}
+
+void WaypointSequencer::enqueue_next_segment_planner()
+{
+    auto& _ = innerState_;
+
+    ASSERT_(_.activeFinalTarget.has_value());
+    ASSERT_(_.activePlan.has_value());
+
+    const auto nextWp = find_next_waypoint_for_planner(_.activeFinalTarget);
+    if (!nextWp) return;  // This is the last segment
+
+    MRPT_LOG_DEBUG_STREAM(
+        "enqueue_next_segment_planner() called with targetWpIdx=" << *nextWp);
+
+    PathPlannerInput ppi = make_planner_input(*nextWp);
+
+    // Start at the predicted final state of the active path:
+    const auto& tree  = _.activePlan->po.motionTree;
+    ppi.pi.stateStart = tree.nodes().at(_.activePlanGoalNodeId);
+
+    _.nextSegmentCancellation.cancel();
+    _.nextSegmentCancellation = CancellationToken();
+    ppi.cancellation          = _.nextSegmentCancellation;
+
+    _.nextSegmentFuture = plannerScheduler_->enqueue(
+        PlannerJobClass::LOOKAHEAD, ppi.cancellation,
+        [this, ppi]() { return path_planner_function(ppi); });
+    _.nextSegmentTarget = *nextWp;
+}
+
+void WaypointSequencer::check_active_target_reached()
+{
+    auto& _ = innerState_;
+
+    if (!_.activeFinalTarget) return;
+
+    auto&       wps      = _.waypointNavStatus.waypoints;
+    const auto  activeWp = *_.activeFinalTarget;
+    const auto& wp       = wps.at(activeWp);
+    const auto& p        = lastVehicleLocalization_.pose;
+
+    if (mrpt::hypot_fast(p.x - wp.target.x, p.y - wp.target.y) >
+        wp.allowedDistance)
+        return;
+
+    // Reached. Waypoints before it, if any, were skipped:
+    const auto now = mrpt::Clock::now();
+    for (waypoint_idx_t i = 0; i <= activeWp; i++)
+    {
+        auto& w = wps.at(i);
+        if (w.reached) continue;
+        w.reached         = true;
+        w.skipped         = (i != activeWp);
+        w.timestamp_reach = now;
+    }
+    MRPT_LOG_INFO_STREAM("Waypoint #" << activeWp << " reached.");
+
+    _.activeFinalTarget.reset();
+    _.activePlan.reset();
+    _.activePlanGoalNodeId = INVALID_NODEID;
+
+    if (activeWp + 1 == wps.size())
+    {
+        MRPT_LOG_INFO("Final waypoint reached, navigation finished.");
+        _.navigationEndEventSent = true;
+        navigationStatus_        = NavStatus::IDLE;
+        return;
+    }
+
+    // Hand over the pipelined plan of the next segment, if any. It is
+    // checked against the current obstacles in check_new_rrtstar_output(),
+    // then appended to the path under execution, which it continues.
+    if (_.nextSegmentTarget)
+    {
+        _.pathPlannerFuture        = std::move(_.nextSegmentFuture);
+        _.pathPlannerTarget        = _.nextSegmentTarget;
+        _.pathPlannerCancellation  = _.nextSegmentCancellation;
+        _.pathPlannerIsPipelined   = true;
+        _.pathPlannerContinuesPath = true;
+        _.nextSegmentTarget.reset();
+        _.nextSegmentCancellation = CancellationToken();
+    }
+}
+
+bool WaypointSequencer::obstacles_changed(const PathPlannerOutput& p) const
+{
+    const auto& sources = p.po.originalInput.obstacles;
+    ASSERT_EQUAL_(sources.size(), p.obstacleVersions.size());
+
+    for (size_t i = 0; i < sources.size(); i++)
+        if (sources[i]->version() != p.obstacleVersions[i]) return true;
+
+    return false;
+}
+
+WaypointSequencer::PathPlannerOutput WaypointSequencer::revalidation_function(
+    PathPlannerOutput p, CancellationToken cancellation)
+{
+    MRPT_START
+
+    p.revalidated = true;
+
+    // Only the new obstacles of the sources that changed since planning:
+    const auto& sources = p.po.originalInput.obstacles;
+    ASSERT_EQUAL_(sources.size(), p.obstacleVersions.size());
+    ASSERT_EQUAL_(sources.size(), p.obstacleSnapshots.size());
+
+    const double tolSq = mrpt::square(config_.revalidation_obstacle_tolerance);
+
+    mrpt::maps::CSimplePointsMap newObstacles;
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        const auto version = sources[i]->version();
+        if (version == p.obstacleVersions[i]) continue;
+        p.obstacleVersions[i] = version;
+
+        const auto pts = sources[i]->obstacles();
+        if (!pts) continue;
+
+        auto& former = p.obstacleSnapshots[i];
+        if (!former || former->empty())
+        {
+            newObstacles.insertAnotherMap(
+                pts.get(), mrpt::poses::CPose3D::Identity());
+        }
+        else
+        {
+            const auto& xs = pts->getPointsBufferRef_x();
+            const auto& ys = pts->getPointsBufferRef_y();
+            for (size_t j = 0; j < xs.size(); j++)
+            {
+                mrpt::math::TPoint2D closest;
+                float                closestDistSqr;
+                former->kdTreeClosestPoint2D(
+                    {xs[j], ys[j]}, closest, closestDistSqr);
+                if (closestDistSqr > tolSq)
+                    newObstacles.insertPointFast(xs[j], ys[j], 0);
+            }
+        }
+        if (sources[i]->dynamic()) former = pts;
+    }
+    newObstacles.mark_as_modified();
+    if (newObstacles.empty() || cancellation.cancelled()) return p;
+
+    auto [ptgs, ptgsGeneration] = acquire_ptgs_copy();
+
+    // Only the chosen path is checked:
+    const bool pathIsFree = Planner::path_is_collision_free(
+        p.po.motionTree, p.pathGoalNodeId, ptgs, newObstacles);
+
+    if (!pathIsFree)
+    {
+        // To be chosen again by the navigation thread:
+        p.chosenWp.reset();
+        p.pathGoalNodeId = INVALID_NODEID;
+
+        if (p.repairable)
+        {
+            // Only the edges blocked by new obstacles are replanned:
+            TPS_RRTstar rrt;
+            rrt.setMinLoggingLevel(this->getMinLoggingLevel());
+            rrt.profiler_.enable(false);
+            rrt.params_            = config_.rrt_params;
+            rrt.cancellationToken_ = cancellation;
+
+            p.po.originalInput.ptgs = ptgs;
+            p.po                    = rrt.repair(p.po, newObstacles);
+            p.po.originalInput.ptgs = config_.ptgs;
+        }
+        else
+        {
+            // The tree cannot be repaired: plan again.
+            p.po.success = false;
+            for (auto& g : p.po.extraGoals) g.success = false;
+        }
+    }
+
+    release_ptgs_copy(std::move(ptgs), ptgsGeneration);
+
+    MRPT_LOG_DEBUG_STREAM(
+        "[revalidation_function] Pipelined plan checked against "
+        << newObstacles.size() << " new obstacle points: path "
+        << (pathIsFree ? "is free" : "was blocked"));
+
+    return p;
+    MRPT_END
+}
+
+void WaypointSequencer::choose_path_goal(PathPlannerOutput& result) const
+{
+    // Choose the final waypoint of the path: the planner target, or the
+    // farthest look-ahead waypoint with a path to it, if all waypoints before
+    // it can be skipped:
+    const auto& _   = innerState_;
+    const auto& wps = _.waypointNavStatus.waypoints;
+
+    ASSERT_(_.pathPlannerTarget.has_value());
+
+    result.chosenWp.reset();
+    result.pathGoalNodeId = INVALID_NODEID;
+    if (result.po.success)
+    {
+        result.chosenWp       = *_.pathPlannerTarget;
+        result.pathGoalNodeId = result.po.goalNodeId;
+    }
+
+    bool allSkippable = wps.at(*_.pathPlannerTarget).allowSkip;
+    for (size_t i = 0; i < result.po.extraGoals.size(); i++)
+    {
+        const auto& r     = result.po.extraGoals.at(i);
+        const auto  wpIdx = result.extraGoalWaypoints.at(i);
+
+        MRPT_LOG_DEBUG_FMT(
+            "Look-ahead waypoint #%u: success=%s pathCost=%f",
+            static_cast<unsigned int>(wpIdx), r.success ? "YES" : "NO",
+            r.pathCost);
+
+        if (!allSkippable) break;
+        if (r.success)
+        {
+            result.chosenWp       = wpIdx;
+            result.pathGoalNodeId = r.goalNodeId;
+        }
+        allSkippable = wps.at(wpIdx).allowSkip;
+    }
 }
 
 void WaypointSequencer::check_new_rrtstar_output()
@@ -547,18 +1097,88 @@ void WaypointSequencer::check_new_rrtstar_output()
         _.pathPlannerFuture.wait_for(std::chrono::milliseconds(0)))
         return;
 
-    const auto result = _.pathPlannerFuture.get();
+    auto result = _.pathPlannerFuture.get();
 
-    if (!result.po.success)
+    // Update the planning latency estimate, only with plans the vehicle had
+    // to wait for:
+    if (!_.pathPlannerIsPipelined && !result.revalidated &&
+        config_.plan_latency_ewma_alpha > 0)
+    {
+        const double latency = mrpt::system::timeDifference(
+            _.pathPlannerEnqueueTime, mrpt::Clock::now());
+        const double alpha = config_.plan_latency_ewma_alpha;
+
+        planLatencyEstimate_ =
+            planLatencyEstimate_
+                ? alpha * latency + (1 - alpha) * *planLatencyEstimate_
+                : latency;
+
+        navProfiler_.registerUserMeasure(
+            "path_planner_latency", latency, true /*has time units*/);
+    }
+
+    if (!result.chosenWp) choose_path_goal(result);
+
+    // Plans computed in advance (pipelined) may be outdated: check the
+    // chosen path against the obstacles sensed meanwhile, in a planner
+    // thread:
+    if (_.pathPlannerIsPipelined && result.chosenWp &&
+        obstacles_changed(result))
+    {
+        const auto cancellation = _.pathPlannerCancellation;
+
+        _.pathPlannerFuture = plannerScheduler_->enqueue(
+            PlannerJobClass::URGENT, cancellation,
+            [this, cancellation, p = std::move(result)]() {
+                return revalidation_function(p, cancellation);
+            });
+        _.pathPlannerIsPipelined = false;
+        return;
+    }
+
+    if (!result.chosenWp)
     {
         MRPT_LOG_WARN("RRT* failed to plan towards the target!");
+
+        // Plan again, from the current vehicle state:
+        _.pathPlannerTarget.reset();
+        _.pathPlannerContinuesPath = false;
         return;
     }
+    if (*result.chosenWp != *_.pathPlannerTarget)
+    {
+        MRPT_LOG_INFO_STREAM(
+            "Skipping to look-ahead waypoint #"
+            << *result.chosenWp << ", since waypoint #" << *_.pathPlannerTarget
+            << " can be skipped.");
+    }
+
+    // This is now the path under execution:
+    const bool continuesPath = _.pathPlannerContinuesPath;
+    _.pathPlannerTarget.reset();
+    _.pathPlannerContinuesPath = false;
+    _.activeFinalTarget        = result.chosenWp;
+    _.activePlan           = result;
+    _.activePlanGoalNodeId = result.pathGoalNodeId;
+
+    if (!send_active_plan_to_tracker(continuesPath))
+    {
+        // The plan starts at the end of a path no longer being tracked,
+        // not at the vehicle: plan again from the current vehicle state.
+        MRPT_LOG_WARN_STREAM(
+            "Pipelined plan towards waypoint #"
+            << *_.activeFinalTarget
+            << " dropped, since path tracking was lost.");
+        drop_active_plan();
+        return;
+    }
+
+    if (config_.pipelined_planning) enqueue_next_segment_planner();
 
     if (config_.vizSceneToModify)
     {
         RenderOptions ro;
-        ro.highlight_path_to_node_id = result.po.goalNodeId;
+        ro.highlight_path_to_node_id = result.pathGoalNodeId;
         ro.draw_obstacles            = false;
         ro.ground_xy_grid_frequency  = 0;  // disabled
         ro.phi2z_scale               = 0;
@@ -589,11 +1209,73 @@ void WaypointSequencer::check_new_rrtstar_output()
         // unlock:
         if (config_.on_viz_post_modify) config_.on_viz_post_modify();
     }
+}
+
+bool WaypointSequencer::send_active_plan_to_tracker(
+    const bool continuesFormerPath)
+{
+    auto& _ = innerState_;
+
+    ASSERT_(_.activePlan.has_value());
 
-    const auto plannedPath =
-        result.po.motionTree.backtrack_path(result.po.goalNodeId);
-    for (const auto& step : plannedPath)
-    {  //
-        std::cout << step.asString() << std::endl;
+    const auto& tree = _.activePlan->po.motionTree;
+    const auto  path = tree.backtrack_path(_.activePlanGoalNodeId);
+
+    std::vector<MoveEdgeSE2_TPS> edges;
+    for (const auto& node : path)
+    {
+        if (!node.parentID_) continue;  // the root
+        edges.push_back(tree.edge_to_parent(node.nodeID_));
+
+        MRPT_LOG_DEBUG_STREAM("Path step: " << node.asString());
     }
+
+    if (continuesFormerPath) return pathTracker_.append_path(edges);
+
+    pathTracker_.set_path(edges, lastVehicleOdometry_.odometry);
+    return true;
+}
+
+void WaypointSequencer::check_path_tracking()
+{
+    auto& _ = innerState_;
+
+    if (!_.activePlan) return;
+
+    // Note: if the path ended at the target, check_active_target_reached()
+    // has already dropped the active plan.
+    switch (pathTracker_.status())
+    {
+        case PathTrackerStatus::LOST:
+            MRPT_LOG_WARN_STREAM(
+                "Path tracking lost on the way to waypoint #"
+                << *_.activeFinalTarget << ", replanning.");
+            break;
+        case PathTrackerStatus::FINISHED:
+        case PathTrackerStatus::IDLE:
+            MRPT_LOG_WARN_STREAM(
+                "Path ended short of waypoint #" << *_.activeFinalTarget
+                                                 << ", replanning.");
+            break;
+        default:
+            return;
+    };
+
+    drop_active_plan();
+}
+
+void WaypointSequencer::drop_active_plan()
+{
+    auto& _ = innerState_;
+
+    _.activeFinalTarget.reset();
+    _.activePlan.reset();
+    _.activePlanGoalNodeId = INVALID_NODEID;
+
+    // The next segment was planned from the end of the dropped one:
+    _.nextSegmentCancellation.cancel();
+    _.nextSegmentCancellation = CancellationToken();
+    _.nextSegmentTarget.reset();
+
+    pathTracker_.clear_path();
 }
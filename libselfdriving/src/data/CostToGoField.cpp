@@ -0,0 +1,197 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#include <mrpt/core/bits_math.h>
+#include <mrpt/core/exceptions.h>
+#include <selfdriving/data/CostToGoField.h>
+
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+
+using namespace selfdriving;
+
+static const float UNREACHABLE = std::numeric_limits<float>::max();
+
+CostToGoField CostToGoField::Compute(
+    const mrpt::math::TPoint2D& goal, const mrpt::math::TPoint2D& bboxMin,
+    const mrpt::math::TPoint2D&                     bboxMax,
+    const std::vector<mrpt::maps::CPointsMap::Ptr>& obstacles,
+    const Parameters&                               p)
+{
+    MRPT_START
+
+    ASSERT_GT_(p.resolution, .0);
+    ASSERT_LT_(bboxMin.x, bboxMax.x);
+    ASSERT_LT_(bboxMin.y, bboxMax.y);
+
+    CostToGoField f;
+    f.goal_ = goal;
+
+    auto& g = f.grid_;
+    g.setSize(
+        bboxMin.x, bboxMax.x, bboxMin.y, bboxMax.y, p.resolution,
+        &UNREACHABLE);
+
+    const int nx = static_cast<int>(g.getSizeX());
+    const int ny = static_cast<int>(g.getSizeY());
+
+    // 1) Occupancy:
+    std::vector<uint8_t> occupied(nx * ny, 0);
+
+    const int R =
+        static_cast<int>(std::ceil(p.obstacleInflation / p.resolution));
+    const double inflation2 = mrpt::square(p.obstacleInflation);
+
+    for (const auto& obs : obstacles)
+    {
+        if (!obs) continue;
+        const auto& xs = obs->getPointsBufferRef_x();
+        const auto& ys = obs->getPointsBufferRef_y();
+        for (size_t i = 0; i < xs.size(); i++)
+        {
+            const int cx = g.x2idx(xs[i]), cy = g.y2idx(ys[i]);
+            for (int iy = std::max(0, cy - R); iy <= std::min(ny - 1, cy + R);
+                 iy++)
+            {
+                for (int ix = std::max(0, cx - R);
+                     ix <= std::min(nx - 1, cx + R); ix++)
+                {
+                    if (ix != cx || iy != cy)
+                    {
+                        const double d2 = mrpt::square(g.idx2x(ix) - xs[i]) +
+                                          mrpt::square(g.idx2y(iy) - ys[i]);
+                        if (d2 > inflation2) continue;
+                    }
+                    occupied[ix + iy * nx] = 1;
+                }
+            }
+        }
+    }
+
+    // 2) Dijkstra wavefront from the goal:
+    const int gx = g.x2idx(goal.x), gy = g.y2idx(goal.y);
+    if (gx < 0 || gy < 0 || gx >= nx || gy >= ny) return f;
+
+    // The goal is assumed to be reachable:
+    occupied[gx + gy * nx] = 0;
+
+    using entry_t = std::pair<float, int>;
+    std::priority_queue<entry_t, std::vector<entry_t>, std::greater<entry_t>>
+        open;
+
+    *g.cellByIndex(gx, gy) = 0;
+    open.emplace(0, gx + gy * nx);
+
+    const float diagStep = static_cast<float>(M_SQRT2 * p.resolution);
+    const float axisStep = static_cast<float>(p.resolution);
+
+    while (!open.empty())
+    {
+        const auto [c, idx] = open.top();
+        open.pop();
+
+        const int cx = idx % nx, cy = idx / nx;
+        if (c > *g.cellByIndex(cx, cy)) continue;  // stale entry
+
+        for (int dy = -1; dy <= 1; dy++)
+        {
+            for (int dx = -1; dx <= 1; dx++)
+            {
+                if (!dx && !dy) continue;
+                const int ix = cx + dx, iy = cy + dy;
+                if (ix < 0 || iy < 0 || ix >= nx || iy >= ny) continue;
+                if (occupied[ix + iy * nx]) continue;
+
+                const float nc = c + ((dx && dy) ? diagStep : axisStep);
+                float*      cell = g.cellByIndex(ix, iy);
+                if (nc >= *cell) continue;
+                *cell = nc;
+                open.emplace(nc, ix + iy * nx);
+            }
+        }
+    }
+
+    return f;
+    MRPT_END
+}
+
+std::optional<double> CostToGoField::cost_to_go(
+    const mrpt::math::TPoint2D& p) const
+{
+    const float* cell = grid_.cellByPos(p.x, p.y);
+    if (!cell || *cell == UNREACHABLE) return {};
+    return *cell;
+}
+
+double CostToGoField::heuristic(const mrpt::math::TPoint2D& p) const
+{
+    const double euclidean = std::hypot(p.x - goal_.x, p.y - goal_.y);
+
+    const auto c = cost_to_go(p);
+    if (!c) return euclidean;
+
+    // 8-connected paths are up to 1/cos(22.5deg) longer than straight lines,
+    // and both ends may be off the cell centers by half a cell diagonal:
+    const double MAX_OCTILE_RATIO = 1.0824;
+    const double cellDiag         = M_SQRT2 * grid_.getResolution();
+
+    return std::max(euclidean, (*c - cellDiag) / MAX_OCTILE_RATIO);
+}
+
+std::vector<mrpt::math::TPoint2D> CostToGoField::path_from(
+    const mrpt::math::TPoint2D& p, const double maxLength) const
+{
+    std::vector<mrpt::math::TPoint2D> path;
+    if (!cost_to_go(p)) return path;
+
+    const int nx = static_cast<int>(grid_.getSizeX());
+    const int ny = static_cast<int>(grid_.getSizeY());
+
+    int cx = grid_.x2idx(p.x), cy = grid_.y2idx(p.y);
+
+    // Costs strictly decrease along the path, so it cannot be longer than
+    // the number of cells:
+    const float c0 = *grid_.cellByIndex(cx, cy);
+    for (int i = 0; i < nx * ny; i++)
+    {
+        path.emplace_back(grid_.idx2x(cx), grid_.idx2y(cy));
+
+        const float c = *grid_.cellByIndex(cx, cy);
+        if (c == 0) break;  // goal reached
+        if (c0 - c >= maxLength) break;
+
+        float bestCost = c;
+        int   bestX = cx, bestY = cy;
+        for (int dy = -1; dy <= 1; dy++)
+        {
+            for (int dx = -1; dx <= 1; dx++)
+            {
+                const int ix = cx + dx, iy = cy + dy;
+                if (ix < 0 || iy < 0 || ix >= nx || iy >= ny) continue;
+                const float nc = *grid_.cellByIndex(ix, iy);
+                if (nc >= bestCost) continue;
+                bestCost = nc;
+                bestX    = ix;
+                bestY    = iy;
+            }
+        }
+        if (bestX == cx && bestY == cy) break;  // should not happen
+        cx = bestX;
+        cy = bestY;
+    }
+    return path;
+}
+
+std::optional<mrpt::math::TPoint2D> CostToGoField::lookahead_point(
+    const mrpt::math::TPoint2D& p, const double distance) const
+{
+    const auto path = path_from(p, distance);
+    if (path.empty()) return {};
+    if (*grid_.cellByPos(path.back().x, path.back().y) == 0) return goal_;
+    return path.back();
+}
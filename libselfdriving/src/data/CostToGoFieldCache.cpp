@@ -0,0 +1,81 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#include <mrpt/core/lock_helper.h>
+#include <selfdriving/data/CostToGoFieldCache.h>
+
+using namespace selfdriving;
+
+std::shared_ptr<const CostToGoField> CostToGoFieldCache::get(
+    const mrpt::math::TPoint2D& goal, const mrpt::math::TPoint2D& bboxMin,
+    const mrpt::math::TPoint2D&             bboxMax,
+    const std::vector<ObstacleSource::Ptr>& obstacles,
+    const CostToGoField::Parameters&        p)
+{
+    MRPT_START
+
+    Entry key;
+    key.goal   = goal;
+    key.params = p;
+
+    std::vector<mrpt::maps::CPointsMap::Ptr> obstaclePoints;
+    for (const auto& os : obstacles)
+    {
+        if (!os || os->dynamic()) continue;
+        const auto& pts = obstaclePoints.emplace_back(os->obstacles());
+        ASSERT_(pts);
+        key.sources.emplace_back(
+            os.get(), os->version(), obstacle_points_hash(*pts));
+    }
+
+    const auto lambdaSameKey = [&key](const Entry& e) {
+        return e.goal == key.goal &&
+               e.params.resolution == key.params.resolution &&
+               e.params.obstacleInflation == key.params.obstacleInflation &&
+               e.sources == key.sources;
+    };
+    const auto lambdaCovers = [&](const CostToGoField& f) {
+        const auto fMin = f.bbox_min(), fMax = f.bbox_max();
+        return fMin.x <= bboxMin.x && fMin.y <= bboxMin.y &&
+               fMax.x >= bboxMax.x && fMax.y >= bboxMax.y;
+    };
+
+    {
+        auto lck = mrpt::lockHelper(mtx_);
+        for (auto it = entries_.begin(); it != entries_.end(); ++it)
+        {
+            if (!lambdaSameKey(*it) || !lambdaCovers(*it->field)) continue;
+
+            hits_++;
+            entries_.splice(entries_.begin(), entries_, it);
+            return entries_.front().field;
+        }
+        misses_++;
+    }
+
+    // Not found: compute it without holding the lock.
+    key.field = std::make_shared<const CostToGoField>(
+        CostToGoField::Compute(goal, bboxMin, bboxMax, obstaclePoints, p));
+
+    auto lck = mrpt::lockHelper(mtx_);
+
+    // Remove outdated entries for the same goal and sources:
+    entries_.remove_if(lambdaSameKey);
+
+    entries_.push_front(key);
+    while (entries_.size() > maxEntries_) entries_.pop_back();
+
+    return key.field;
+    MRPT_END
+}
+
+void CostToGoFieldCache::clear()
+{
+    auto lck = mrpt::lockHelper(mtx_);
+    entries_.clear();
+    hits_   = 0;
+    misses_ = 0;
+}
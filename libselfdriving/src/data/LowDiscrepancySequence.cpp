@@ -0,0 +1,75 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#include <mrpt/core/exceptions.h>
+#include <mrpt/random/RandomGenerators.h>
+#include <selfdriving/data/LowDiscrepancySequence.h>
+
+#include <algorithm>
+#include <numeric>
+
+using namespace selfdriving;
+
+// First primes, used as the bases of each dimension:
+static const uint32_t PRIMES[] = {2,  3,  5,  7,  11, 13, 17, 19,
+                                  23, 29, 31, 37, 41, 43, 47, 53};
+
+HaltonSequence::HaltonSequence(
+    size_t dimensions, const std::optional<uint32_t>& scrambleSeed)
+{
+    MRPT_START
+
+    constexpr size_t maxDims = sizeof(PRIMES) / sizeof(PRIMES[0]);
+    ASSERT_GT_(dimensions, 0U);
+    ASSERT_LE_(dimensions, maxDims);
+
+    bases_.assign(PRIMES, PRIMES + dimensions);
+
+    if (!scrambleSeed) return;
+
+    mrpt::random::CRandomGenerator rng(*scrambleSeed);
+
+    permutations_.resize(dimensions);
+    for (size_t d = 0; d < dimensions; d++)
+    {
+        // Keep the digit "0" in place, so the infinite trailing zeros of
+        // each index do not add a bias to the radical inverse:
+        auto& perm = permutations_[d];
+        perm.resize(bases_[d]);
+        std::iota(perm.begin(), perm.end(), 0);
+        for (size_t i = perm.size() - 1; i > 1; i--)
+            std::swap(perm[i], perm[1 + rng.drawUniform32bit() % i]);
+    }
+
+    // Different seeds also start at different points of the sequence:
+    index_ = 1 + rng.drawUniform32bit() % 4096;
+
+    MRPT_END
+}
+
+double HaltonSequence::radical_inverse(size_t dim, uint64_t i) const
+{
+    const uint32_t base    = bases_[dim];
+    const double   invBase = 1.0 / base;
+    const auto*    perm =
+        permutations_.empty() ? nullptr : permutations_[dim].data();
+
+    double r = 0, f = invBase;
+    for (; i > 0; i /= base, f *= invBase)
+    {
+        const uint32_t digit = i % base;
+        r += f * (perm ? perm[digit] : digit);
+    }
+    // Avoid returning 1.0 due to rounding errors:
+    return std::min(r, 1.0 - 1e-12);
+}
+
+void HaltonSequence::next(double* out)
+{
+    for (size_t d = 0; d < bases_.size(); d++)
+        out[d] = radical_inverse(d, index_);
+    index_++;
+}
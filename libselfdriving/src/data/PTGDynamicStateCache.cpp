@@ -0,0 +1,56 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#include <selfdriving/data/PTGDynamicStateCache.h>
+
+#include <cmath>
+
+using namespace selfdriving;
+
+static double quantize(const double v, const double step)
+{
+    if (step <= 0) return v;
+    return std::round(v / step) * step;
+}
+
+mrpt::math::TTwist2D PTGDynamicStateCache::quantized_velocity(
+    const mrpt::math::TTwist2D& localVel) const
+{
+    return {
+        quantize(localVel.vx, linearVelocityQuantization),
+        quantize(localVel.vy, linearVelocityQuantization),
+        quantize(localVel.omega, angularVelocityQuantization)};
+}
+
+bool PTGDynamicStateCache::update(
+    ptg_t& ptg, const ptg_t::TNavDynamicState& ds)
+{
+    ptg_t::TNavDynamicState qds = ds;
+    qds.curVelLocal             = quantized_velocity(ds.curVelLocal);
+
+    const key_t key = {
+        qds.curVelLocal.vx, qds.curVelLocal.vy, qds.curVelLocal.omega,
+        qds.targetRelSpeed};
+
+    if (auto it = lastApplied_.find(&ptg);
+        it != lastApplied_.end() && it->second == key)
+    {
+        ++hits_;
+        return true;
+    }
+
+    ++misses_;
+    ptg.updateNavDynamicState(qds);
+    lastApplied_[&ptg] = key;
+    return false;
+}
+
+void PTGDynamicStateCache::clear()
+{
+    lastApplied_.clear();
+    hits_   = 0;
+    misses_ = 0;
+}
@@ -0,0 +1,143 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#include <selfdriving/data/PTGReachableRegion.h>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace selfdriving;
+
+void PTGReachableRegion::build(
+    ptg_t& ptg, const double resolution, const double dilationDistance)
+{
+    MRPT_START
+
+    cells_.clear();
+    if (resolution <= 0) return;  // mask disabled
+
+    // A mask built for one initial velocity does not hold for others:
+    if (depends_on_velocity(ptg, resolution)) return;
+
+    const double refDist = ptg.getRefDistance();
+    ASSERT_GT_(refDist, .0);
+
+    const int dilation = std::max<int>(
+        1, static_cast<int>(std::ceil(dilationDistance / resolution)));
+
+    resolution_ = resolution;
+    minXY_      = -refDist - dilation * resolution;
+    size_ = static_cast<int>(std::ceil(2 * (-minXY_) / resolution)) + 1;
+
+    std::vector<uint8_t> reached(size_ * size_, 0);
+
+    const auto lambdaMark = [&](const mrpt::math::TPoint2D& p) {
+        const int cx = static_cast<int>((p.x - minXY_) / resolution_);
+        const int cy = static_cast<int>((p.y - minXY_) / resolution_);
+        if (cx < 0 || cy < 0 || cx >= size_ || cy >= size_) return;
+        reached[cx + cy * size_] = 1;
+    };
+    const auto lambdaMarkSegment = [&](const mrpt::math::TPoint2D& a,
+                                       const mrpt::math::TPoint2D& b) {
+        const auto   delta = b - a;
+        const size_t n =
+            1 + static_cast<size_t>(2 * delta.norm() / resolution_);
+        for (size_t i = 0; i <= n; i++) lambdaMark(a + delta * (double(i) / n));
+    };
+
+    // 1) Mark the cells swept by all trajectories, and those in between two
+    // consecutive trajectories, since paths are a discretization of a
+    // continuous set of motions:
+    const size_t nPaths = ptg.getAlphaValuesCount();
+    for (size_t k = 0; k < nPaths; k++)
+    {
+        const size_t kNext  = (k + 1) % nPaths;
+        const size_t nSteps = ptg.getPathStepCount(k);
+        const size_t nStepsNext =
+            nPaths > 1 ? ptg.getPathStepCount(kNext) : size_t(0);
+
+        for (size_t step = 0; step < nSteps; step++)
+        {
+            const auto p = mrpt::math::TPoint2D(ptg.getPathPose(k, step));
+            lambdaMark(p);
+
+            if (step < nStepsNext)
+            {
+                lambdaMarkSegment(
+                    p, mrpt::math::TPoint2D(ptg.getPathPose(kNext, step)));
+            }
+        }
+    }
+
+    // 2) Dilate:
+    cells_.assign(size_ * size_, 0);
+    for (int cy = 0; cy < size_; cy++)
+    {
+        for (int cx = 0; cx < size_; cx++)
+        {
+            if (!reached[cx + cy * size_]) continue;
+
+            for (int dy = -dilation; dy <= dilation; dy++)
+            {
+                const int y = cy + dy;
+                if (y < 0 || y >= size_) continue;
+                for (int dx = -dilation; dx <= dilation; dx++)
+                {
+                    const int x = cx + dx;
+                    if (x < 0 || x >= size_) continue;
+                    cells_[x + y * size_] = 1;
+                }
+            }
+        }
+    }
+
+    MRPT_END
+}
+
+bool PTGReachableRegion::depends_on_velocity(
+    ptg_t& ptg, const double tolerance)
+{
+    MRPT_START
+
+    const auto   original = ptg.getCurrentNavDynamicState();
+    const size_t nPaths   = ptg.getAlphaValuesCount();
+
+    std::vector<std::vector<mrpt::math::TPose2D>> refPaths(nPaths);
+    for (size_t k = 0; k < nPaths; k++)
+        for (size_t step = 0; step < ptg.getPathStepCount(k); step++)
+            refPaths[k].push_back(ptg.getPathPose(k, step));
+
+    // Moving forward, sideways (for holonomic PTGs), and turning:
+    const double v = 0.5 * ptg.getMaxLinVel(), w = 0.5 * ptg.getMaxAngVel();
+    const std::vector<mrpt::math::TTwist2D> probeVels = {
+        {v, 0, 0}, {0, v, 0}, {0, 0, w}};
+
+    bool dependent = false;
+    for (const auto& vel : probeVels)
+    {
+        auto ds        = original;
+        ds.curVelLocal = vel;
+        ptg.updateNavDynamicState(ds);
+
+        for (size_t k = 0; k < nPaths && !dependent; k++)
+        {
+            const size_t nSteps =
+                std::min<size_t>(refPaths[k].size(), ptg.getPathStepCount(k));
+            for (size_t step = 0; step < nSteps && !dependent; step++)
+            {
+                const auto  p = ptg.getPathPose(k, step);
+                const auto& r = refPaths[k][step];
+                dependent = std::hypot(p.x - r.x, p.y - r.y) > tolerance;
+            }
+        }
+        if (dependent) break;
+    }
+
+    ptg.updateNavDynamicState(original);
+    return dependent;
+
+    MRPT_END
+}
@@ -0,0 +1,185 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#include <mrpt/io/CFileGZInputStream.h>
+#include <mrpt/io/CFileGZOutputStream.h>
+#include <mrpt/serialization/CArchive.h>
+#include <mrpt/system/datetime.h>
+#include <mrpt/system/filesystem.h>
+#include <selfdriving/data/PTGRoadmap.h>
+#include <selfdriving/data/fnv1a_hash.h>
+
+#include <cinttypes>
+#include <functional>
+#include <thread>
+
+using namespace selfdriving;
+
+// Increase if the file format changes:
+static const uint8_t ROADMAP_FILE_VERSION = 1;
+static const char    ROADMAP_FILE_MAGIC[] = "PTGRoadmap";
+
+void PTGRoadmap::clear()
+{
+    nodes.clear();
+    edges.clear();
+    outEdges.clear();
+    ptgSignatures.clear();
+    mapSignature = 0;
+}
+
+PTGRoadmap::node_index_t PTGRoadmap::add_node(const mrpt::math::TPose2D& p)
+{
+    nodes.push_back(p);
+    outEdges.resize(nodes.size());
+    return nodes.size() - 1;
+}
+
+PTGRoadmap::edge_index_t PTGRoadmap::add_edge(const edge_t& e)
+{
+    ASSERT_LT_(e.from, nodes.size());
+    ASSERT_LT_(e.to, nodes.size());
+
+    edges.push_back(e);
+    outEdges.resize(nodes.size());
+    outEdges[e.from].push_back(edges.size() - 1);
+    return edges.size() - 1;
+}
+
+void PTGRoadmap::rebuild_adjacency()
+{
+    outEdges.clear();
+    outEdges.resize(nodes.size());
+    for (edge_index_t i = 0; i < edges.size(); i++)
+        outEdges.at(edges[i].from).push_back(i);
+}
+
+bool PTGRoadmap::compatible_with(const TrajectoriesAndRobotShape& trs) const
+{
+    if (trs.ptgs.size() != ptgSignatures.size()) return false;
+    for (size_t i = 0; i < trs.ptgs.size(); i++)
+        if (trs.ptg_signature_hash(i) != ptgSignatures[i]) return false;
+    return true;
+}
+
+bool PTGRoadmap::compatible_with(
+    const TrajectoriesAndRobotShape&        trs,
+    const std::vector<ObstacleSource::Ptr>& obstacles) const
+{
+    return compatible_with(trs) &&
+           static_obstacles_signature(obstacles) == mapSignature;
+}
+
+uint64_t PTGRoadmap::static_obstacles_signature(
+    const std::vector<ObstacleSource::Ptr>& obstacles)
+{
+    uint64_t h = 0;
+    for (const auto& os : obstacles)
+    {
+        if (!os || os->dynamic()) continue;
+        const auto pts = os->obstacles();
+        ASSERT_(pts);
+        // Combine, order-dependent:
+        h = h * FNV1A_64_PRIME ^ obstacle_points_hash(*pts);
+    }
+    return h;
+}
+
+bool PTGRoadmap::save_to_file(const std::string& fileName) const
+{
+    // Write to a private file first, then rename it (atomic):
+    const std::string tmpFile = mrpt::format(
+        "%s.%016" PRIx64 ".tmp", fileName.c_str(),
+        static_cast<uint64_t>(
+            std::hash<std::thread::id>()(std::this_thread::get_id()) ^
+            mrpt::Clock::now().time_since_epoch().count()));
+
+    if (!write_to_file(tmpFile) ||
+        !mrpt::system::renameFile(tmpFile, fileName))
+    {
+        mrpt::system::deleteFile(tmpFile);
+        return false;
+    }
+    return true;
+}
+
+bool PTGRoadmap::write_to_file(const std::string& fileName) const
+{
+    mrpt::io::CFileGZOutputStream f;
+    if (!f.open(fileName)) return false;
+
+    auto a = mrpt::serialization::archiveFrom(f);
+
+    a << std::string(ROADMAP_FILE_MAGIC) << ROADMAP_FILE_VERSION;
+
+    a.WriteAs<uint32_t>(ptgSignatures.size());
+    for (const auto& s : ptgSignatures) a << s;
+    a << mapSignature;
+
+    a.WriteAs<uint32_t>(nodes.size());
+    for (const auto& p : nodes) a << p.x << p.y << p.phi;
+
+    a.WriteAs<uint32_t>(edges.size());
+    for (const auto& e : edges)
+    {
+        a.WriteAs<uint32_t>(e.from);
+        a.WriteAs<uint32_t>(e.to);
+        a.WriteAs<uint8_t>(e.ptgIndex);
+        a.WriteAs<int16_t>(e.ptgPathIndex);
+        a << e.ptgDist << e.cost;
+    }
+    return true;
+}
+
+bool PTGRoadmap::load_from_file(const std::string& fileName)
+{
+    clear();
+
+    mrpt::io::CFileGZInputStream f;
+    if (!f.open(fileName)) return false;
+
+    auto a = mrpt::serialization::archiveFrom(f);
+
+    try
+    {
+        std::string magic;
+        uint8_t     version;
+        a >> magic >> version;
+        if (magic != ROADMAP_FILE_MAGIC || version != ROADMAP_FILE_VERSION)
+            return false;
+
+        ptgSignatures.resize(a.ReadAs<uint32_t>());
+        for (auto& s : ptgSignatures) a >> s;
+        a >> mapSignature;
+
+        nodes.resize(a.ReadAs<uint32_t>());
+        for (auto& p : nodes) a >> p.x >> p.y >> p.phi;
+
+        edges.resize(a.ReadAs<uint32_t>());
+        for (auto& e : edges)
+        {
+            e.from         = a.ReadAs<uint32_t>();
+            e.to           = a.ReadAs<uint32_t>();
+            e.ptgIndex     = a.ReadAs<uint8_t>();
+            e.ptgPathIndex = a.ReadAs<int16_t>();
+            a >> e.ptgDist >> e.cost;
+
+            if (e.from >= nodes.size() || e.to >= nodes.size())
+            {
+                clear();
+                return false;
+            }
+        }
+    }
+    catch (const std::exception&)
+    {
+        clear();
+        return false;
+    }
+
+    rebuild_adjacency();
+    return true;
+}
@@ -4,6 +4,21 @@
  * See LICENSE for license information.
  * ------------------------------------------------------------------------- */
 
+#include <mrpt/core/bits_math.h>
+#include <mrpt/math/wrap2pi.h>
 #include <selfdriving/data/PlannerInput.h>
 
+#include <cmath>
+
 using namespace selfdriving;
+
+bool PlannerGoal::is_reached_by(const mrpt::math::TPose2D& p) const
+{
+    const auto& g = state.pose;
+    if (mrpt::hypot_fast(p.x - g.x, p.y - g.y) > distanceTolerance)
+        return false;
+
+    return !headingTolerance.has_value() ||
+           std::abs(mrpt::math::angDistance(p.phi, g.phi)) <=
+               *headingTolerance;
+}
@@ -7,3 +7,28 @@
 #include <selfdriving/data/PlannerOutput.h>
 
 using namespace selfdriving;
+
+void PlannerOutput::update_extra_goal_results()
+{
+    const auto& goals = originalInput.extraGoals;
+
+    extraGoals.assign(goals.size(), PlannerGoalResult());
+    if (goals.empty()) return;
+
+    for (const auto& [nodeId, node] : motionTree.nodes())
+    {
+        if (nodeId == goalNodeId) continue;
+        if (node.cost_ == std::numeric_limits<cost_t>::max()) continue;
+
+        for (size_t i = 0; i < goals.size(); i++)
+        {
+            auto& r = extraGoals[i];
+            if (node.cost_ >= r.pathCost) continue;
+            if (!goals[i].is_reached_by(node.pose)) continue;
+
+            r.success    = true;
+            r.goalNodeId = nodeId;
+            r.pathCost   = node.cost_;
+        }
+    }
+}
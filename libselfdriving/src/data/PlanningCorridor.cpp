@@ -0,0 +1,85 @@
+/* -------------------------------------------------------------------------
+ *   SelfDriving C++ library based on PTGs and mrpt-nav
+ * Copyright (C) 2019-2021 Jose Luis Blanco, University of Almeria
+ * See LICENSE for license information.
+ * ------------------------------------------------------------------------- */
+
+#include <mrpt/core/bits_math.h>
+#include <mrpt/core/exceptions.h>
+#include <selfdriving/data/PlanningCorridor.h>
+
+#include <cmath>
+
+using namespace selfdriving;
+
+PlanningCorridor PlanningCorridor::FromPath(
+    const std::vector<mrpt::math::TPoint2D>& path, const double width,
+    const double resolution)
+{
+    MRPT_START
+
+    ASSERT_GT_(resolution, .0);
+    ASSERT_GE_(width, .0);
+
+    PlanningCorridor c;
+    if (path.empty()) return c;
+
+    mrpt::math::TPoint2D bbMin = path.front(), bbMax = path.front();
+    for (const auto& p : path)
+    {
+        mrpt::keep_min(bbMin.x, p.x);
+        mrpt::keep_min(bbMin.y, p.y);
+        mrpt::keep_max(bbMax.x, p.x);
+        mrpt::keep_max(bbMax.y, p.y);
+    }
+
+    const uint8_t outside = 0;
+    c.mask_.setSize(
+        bbMin.x - width - resolution, bbMax.x + width + resolution,
+        bbMin.y - width - resolution, bbMax.y + width + resolution, resolution,
+        &outside);
+
+    const int    nx     = static_cast<int>(c.mask_.getSizeX());
+    const int    ny     = static_cast<int>(c.mask_.getSizeY());
+    const int    R      = static_cast<int>(std::ceil(width / resolution));
+    const double width2 = mrpt::square(width);
+
+    for (const auto& p : path)
+    {
+        const int cx = c.mask_.x2idx(p.x), cy = c.mask_.y2idx(p.y);
+        for (int iy = std::max(0, cy - R); iy <= std::min(ny - 1, cy + R); iy++)
+        {
+            for (int ix = std::max(0, cx - R); ix <= std::min(nx - 1, cx + R);
+                 ix++)
+            {
+                uint8_t* cell = c.mask_.cellByIndex(ix, iy);
+                if (*cell) continue;
+
+                const mrpt::math::TPoint2D center(
+                    c.mask_.idx2x(ix), c.mask_.idx2y(iy));
+                if (mrpt::square(center.x - p.x) +
+                        mrpt::square(center.y - p.y) >
+                    width2)
+                    continue;
+
+                *cell = 1;
+                c.cells_.push_back(center);
+            }
+        }
+    }
+
+    return c;
+    MRPT_END
+}
+
+mrpt::math::TPoint2D PlanningCorridor::draw_uniform(
+    mrpt::random::CRandomGenerator& rng) const
+{
+    ASSERT_(!empty());
+
+    const auto&  center = cells_[rng.drawUniform32bit() % cells_.size()];
+    const double h      = 0.5 * mask_.getResolution();
+
+    return {
+        center.x + rng.drawUniform(-h, h), center.y + rng.drawUniform(-h, h)};
+}
@@ -4,20 +4,152 @@
  * See LICENSE for license information.
  * ------------------------------------------------------------------------- */
 
+#include <mrpt/config/CConfigFileMemory.h>
+#include <mrpt/system/filesystem.h>
 #include <selfdriving/data/TrajectoriesAndRobotShape.h>
+#include <selfdriving/data/fnv1a_hash.h>
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <ctime>
+#include <functional>
+#include <future>
+#include <thread>
 
 using namespace selfdriving;
 
+// A string with all the parameters that determine the contents of the PTG
+// precomputed tables:
+static std::string ptg_signature(const ptg_t& ptg, const RobotShape& shape)
+{
+    mrpt::config::CConfigFileMemory cfg;
+    ptg.saveToConfigFile(cfg, "ptg");
+
+    std::string sig;
+    cfg.getContent(sig);
+    sig += ptg.GetRuntimeClass()->className;
+
+    if (auto pPoly = std::get_if<mrpt::math::TPolygon2D>(&shape); pPoly)
+    {
+        for (const auto& pt : *pPoly)
+            sig += mrpt::format("\n%.06f %.06f", pt.x, pt.y);
+    }
+    else if (auto pRadius = std::get_if<robot_radius_t>(&shape); pRadius)
+    {
+        sig += mrpt::format("\nR=%.06f", *pRadius);
+    }
+    return sig;
+}
+
+// Initializes a PTG such that its precomputed tables are built at most once
+// among all processes sharing the same cache directory: the first process
+// takes a lock file and builds the tables into a temporary file, which is
+// then atomically renamed, so others never read a partially-written cache.
+// Other processes wait for the lock to be released and just load the file.
+// Locks older than `lockTimeout` (e.g. from a crashed process) are removed.
+static void initialize_ptg_with_shared_cache(
+    ptg_t& ptg, const std::string& cacheFile, const double lockTimeout)
+{
+    using namespace std::chrono_literals;
+
+    const std::string lockFile = cacheFile + ".lock";
+
+    // Builds the tables into a private file, then publishes it:
+    const auto lambdaBuildAndPublish = [&]() {
+        const std::string tmpFile = mrpt::format(
+            "%s.%016" PRIx64 ".tmp", cacheFile.c_str(),
+            static_cast<uint64_t>(
+                std::hash<std::thread::id>()(std::this_thread::get_id()) ^
+                mrpt::Clock::now().time_since_epoch().count()));
+
+        ptg.initialize(tmpFile, false /*verbose*/);
+
+        if (mrpt::system::fileExists(tmpFile) &&
+            !mrpt::system::renameFile(tmpFile, cacheFile))
+        {
+            mrpt::system::deleteFile(tmpFile);
+        }
+    };
+
+    const auto tStart = mrpt::Clock::now();
+    for (;;)
+    {
+        // Already built by us or someone else?
+        if (mrpt::system::fileExists(cacheFile))
+        {
+            ptg.initialize(cacheFile, false /*verbose*/);
+            return;
+        }
+
+        // Try to become the one building the tables ("x": fail if exists):
+        if (FILE* f = std::fopen(lockFile.c_str(), "wx"); f)
+        {
+            std::fclose(f);
+            break;
+        }
+
+        // A lock older than the timeout was left behind by a process that
+        // died while building: break it and try to take it ourselves.
+        if (const time_t lockTime =
+                mrpt::system::getFileModificationTime(lockFile);
+            lockTime != 0 &&
+            std::difftime(std::time(nullptr), lockTime) > lockTimeout)
+        {
+            mrpt::system::deleteFile(lockFile);
+            continue;
+        }
+
+        // Someone else is (still) building it. Wait, but not forever:
+        if (mrpt::system::timeDifference(tStart, mrpt::Clock::now()) >
+            lockTimeout)
+        {
+            lambdaBuildAndPublish();
+            return;
+        }
+        std::this_thread::sleep_for(100ms);
+    }
+
+    // We own the lock:
+    try
+    {
+        lambdaBuildAndPublish();
+    }
+    catch (...)
+    {
+        mrpt::system::deleteFile(lockFile);
+        throw;
+    }
+    mrpt::system::deleteFile(lockFile);
+}
+
 void TrajectoriesAndRobotShape::clear() { *this = TrajectoriesAndRobotShape(); }
 
+uint64_t TrajectoriesAndRobotShape::ptg_signature_hash(const size_t i) const
+{
+    return fnv1a_64(ptg_signature(*ptgs.at(i), robotShape));
+}
+
 void TrajectoriesAndRobotShape::initFromConfigFile(
     mrpt::config::CConfigFileBase& c, const std::string& s)
 {
     MRPT_START
 
-    const auto   ptg_cache_files_directory = std::string(".");
     unsigned int PTG_COUNT = c.read_int(s, "PTG_COUNT", 0, true);
 
+    const auto ptg_cache_files_directory =
+        c.read_string(s, "ptg_cache_files_directory", ".", false);
+
+    const bool parallelInit =
+        c.read_bool(s, "ptg_parallel_initialization", true, false);
+
+    // Max time to wait for another process building the same PTG tables [s]:
+    const double cacheLockTimeout =
+        c.read_double(s, "ptg_cache_lock_timeout", 120.0, false);
+
+    const double reachableRegionResolution =
+        c.read_double(s, "PTG_reachable_region_resolution", 0.10, false);
+
     // Load robot shape: 1/2 polygon
     // ---------------------------------------------
     mrpt::math::CPolygon robShape;
@@ -54,6 +186,14 @@ void TrajectoriesAndRobotShape::initFromConfigFile(
     // Free previous PTGs:
     ptgs.clear();
     ptgs.resize(PTG_COUNT);
+    reachableRegions.clear();
+    reachableRegions.resize(PTG_COUNT);
+
+    if (!ptg_cache_files_directory.empty() &&
+        !mrpt::system::directoryExists(ptg_cache_files_directory))
+    {
+        mrpt::system::createDirectory(ptg_cache_files_directory);
+    }
 
     for (unsigned int n = 0; n < PTG_COUNT; n++)
     {
@@ -85,15 +225,46 @@ void TrajectoriesAndRobotShape::initFromConfigFile(
             // Set it:
             ptg_circ->setRobotShapeRadius(std::get<robot_radius_t>(robotShape));
         }
+    }
 
-        // Init:
-        new_ptg->initialize(
+    // Init: this may take a while for PTGs that build collision grids, so
+    // do it in parallel. Cache files are named after a hash of all PTG
+    // parameters and the robot shape, so stale tables are never reused, and
+    // they are shared among all processes using the same cache directory:
+    const auto lambdaInitPTG = [&](const unsigned int n) {
+        auto& ptg = *ptgs[n];
+
+        const uint64_t hash = ptg_signature_hash(n);
+
+        initialize_ptg_with_shared_cache(
+            ptg,
             mrpt::format(
-                "%s/ReacNavGrid_%03u.dat.gz", ptg_cache_files_directory.c_str(),
-                n),
-            false /*verbose*/
-        );
+                "%s/PTG_%016" PRIx64 ".dat.gz",
+                ptg_cache_files_directory.c_str(), hash),
+            cacheLockTimeout);
+
+        // Precompute the PTG reachable area:
+        reachableRegions[n].build(ptg, reachableRegionResolution);
+    };
+
+    if (parallelInit && PTG_COUNT > 1)
+    {
+        std::vector<std::future<void>> tasks;
+        for (unsigned int n = 0; n < PTG_COUNT; n++)
+        {
+            tasks.emplace_back(
+                std::async(std::launch::async, lambdaInitPTG, n));
+        }
+
+        // Wait for all, and rethrow exceptions, if any:
+        for (auto& t : tasks) t.wait();
+        for (auto& t : tasks) t.get();
     }
+    else
+    {
+        for (unsigned int n = 0; n < PTG_COUNT; n++) lambdaInitPTG(n);
+    }
+
     initialized_ = true;
     MRPT_END
 }
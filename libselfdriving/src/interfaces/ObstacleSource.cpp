@@ -4,12 +4,28 @@
  * See LICENSE for license information.
  * ------------------------------------------------------------------------- */
 
+#include <selfdriving/data/fnv1a_hash.h>
 #include <selfdriving/interfaces/ObstacleSource.h>
 
 using namespace selfdriving;
 
 ObstacleSource::~ObstacleSource() = default;
 
+uint64_t selfdriving::obstacle_points_hash(const mrpt::maps::CPointsMap& pts)
+{
+    // FNV-1a over the raw coordinates:
+    uint64_t h = FNV1A_64_OFFSET;
+    for (size_t i = 0; i < pts.size(); i++)
+    {
+        float x, y, z;
+        pts.getPoint(i, x, y, z);
+        h = fnv1a_64(&x, sizeof(x), h);
+        h = fnv1a_64(&y, sizeof(y), h);
+        h = fnv1a_64(&z, sizeof(z), h);
+    }
+    return h;
+}
+
 ObstacleSource::Ptr ObstacleSource::FromStaticPointcloud(
     const mrpt::maps::CPointsMap::Ptr& pc)
 {
@@ -6,6 +6,10 @@
 
 #include <mrpt/core/initializer.h>
 #include <selfdriving/algos/CostEvaluatorCostMap.h>
+#include <selfdriving/algos/TPS_Astar.h>
+#include <selfdriving/algos/TPS_BITstar.h>
+#include <selfdriving/algos/TPS_PRM.h>
+#include <selfdriving/algos/TPS_RRTstar.h>
 
 MRPT_INITIALIZER(selfdriving_register)
 {
@@ -13,4 +17,10 @@ MRPT_INITIALIZER(selfdriving_register)
 
     mrpt::rtti::registerClass(CLASS_ID(CostEvaluator));
     mrpt::rtti::registerClass(CLASS_ID(CostEvaluatorCostMap));
+
+    mrpt::rtti::registerClass(CLASS_ID(Planner));
+    mrpt::rtti::registerClass(CLASS_ID(TPS_RRTstar));
+    mrpt::rtti::registerClass(CLASS_ID(TPS_BITstar));
+    mrpt::rtti::registerClass(CLASS_ID(TPS_PRM));
+    mrpt::rtti::registerClass(CLASS_ID(TPS_Astar));
 }